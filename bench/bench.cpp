@@ -0,0 +1,614 @@
+#include "NeuralNet.hpp"
+#include "Activation.hpp"
+#include "ModelFile.hpp"
+#include "PackedDataset.hpp"
+#include "Gemm.hpp"
+#include "InferencePlan.hpp"
+#include "SparseNet.hpp"
+#include "BatchProducer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Benchmark suite, run with `make bench`.
+//
+// Every benchmark is timed as a number of samples, each sample being a fixed number of calls
+// (enough to take at least MIN_SAMPLE_NS, so tiny operations aren't dominated by the clock).
+// Samples are collected until --min-time seconds have passed, with at least MIN_SAMPLES of them.
+// Results go to stdout (or --out) as JSON, a readable summary goes to stderr.
+//
+//   bench [--filter text] [--min-time seconds] [--out path]
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const double MIN_SAMPLE_NS = 20000.0;
+const size_t MIN_SAMPLES = 10;
+const size_t MAX_SAMPLES = 100000;
+
+// work done by one call, used to turn times into rates (0 = not reported)
+struct Work{
+    double flops;
+    double bytes;
+    double items;
+};
+
+struct BenchResult{
+    std::string name;
+    size_t calls_per_sample;
+    size_t samples;
+    double median_ns; // per call
+    double p99_ns;
+    double min_ns;
+    Work work;
+};
+
+struct BenchOptions{
+    std::string filter;
+    double min_time = 0.5;
+    std::string out_path;
+};
+
+double elapsed_ns(Clock::time_point start)
+{
+    return std::chrono::duration<double,std::nano>(Clock::now() - start).count();
+}
+
+// value at fraction q of sorted times
+double percentile(const std::vector<double>& sorted, double q)
+{
+    size_t index = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+class BenchRunner{
+    public:
+        BenchRunner(const BenchOptions& options) : options(options) {}
+
+        void run(const std::string& name, Work work, const std::function<void()>& call)
+        {
+            if(!options.filter.empty() && name.find(options.filter) == std::string::npos){
+                return;
+            }
+            // the first call warms up caches and buffers and sizes the samples
+            auto start = Clock::now();
+            call();
+            double first_ns = std::max(elapsed_ns(start),1.0);
+            size_t calls = static_cast<size_t>(std::max(1.0,MIN_SAMPLE_NS / first_ns));
+
+            std::vector<double> times;
+            auto bench_start = Clock::now();
+            while(times.size() < MAX_SAMPLES &&
+                  (times.size() < MIN_SAMPLES || elapsed_ns(bench_start) < options.min_time * 1e9))
+            {
+                start = Clock::now();
+                for(size_t n = 0; n < calls; n++){
+                    call();
+                }
+                times.push_back(elapsed_ns(start) / calls);
+            }
+            std::sort(times.begin(),times.end());
+
+            BenchResult result = {name, calls, times.size(), percentile(times,0.5), percentile(times,0.99), times.front(), work};
+            results.push_back(result);
+            print_summary(result);
+        }
+
+        std::string json() const
+        {
+            std::ostringstream out;
+            out.precision(10);
+            std::time_t now = std::time(nullptr);
+            char date[32];
+            std::strftime(date,sizeof(date),"%Y-%m-%dT%H:%M:%SZ",std::gmtime(&now));
+            out << "{\n";
+            out << "  \"context\": {\"date\": \"" << date << "\", \"isa\": \"" << gemm_isa_name(gemm_get_isa())
+                << "\", \"hardware_threads\": " << std::thread::hardware_concurrency()
+                << ", \"compiler\": \"" << escape(__VERSION__) << "\"},\n";
+            out << "  \"benchmarks\": [";
+            for(size_t n = 0; n < results.size(); n++)
+            {
+                const BenchResult& r = results[n];
+                double seconds = r.median_ns * 1e-9;
+                out << (n ? ",\n" : "\n") << "    {\"name\": \"" << escape(r.name) << "\""
+                    << ", \"samples\": " << r.samples
+                    << ", \"calls_per_sample\": " << r.calls_per_sample
+                    << ", \"median_ns\": " << r.median_ns
+                    << ", \"p99_ns\": " << r.p99_ns
+                    << ", \"min_ns\": " << r.min_ns;
+                if(r.work.flops > 0){
+                    out << ", \"gflops\": " << r.work.flops / r.median_ns;
+                }
+                if(r.work.bytes > 0){
+                    out << ", \"bytes_per_second\": " << r.work.bytes / seconds;
+                }
+                if(r.work.items > 0){
+                    out << ", \"items_per_second\": " << r.work.items / seconds;
+                }
+                out << "}";
+            }
+            out << "\n  ]\n}\n";
+            return out.str();
+        }
+
+    private:
+        static std::string escape(const std::string& text)
+        {
+            std::string escaped;
+            for(char c : text)
+            {
+                if(c == '"' || c == '\\'){
+                    escaped += '\\';
+                }
+                escaped += c;
+            }
+            return escaped;
+        }
+
+        static void print_summary(const BenchResult& r)
+        {
+            char line[256];
+            std::snprintf(line,sizeof(line),"%-36s median %12.1f ns  p99 %12.1f ns",r.name.c_str(),r.median_ns,r.p99_ns);
+            std::cerr << line;
+            if(r.work.flops > 0){
+                std::snprintf(line,sizeof(line),"  %8.2f GFLOP/s",r.work.flops / r.median_ns);
+                std::cerr << line;
+            }
+            if(r.work.bytes > 0){
+                std::snprintf(line,sizeof(line),"  %8.2f GB/s",r.work.bytes / r.median_ns);
+                std::cerr << line;
+            }
+            if(r.work.items > 0){
+                std::snprintf(line,sizeof(line),"  %10.0f items/s",r.work.items / (r.median_ns * 1e-9));
+                std::cerr << line;
+            }
+            std::cerr << std::endl;
+        }
+
+        BenchOptions options;
+        std::vector<BenchResult> results;
+};
+
+std::mt19937 rng(42);
+
+Matrix random_matrix(size_t width, size_t height, float scale = 1.0f)
+{
+    std::uniform_real_distribution<float> value(-scale,scale);
+    Matrix mat(width,height);
+    for(float& v : mat.get_data()){
+        v = value(rng);
+    }
+    return mat;
+}
+
+// the example topology with small weights, NeuralNet::randomize saturates every neuron
+NeuralNet example_net(ActivationKind hidden = ActivationKind::sigmoid)
+{
+    NeuralNet net;
+    net.add_layer(128*128);
+    net.add_layer(32,hidden);
+    net.add_layer(10);
+    for(size_t n_layer = 1; n_layer < net.get_layer_count(); n_layer++)
+    {
+        size_t inputs = net.get_layer_neurons(n_layer-1).get_height();
+        size_t outputs = net.get_layer_neurons(n_layer).get_height();
+        net.set_layer_weights(n_layer,random_matrix(inputs,outputs,1.0f / std::sqrt((float)inputs)));
+        net.set_layer_bias(n_layer,random_matrix(1,outputs,0.1f));
+    }
+    return net;
+}
+
+std::shared_ptr<Dataset> random_dataset(size_t samples, size_t inputs, size_t outputs)
+{
+    auto dataset = std::make_shared<Dataset>();
+    for(size_t n = 0; n < samples; n++)
+    {
+        Matrix desired(1,outputs);
+        desired.get_data()[n % outputs] = 1.0f;
+        Matrix input = random_matrix(1,inputs,0.5f);
+        for(float& v : input.get_data()){
+            v += 0.5f;
+        }
+        dataset->add_sample(std::move(input),std::move(desired));
+    }
+    return dataset;
+}
+
+// 128x128 images that are black except for random strokes in the middle 72x72 pixels,
+// about 8% of a sample and 30% of a batch of them is non-zero
+std::shared_ptr<Dataset> digit_like_dataset(size_t samples)
+{
+    auto dataset = std::make_shared<Dataset>();
+    std::uniform_real_distribution<float> value(0.0f,1.0f);
+    for(size_t n = 0; n < samples; n++)
+    {
+        Matrix desired(1,10);
+        desired.get_data()[n % 10] = 1.0f;
+        Matrix input(1,128*128);
+        for(size_t y = 28; y < 100; y++){
+            for(size_t x = 28; x < 100; x++){
+                if(value(rng) < 0.25f){
+                    input.get_data()[y * 128 + x] = value(rng);
+                }
+            }
+        }
+        dataset->add_sample(std::move(input),std::move(desired));
+    }
+    return dataset;
+}
+
+size_t file_size(const std::string& path)
+{
+    return std::filesystem::file_size(path);
+}
+
+void bench_matrix(BenchRunner& runner)
+{
+    // (m x k) * (k x n), the first shapes are the ones training on the example runs into
+    struct Shape{ size_t m, k, n; };
+    const Shape shapes[] = {{32,16384,30}, {10,32,30}, {32,16384,1}, {64,64,64}, {256,256,256}, {512,512,512}};
+    for(const Shape& s : shapes)
+    {
+        Matrix a = random_matrix(s.k,s.m);
+        Matrix b = random_matrix(s.n,s.k);
+        Matrix c(s.n,s.m);
+        Work work = {2.0 * s.m * s.n * s.k, 4.0 * (s.m * s.k + s.k * s.n + s.m * s.n), 0};
+        std::string shape = std::to_string(s.m) + "x" + std::to_string(s.k) + "x" + std::to_string(s.n);
+        runner.run("matrix/dot/" + shape,work,[&](){ a.dot(b,c); });
+        if(s.n > 1 && s.n % 16 != 0){
+            // the same product with the batch rows padded to whole cache lines
+            Matrix padded_b(s.n,s.k,RowPadding::cache_line);
+            padded_b.view().assign(b);
+            Matrix padded_c(s.n,s.m,RowPadding::cache_line);
+            runner.run("matrix/dot/" + shape + "/padded",work,[&](){ a.dot(padded_b,padded_c); });
+        }
+    }
+
+    // the backward pass products, delta (32 x 30) against the inputs (16384 x 30) and weights
+    {
+        Matrix delta = random_matrix(30,32);
+        Matrix inputs = random_matrix(30,16384);
+        Matrix weights = random_matrix(16384,32);
+        Matrix weight_gradient(16384,32);
+        Matrix next_delta(30,16384);
+        Work work = {2.0 * 32 * 16384 * 30, 4.0 * (32 * 30 + 16384 * 30 + 32 * 16384), 0};
+        runner.run("matrix/dot_nt/32x30x16384",work,[&](){ delta.dot_nt(inputs,weight_gradient); });
+        runner.run("matrix/dot_tn/16384x32x30",work,[&](){ weights.dot_tn(delta,next_delta); });
+    }
+
+    const size_t sizes[] = {1024, 1 << 20};
+    for(size_t size : sizes)
+    {
+        Matrix a = random_matrix(1,size);
+        Matrix b = random_matrix(1,size);
+        Matrix c(1,size);
+        std::string n = std::to_string(size);
+        runner.run("matrix/add/" + n,{(double)size, 12.0 * size, 0},[&](){ c = a + b; });
+        runner.run("matrix/hadamard/" + n,{(double)size, 12.0 * size, 0},[&](){ c = a * b; });
+        runner.run("matrix/scale/" + n,{(double)size, 8.0 * size, 0},[&](){ c *= 0.999f; });
+        runner.run("matrix/axpy/" + n,{2.0 * size, 12.0 * size, 0},[&](){ c += a * 0.5f; });
+        runner.run("matrix/sum/" + n,{(double)size, 4.0 * size, 0},[&](){ volatile float s = c.sum(); (void)s; });
+    }
+
+    const std::pair<size_t,size_t> transposes[] = {{30,16384}, {512,512}};
+    for(const auto& shape : transposes)
+    {
+        Matrix a = random_matrix(shape.first,shape.second);
+        Matrix t(shape.second,shape.first);
+        std::string name = "matrix/transpose/" + std::to_string(shape.second) + "x" + std::to_string(shape.first);
+        runner.run(name,{0, 8.0 * shape.first * shape.second, 0},[&](){ a.transpose(t); });
+    }
+
+    {
+        NeuralNet net;
+        Matrix a = random_matrix(30,32,4.0f);
+        runner.run("activation/sigmoid/32x30",{0, 8.0 * 32 * 30, 32 * 30},[&](){ net.sigmoid(a); });
+        Matrix b = random_matrix(1,1 << 20,4.0f);
+        runner.run("activation/sigmoid/1048576",{0, 8.0 * (1 << 20), 1 << 20},[&](){ net.sigmoid(b); });
+        float* values = b.get_data().data();
+        for(ActivationKind kind : {ActivationKind::tanh, ActivationKind::relu, ActivationKind::leaky_relu})
+        {
+            std::string name = activation_name(kind);
+            runner.run("activation/" + name + "/1048576",{0, 8.0 * (1 << 20), 1 << 20},[&](){
+                activation_kernel(kind,values,values,1 << 20);
+            });
+            runner.run("activation/" + name + "_derivative/1048576",{0, 8.0 * (1 << 20), 1 << 20},[&](){
+                activation_derivative_kernel(kind,values,values,1 << 20);
+            });
+        }
+    }
+}
+
+void bench_network(BenchRunner& runner)
+{
+    NeuralNet net = example_net();
+    auto dataset = random_dataset(300,128*128,10);
+    const double forward_flops = 2.0 * (16384 * 32 + 32 * 10);
+    const double weight_bytes = 4.0 * (16384 * 32 + 32 * 10);
+
+    {
+        const Matrix& input = (*dataset)[0].first;
+        runner.run("net/feedforward",{forward_flops, weight_bytes, 1},[&](){
+            net.set_input(input);
+            net.feedforward();
+        });
+        const Matrix& desired = (*dataset)[0].second;
+        // forward, backward (delta and weight gradient) and update, about three times the forward work
+        runner.run("net/backpropagate",{3.0 * forward_flops, 3.0 * weight_bytes, 1},[&](){
+            net.backpropagate(input,desired);
+        });
+    }
+
+    TrainingBatch batch(dataset);
+    for(size_t n = 0; n < 30; n++){
+        batch.add_sample(n * 7 % dataset->size());
+    }
+    std::vector<size_t> thread_counts = {1};
+    if(std::thread::hardware_concurrency() > 1){
+        thread_counts.push_back(std::thread::hardware_concurrency());
+    }
+    for(size_t threads : thread_counts)
+    {
+        net.set_thread_count(threads);
+        Work work = {3.0 * forward_flops * batch.size(), 0, (double)batch.size()};
+        runner.run("net/process_batch/30/threads_" + std::to_string(threads),work,[&](){
+            net.process_batch(0.01f,batch);
+        });
+    }
+    net.set_thread_count(1);
+
+    // the same with the per layer counters on, the difference is the instrumentation overhead
+    net.set_profiling(true);
+    runner.run("net/process_batch/30/profiled",{3.0 * forward_flops * batch.size(), 0, (double)batch.size()},[&](){
+        net.process_batch(0.01f,batch);
+    });
+    net.set_profiling(false);
+
+    // a relu hidden layer, no exp in either direction
+    NeuralNet relu_net = example_net(ActivationKind::relu);
+    runner.run("net/process_batch/30/relu",{3.0 * forward_flops * batch.size(), 0, (double)batch.size()},[&](){
+        relu_net.process_batch(0.01f,batch);
+    });
+
+    // mostly black inputs through the dense and the sparse first layer
+    auto digits = digit_like_dataset(300);
+    TrainingBatch digit_batch(digits);
+    for(size_t n = 0; n < 30; n++){
+        digit_batch.add_sample(n * 7 % digits->size());
+    }
+    for(float threshold : {0.0f, 0.5f})
+    {
+        net.set_sparse_input_threshold(threshold);
+        std::string path = threshold > 0 ? "sparse" : "dense";
+        const Matrix& input = (*digits)[0].first;
+        runner.run("net/feedforward/digits_" + path,{forward_flops, weight_bytes, 1},[&](){
+            net.set_input(input);
+            net.feedforward();
+        });
+        runner.run("net/process_batch/30/digits_" + path,{3.0 * forward_flops * digit_batch.size(), 0, (double)digit_batch.size()},[&](){
+            net.process_batch(0.01f,digit_batch);
+        });
+    }
+
+    // shuffled batches stacked on the producer's thread, next() alone is the assembly rate when
+    // nothing else runs, with a training step in between the assembly overlaps the step
+    BatchProducer producer(digits,30);
+    runner.run("data/batch_producer/30/digits",{0, 0, 30.0},[&](){
+        producer.next();
+    });
+    runner.run("net/process_batch/30/digits_sparse_producer",{3.0 * forward_flops * 30, 0, 30.0},[&](){
+        const ProducedBatch& produced = producer.next();
+        net.process_batch(0.01f,produced.inputs,produced.desired);
+    });
+    net.set_sparse_input_threshold(0.0f);
+}
+
+// one in-place update of the example's first layer weights with every rule, and training steps with adam
+void bench_optimizers(BenchRunner& runner)
+{
+    Matrix weights = random_matrix(16384,32,0.01f);
+    Matrix gradient = random_matrix(16384,32,1.0f);
+    const double parameters = 16384.0 * 32;
+    for(OptimizerKind kind : {OptimizerKind::sgd, OptimizerKind::momentum, OptimizerKind::nesterov,
+                              OptimizerKind::rmsprop, OptimizerKind::adam})
+    {
+        OptimizerSettings settings;
+        settings.kind = kind;
+        Optimizer optimizer(settings);
+        Work work = {optimizer.get_flops_per_parameter() * parameters, optimizer.get_bytes_per_parameter() * parameters, parameters};
+        runner.run(std::string("optimizer/") + optimizer_name(kind) + "/524288",work,[&](){
+            optimizer.next_step();
+            optimizer.update(0,1e-6f,30,weights.view(),gradient);
+        });
+    }
+
+    NeuralNet net = example_net(ActivationKind::relu);
+    auto digits = digit_like_dataset(300);
+    TrainingBatch batch(digits);
+    for(size_t n = 0; n < 30; n++){
+        batch.add_sample(n * 7 % digits->size());
+    }
+    const double forward_flops = 2.0 * (16384 * 32 + 32 * 10);
+    OptimizerSettings adam;
+    adam.kind = OptimizerKind::adam;
+    net.set_optimizer(adam);
+    for(float threshold : {0.0f, 0.5f})
+    {
+        // the sparse first layer only updates the weights (and moments) of the active inputs
+        net.set_sparse_input_threshold(threshold);
+        std::string path = threshold > 0 ? "sparse" : "dense";
+        runner.run("net/process_batch/30/adam_digits_" + path,{3.0 * forward_flops * batch.size(), 0, (double)batch.size()},[&](){
+            net.process_batch(0.001f,batch);
+        });
+    }
+}
+
+// asynchronous SGD over the same 30 digit samples as net/process_batch/30/digits_*, one step per sample
+void bench_hogwild(BenchRunner& runner)
+{
+    NeuralNet net = example_net(ActivationKind::relu);
+    auto digits = digit_like_dataset(300);
+    TrainingBatch batch(digits);
+    for(size_t n = 0; n < 30; n++){
+        batch.add_sample(n * 7 % digits->size());
+    }
+    const double forward_flops = 2.0 * (16384 * 32 + 32 * 10);
+    std::vector<size_t> thread_counts = {1};
+    if(std::thread::hardware_concurrency() > 1){
+        thread_counts.push_back(std::thread::hardware_concurrency());
+    }
+    for(float threshold : {0.0f, 0.5f})
+    {
+        net.set_sparse_input_threshold(threshold);
+        std::string path = threshold > 0 ? "sparse" : "dense";
+        for(size_t threads : thread_counts)
+        {
+            net.set_thread_count(threads);
+            Work work = {3.0 * forward_flops * batch.size(), 0, (double)batch.size()};
+            runner.run("net/hogwild/30/digits_" + path + "/threads_" + std::to_string(threads),work,[&](){
+                net.train_hogwild(0.001f,batch);
+            });
+        }
+    }
+}
+
+// dense serving against magnitude pruned CSR models, one sample (latency) and a batch of 64
+void bench_pruned(BenchRunner& runner)
+{
+    NeuralNet net = example_net();
+    const size_t input_size = 128*128;
+    const size_t output_size = 10;
+    std::vector<float> inputs(64 * input_size);
+    std::uniform_real_distribution<float> value(0.0f,1.0f);
+    for(float& v : inputs){
+        v = value(rng);
+    }
+    std::vector<float> outputs(64 * output_size);
+    const double weights = 16384 * 32 + 32 * 10;
+
+    InferencePlan plan(net);
+    for(size_t n : {1, 64})
+    {
+        runner.run("inference/dense/" + std::to_string(n),{2.0 * weights * n, 4.0 * weights, (double)n},[&](){
+            plan.predict_batch(inputs.data(),n,outputs.data());
+        });
+    }
+    for(float density : {0.3f, 0.1f, 0.03f})
+    {
+        NeuralNet pruned = net;
+        pruned.prune_weights(pruned.pruning_threshold(density));
+        SparseNet sparse(pruned,1.0f); // CSR at every density
+        char name[32];
+        std::snprintf(name,sizeof(name),"inference/sparse_%.2f/",density);
+        double non_zero = sparse.get_density() * weights;
+        for(size_t n : {1, 64})
+        {
+            runner.run(name + std::to_string(n),{2.0 * non_zero * n, (double)sparse.get_weight_bytes(), (double)n},[&](){
+                sparse.predict_batch(inputs.data(),n,outputs.data());
+            });
+        }
+    }
+}
+
+void bench_files(BenchRunner& runner)
+{
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+    std::string model_path = (dir / "nn_bench_model.nnm").string();
+    std::string pack_path = (dir / "nn_bench_dataset.pack").string();
+
+    NeuralNet net = example_net();
+    net.save(model_path);
+    double model_bytes = file_size(model_path);
+    runner.run("io/model_save",{0, model_bytes, 0},[&](){ net.save(model_path); });
+    runner.run("io/model_load",{0, model_bytes, 0},[&](){
+        NeuralNet loaded;
+        loaded.load(model_path);
+    });
+    runner.run("io/model_mmap",{0, 0, 0},[&](){ MappedModel model(model_path); });
+
+    const size_t samples = 300;
+    {
+        PackedDatasetWriter writer(pack_path,128*128);
+        Matrix sample = random_matrix(1,128*128);
+        for(size_t n = 0; n < samples; n++){
+            writer.add_sample(sample.get_data().data(),n % 10);
+        }
+    }
+    double pack_bytes = file_size(pack_path);
+    // open with checksum verification and copy every sample into a Dataset, like the example does
+    runner.run("io/dataset_load/300",{0, pack_bytes, (double)samples},[&](){
+        PackedDataset packed(pack_path,true);
+        Dataset dataset;
+        for(size_t n = 0; n < packed.size(); n++)
+        {
+            const float* values = packed.get_sample(n);
+            Matrix desired(1,10);
+            desired.get_data()[packed.get_label(n)] = 1.0f;
+            dataset.add_sample(Matrix(std::vector<float>(values,values + packed.get_sample_size()),1,packed.get_sample_size()),
+                               std::move(desired));
+        }
+    });
+
+    std::remove(model_path.c_str());
+    std::remove(pack_path.c_str());
+}
+
+BenchOptions parse_options(int argc, char** argv)
+{
+    BenchOptions options;
+    for(int n = 1; n < argc; n++)
+    {
+        std::string arg = argv[n];
+        if(arg == "--filter" && n + 1 < argc){
+            options.filter = argv[++n];
+        }else if(arg == "--min-time" && n + 1 < argc){
+            options.min_time = std::stod(argv[++n]);
+        }else if(arg == "--out" && n + 1 < argc){
+            options.out_path = argv[++n];
+        }else{
+            throw std::invalid_argument("usage: bench [--filter text] [--min-time seconds] [--out path]");
+        }
+    }
+    return options;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    try{
+        options = parse_options(argc,argv);
+    }catch(const std::exception& e){
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    BenchRunner runner(options);
+    bench_matrix(runner);
+    bench_network(runner);
+    bench_optimizers(runner);
+    bench_hogwild(runner);
+    bench_pruned(runner);
+    bench_files(runner);
+
+    if(options.out_path.empty()){
+        std::cout << runner.json();
+    }else{
+        std::ofstream out(options.out_path);
+        out << runner.json();
+        std::cerr << "results written to " << options.out_path << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include "NeuralNet.hpp"
+#include "InferencePlan.hpp"
+#include "StaticNeuralNet.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+
+// Single sample inference on the example topology: NeuralNet, a batch 1 InferencePlan and
+// StaticNeuralNet loaded from the same model file. Prints the median time per sample.
+
+typedef StaticNeuralNet<128*128, 32, 10> ExampleNet;
+
+const size_t REPEATS = 2000;
+const char* MODEL_PATH = "bench_static.nnm";
+
+template<typename Run>
+double median_us(Run run)
+{
+    typedef std::chrono::steady_clock clock;
+    std::vector<double> times;
+    for(size_t n = 0; n < REPEATS; n++)
+    {
+        auto start = clock::now();
+        run();
+        times.push_back(std::chrono::duration<double,std::micro>(clock::now() - start).count());
+    }
+    std::nth_element(times.begin(),times.begin() + times.size() / 2,times.end());
+    return times[times.size() / 2];
+}
+
+int main()
+{
+    NeuralNet net;
+    net.add_layer(ExampleNet::topology[0]);
+    net.add_layer(ExampleNet::topology[1]);
+    net.add_layer(ExampleNet::topology[2]);
+    net.randomize();
+    net.save(MODEL_PATH);
+
+    std::unique_ptr<ExampleNet> static_net(new ExampleNet); // 2MB of weights, keep it off the stack
+    static_net->load(MODEL_PATH);
+    InferencePlan plan(net,1);
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> pixel(0.0f,1.0f);
+    ExampleNet::Input input;
+    std::generate(input.begin(),input.end(),[&](){ return pixel(rng) * 0.01f; });
+    Matrix input_matrix(std::vector<float>(input.begin(),input.end()),1,input.size());
+    ExampleNet::Output output;
+    std::vector<float> plan_output(plan.get_output_size());
+
+    // all three compute the same network
+    net.set_input(input_matrix);
+    net.feedforward();
+    static_net->feedforward(input,output);
+    float max_error = 0.0f;
+    for(size_t i = 0; i < output.size(); i++)
+    {
+        max_error = std::max(max_error,std::fabs(output[i] - net.get_output().get_data()[i]));
+    }
+    std::cout << "max difference to NeuralNet: " << max_error << std::endl;
+
+    for(GemmIsa isa : {GemmIsa::scalar, GemmIsa::avx2, GemmIsa::avx512})
+    {
+        gemm_set_isa(isa);
+        if(gemm_get_isa() != isa){
+            continue; // not supported by this cpu
+        }
+        double dynamic_us = median_us([&](){ net.set_input(input_matrix); net.feedforward(); });
+        double plan_us = median_us([&](){ plan.predict_batch(input.data(),1,plan_output.data()); });
+        double static_us = median_us([&](){ static_net->feedforward(input,output); });
+        std::cout << gemm_isa_name(isa) << ": NeuralNet " << dynamic_us << " us, InferencePlan " << plan_us
+                  << " us, StaticNeuralNet " << static_us << " us" << std::endl;
+    }
+    std::remove(MODEL_PATH);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef ACTIVATION_HPP
+#define ACTIVATION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Vectorized activation kernels.
+//
+// sigmoid here is the network's convention, 1 / (1 + exp(x)).
+// tanh, relu (max(x, 0)), leaky_relu (max(x, LEAKY_RELU_SLOPE * x)) and identity are the usual ones.
+// ReLU and leaky ReLU are a max per element, no exp and no branches.
+// The avx2/avx512 kernels (see gemm_isa_select) compute exp with a degree 6 polynomial after
+// range reduction to [-ln2/2, ln2/2]:
+// relative error of exp below 1.5e-7 for x in [-87, 88], absolute error of sigmoid below 1e-7.
+// Above that range exp returns inf and below it 0, so sigmoid saturates to exactly 0 or 1.
+// tanh uses the same exp as 1 - 2 / (1 + exp(2x)), absolute error below 2.5e-7.
+// The scalar kernels use std::exp and std::tanh.
+// In all functions in and out may be the same buffer.
+
+// stored in model files, keep the values
+enum class ActivationKind : uint32_t { sigmoid = 0, tanh = 1, relu = 2, leaky_relu = 3, identity = 4 };
+
+const float LEAKY_RELU_SLOPE = 0.01f;
+
+const char* activation_name(ActivationKind kind);
+ActivationKind activation_from_name(const std::string& name); // throws for unknown names
+bool is_known_activation(uint32_t kind);
+
+void exp_kernel(const float* in, float* out, size_t count);
+void sigmoid_kernel(const float* in, float* out, size_t count);
+// activation_derivative_kernel for sigmoid
+void sigmoid_derivative_kernel(const float* activation, float* out, size_t count);
+void activation_kernel(ActivationKind kind, const float* in, float* out, size_t count);
+// derivative f'(x) from the output a = f(x), for every kind a function of a alone:
+// sigmoid -a * (1 - a) (1 / (1 + exp(x)) falls), tanh 1 - a^2, relu 1 or 0, leaky_relu 1 or the slope,
+// identity 1
+void activation_derivative_kernel(ActivationKind kind, const float* activation, float* out, size_t count);
+
+// Epilogues run on the output of a gemm: add a bias and apply the activation in a single pass.
+// data is rows x cols row-major.
+// bias[row] is added to every element of a row (neurons x samples, the NeuralNet layout)
+void bias_activation_by_row(ActivationKind kind, float* data, size_t rows, size_t cols, const float* bias);
+// bias[col] is added to every element of a column (samples x neurons, the InferencePlan layout)
+void bias_activation_by_column(ActivationKind kind, float* data, size_t rows, size_t cols, const float* bias);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef ALIGNED_ALLOCATOR_HPP
+#define ALIGNED_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <new>
+
+// std::allocator replacement that puts every allocation on an Alignment byte boundary
+// (a cache line by default), for containers that SIMD kernels read with aligned loads.
+
+template<typename T, size_t Alignment = 64>
+class AlignedAllocator{
+    static_assert(Alignment >= alignof(T) && (Alignment & (Alignment - 1)) == 0,
+                  "alignment must be a power of two and at least the alignment of the type");
+
+    public:
+        typedef T value_type;
+
+        template<typename U>
+        struct rebind{
+            typedef AlignedAllocator<U, Alignment> other;
+        };
+
+        AlignedAllocator() noexcept {}
+        template<typename U>
+        AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+        T* allocate(size_t n)
+        {
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+        }
+
+        void deallocate(T* p, size_t)
+        {
+            ::operator delete(p, std::align_val_t(Alignment));
+        }
+};
+
+template<typename T, typename U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&)
+{
+    return true;
+}
+
+template<typename T, typename U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&)
+{
+    return false;
+}
+
+#endif
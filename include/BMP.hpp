@@ -51,67 +51,82 @@ struct BMP {
         read(fname);
     }
 
+    // Decode an image file that is already in memory
+    BMP(const uint8_t *bytes, size_t size) {
+        read(bytes, size);
+    }
+
     void read(const char *fname) {
         std::ifstream inp{ fname, std::ios_base::binary };
         if (inp) {
-            inp.read((char*)&file_header, sizeof(file_header));
-            if(file_header.file_type != 0x4D42) {
-                throw std::runtime_error("Error! Unrecognized file format.");
-            }
-            inp.read((char*)&bmp_info_header, sizeof(bmp_info_header));
-
-            // The BMPColorHeader is used only for transparent images
-            if(bmp_info_header.bit_count == 32) {
-                // Check if the file has bit mask color information
-                if(bmp_info_header.size >= (sizeof(BMPInfoHeader) + sizeof(BMPColorHeader))) {
-                    inp.read((char*)&bmp_color_header, sizeof(bmp_color_header));
-                    // Check if the pixel data is stored as BGRA and if the color space type is sRGB
-                    check_color_header(bmp_color_header);
-                } else {
-                    std::cerr << "Error! The file \"" << fname << "\" does not seem to contain bit mask information\n";
-                    throw std::runtime_error("Error! Unrecognized file format.");
-                }
-            }
+            read(inp, fname);
+        }
+        else {
+            throw std::runtime_error("Unable to open the input image file.");
+        }
+    }
 
-            // Jump to the pixel data location
-            inp.seekg(file_header.offset_data, inp.beg);
+    void read(const uint8_t *bytes, size_t size) {
+        MemoryBuffer buffer(bytes, size);
+        std::istream inp(&buffer);
+        read(inp, "<memory>");
+    }
+
+    void read(std::istream &inp, const char *fname) {
+        inp.read((char*)&file_header, sizeof(file_header));
+        if(file_header.file_type != 0x4D42) {
+            throw std::runtime_error("Error! Unrecognized file format.");
+        }
+        inp.read((char*)&bmp_info_header, sizeof(bmp_info_header));
 
-            // Adjust the header fields for output.
-            // Some editors will put extra info in the image file, we only save the headers and the data.
-            if(bmp_info_header.bit_count == 32) {
-                bmp_info_header.size = sizeof(BMPInfoHeader) + sizeof(BMPColorHeader);
-                file_header.offset_data = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader) + sizeof(BMPColorHeader);
+        // The BMPColorHeader is used only for transparent images
+        if(bmp_info_header.bit_count == 32) {
+            // Check if the file has bit mask color information
+            if(bmp_info_header.size >= (sizeof(BMPInfoHeader) + sizeof(BMPColorHeader))) {
+                inp.read((char*)&bmp_color_header, sizeof(bmp_color_header));
+                // Check if the pixel data is stored as BGRA and if the color space type is sRGB
+                check_color_header(bmp_color_header);
             } else {
-                bmp_info_header.size = sizeof(BMPInfoHeader);
-                file_header.offset_data = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader);
+                std::cerr << "Error! The file \"" << fname << "\" does not seem to contain bit mask information\n";
+                throw std::runtime_error("Error! Unrecognized file format.");
             }
-            file_header.file_size = file_header.offset_data;
+        }
 
-            if (bmp_info_header.height < 0) {
-                throw std::runtime_error("The program can treat only BMP images with the origin in the bottom left corner!");
-            }
+        // Jump to the pixel data location
+        inp.seekg(file_header.offset_data, inp.beg);
 
-            data.resize(bmp_info_header.width * bmp_info_header.height * bmp_info_header.bit_count / 8);
+        // Adjust the header fields for output.
+        // Some editors will put extra info in the image file, we only save the headers and the data.
+        if(bmp_info_header.bit_count == 32) {
+            bmp_info_header.size = sizeof(BMPInfoHeader) + sizeof(BMPColorHeader);
+            file_header.offset_data = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader) + sizeof(BMPColorHeader);
+        } else {
+            bmp_info_header.size = sizeof(BMPInfoHeader);
+            file_header.offset_data = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader);
+        }
+        file_header.file_size = file_header.offset_data;
 
-            // Here we check if we need to take into account row padding
-            if (bmp_info_header.width % 4 == 0) {
-                inp.read((char*)data.data(), data.size());
-                file_header.file_size += static_cast<uint32_t>(data.size());
-            }
-            else {
-                row_stride = bmp_info_header.width * bmp_info_header.bit_count / 8;
-                uint32_t new_stride = make_stride_aligned(4);
-                std::vector<uint8_t> padding_row(new_stride - row_stride);
+        if (bmp_info_header.height < 0) {
+            throw std::runtime_error("The program can treat only BMP images with the origin in the bottom left corner!");
+        }
 
-                for (int y = 0; y < bmp_info_header.height; ++y) {
-                    inp.read((char*)(data.data() + row_stride * y), row_stride);
-                    inp.read((char*)padding_row.data(), padding_row.size());
-                }
-                file_header.file_size += static_cast<uint32_t>(data.size()) + bmp_info_header.height * static_cast<uint32_t>(padding_row.size());
-            }
+        data.resize(bmp_info_header.width * bmp_info_header.height * bmp_info_header.bit_count / 8);
+
+        // Here we check if we need to take into account row padding
+        if (bmp_info_header.width % 4 == 0) {
+            inp.read((char*)data.data(), data.size());
+            file_header.file_size += static_cast<uint32_t>(data.size());
         }
         else {
-            throw std::runtime_error("Unable to open the input image file.");
+            row_stride = bmp_info_header.width * bmp_info_header.bit_count / 8;
+            uint32_t new_stride = make_stride_aligned(4);
+            std::vector<uint8_t> padding_row(new_stride - row_stride);
+
+            for (int y = 0; y < bmp_info_header.height; ++y) {
+                inp.read((char*)(data.data() + row_stride * y), row_stride);
+                inp.read((char*)padding_row.data(), padding_row.size());
+            }
+            file_header.file_size += static_cast<uint32_t>(data.size()) + bmp_info_header.height * static_cast<uint32_t>(padding_row.size());
         }
     }
 
@@ -242,6 +257,27 @@ struct BMP {
 private:
     uint32_t row_stride{ 0 };
 
+    // Read-only std::streambuf over a block of memory (supports the seek done by read)
+    struct MemoryBuffer : std::streambuf {
+        MemoryBuffer(const uint8_t *bytes, size_t size) {
+            char *begin = (char*)bytes;
+            setg(begin, begin, begin + size);
+        }
+
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override {
+            char *target = (dir == std::ios_base::beg) ? eback() + off : (dir == std::ios_base::cur) ? gptr() + off : egptr() + off;
+            if (target < eback() || target > egptr()) {
+                return pos_type(off_type(-1));
+            }
+            setg(eback(), target, egptr());
+            return pos_type(target - eback());
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode mode) override {
+            return seekoff(off_type(pos), std::ios_base::beg, mode);
+        }
+    };
+
     void write_headers(std::ofstream &of) {
         of.write((const char*)&file_header, sizeof(file_header));
         of.write((const char*)&bmp_info_header, sizeof(bmp_info_header));
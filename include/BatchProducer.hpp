@@ -0,0 +1,87 @@
+#ifndef BATCH_PRODUCER_HPP
+#define BATCH_PRODUCER_HPP
+
+#include "Dataset.hpp"
+#include "TrainingBatch.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Assembles training batches on a background thread while the caller trains on the previous one.
+//
+// Every epoch the samples are shuffled and cut into batches of batch_size, the last batch of an
+// epoch takes the remainder. A batch is stacked into its slot, one column per sample, ready for
+// NeuralNet::process_batch(learning_rate,inputs,desired). The slots form a single producer single
+// consumer ring that hands batches over through two atomic counters, without a lock: with the
+// default two slots the producer fills one while the caller trains on the other. All slots are
+// allocated up front, producing a batch allocates nothing. A side only sleeps (on a condition
+// variable) when it has to wait for the other, i.e. the ring is full or empty.
+
+struct ProducedBatch{
+    size_t epoch;
+    TrainingBatch batch; // the samples, in column order
+    Matrix inputs;       // (input size x samples)
+    Matrix desired;      // (output size x samples)
+};
+
+struct BatchProducerStats{
+    size_t batches;        // handed out by next()
+    size_t consumer_waits; // next() calls that found no batch ready
+    size_t producer_waits; // batches that were done before their slot was free
+    double wait_seconds;   // time next() spent waiting for the producer
+    double produce_seconds; // time the producer spent assembling batches
+};
+
+class BatchProducer{
+    public:
+        // samples are the dataset indices to draw from (empty: all of them), slots is at least 2
+        BatchProducer(std::shared_ptr<const Dataset> dataset, size_t batch_size, uint32_t seed = 1,
+                      const std::vector<size_t>& samples = {}, size_t slots = 2);
+        ~BatchProducer();
+        BatchProducer(const BatchProducer&) = delete;
+        BatchProducer& operator=(const BatchProducer&) = delete;
+        // the next batch, valid until the following call, an error of the producer is rethrown here
+        const ProducedBatch& next();
+        size_t get_batch_size() const;
+        size_t get_batches_per_epoch() const;
+        BatchProducerStats get_stats() const; // from the consumer thread
+    private:
+        void producer_loop();
+        void fill(ProducedBatch& slot);
+        void wake(std::atomic<bool>& waiting, std::condition_variable& condition);
+
+        std::shared_ptr<const Dataset> dataset;
+        size_t batch_size;
+        std::vector<size_t> order; // samples of the current epoch, shuffled
+        size_t position;           // next sample of order
+        size_t epoch;
+        std::mt19937 rng;
+        std::vector<ProducedBatch> slots;
+
+        // slot n % slots.size() holds batch n, the producer only writes produced, the consumer only released
+        std::atomic<size_t> produced;
+        std::atomic<size_t> released;
+        bool holding;                 // the consumer has a batch it hasn't released yet
+        std::atomic<bool> stopping;
+        std::atomic<bool> failed;
+        std::exception_ptr error;     // set before failed
+        std::atomic<bool> producer_waiting;
+        std::atomic<bool> consumer_waiting;
+        std::mutex wait_mutex;
+        std::condition_variable producer_wake;
+        std::condition_variable consumer_wake;
+
+        size_t consumer_waits;
+        double wait_seconds;
+        std::atomic<size_t> producer_waits;
+        std::atomic<uint64_t> produce_nanoseconds;
+        std::thread producer;
+};
+
+#endif
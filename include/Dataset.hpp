@@ -0,0 +1,23 @@
+#ifndef DATASET_HPP
+#define DATASET_HPP
+
+#include "Matrix.hpp"
+#include <deque>
+#include <utility>
+
+// Shared store of training samples (input and desired output column vectors).
+// TrainingBatches reference samples in a Dataset by index instead of copying them.
+// Samples are never moved once added, references handed out stay valid while the dataset lives.
+class Dataset{
+    public:
+        Dataset();
+        size_t add_sample(const Matrix& input, const Matrix& desired_output); // returns the index of the sample
+        size_t add_sample(Matrix&& input, Matrix&& desired_output);
+        std::pair<const Matrix&,const Matrix&> operator[](size_t index) const;
+        size_t size() const;
+    private:
+        std::deque<Matrix> inputs;
+        std::deque<Matrix> desired_outputs;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef GEMM_HPP
+#define GEMM_HPP
+
+#include <cstddef>
+
+// Single precision matrix multiplication engine used by Matrix::dot.
+// All matrices are stored row-major (element (row,col) at row * ld + col),
+// which is the same layout Matrix uses (index = y * width + x).
+
+enum class Transpose { no, yes };
+
+enum class GemmIsa { scalar, avx2, avx512 };
+
+// C = alpha * op(A) * op(B) + beta * C
+// op(A) is m x k, op(B) is k x n and C is m x n.
+// When trans_a is Transpose::yes, A is stored as a k x m matrix (same for B).
+// When beta is 0, C is not read so it may contain garbage.
+void gemm(Transpose trans_a, Transpose trans_b,
+          size_t m, size_t n, size_t k,
+          float alpha, const float* a, size_t lda,
+          const float* b, size_t ldb,
+          float beta, float* c, size_t ldc);
+
+// Same as above, but all scratch memory is taken from workspace instead of the
+// per thread buffers, so the call never allocates. workspace must be 64 byte aligned
+// and hold at least gemm_workspace_size(m, n, k) floats.
+void gemm(Transpose trans_a, Transpose trans_b,
+          size_t m, size_t n, size_t k,
+          float alpha, const float* a, size_t lda,
+          const float* b, size_t ldb,
+          float beta, float* c, size_t ldc, float* workspace);
+
+// floats of workspace needed by any gemm call with dimensions up to m x n x k
+size_t gemm_workspace_size(size_t m, size_t n, size_t k);
+
+// instruction set used by the kernels, detected at startup
+GemmIsa gemm_get_isa();
+// force a specific instruction set (e.g. for benchmarking), isa's not supported
+// by the cpu are clamped to the best supported one
+void gemm_set_isa(GemmIsa isa);
+const char* gemm_isa_name(GemmIsa isa);
+
+// Picks the variant for the instruction set gemm currently uses. Every vectorized module
+// dispatches through this, so gemm_set_isa caps all of them at once. A variant a cpu feature
+// rules out is passed as the next narrower one.
+template<typename T>
+T gemm_isa_select(T scalar, T avx2, T avx512)
+{
+    switch(gemm_get_isa()){
+        case GemmIsa::avx512: return avx512;
+        case GemmIsa::avx2: return avx2;
+        default: return scalar;
+    }
+}
+
+#endif
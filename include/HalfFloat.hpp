@@ -0,0 +1,25 @@
+#ifndef HALF_FLOAT_HPP
+#define HALF_FLOAT_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// 16 bit floating point storage for weights. Values are only stored as halves,
+// the kernels convert them to float32 as they are loaded and accumulate in float32.
+//  - float16 is IEEE binary16: 10 bit mantissa, range +-65504
+//  - bfloat16 is the top half of a float32: 7 bit mantissa, same range as float
+
+enum class HalfFormat { float16, bfloat16 };
+
+// round to nearest even, float16 overflows to inf
+void float_to_half(const float* in, uint16_t* out, size_t count, HalfFormat format);
+void half_to_float(const uint16_t* in, float* out, size_t count, HalfFormat format);
+
+// C = A * B^T with B stored as halves, A is m x k, B is n x k and C is m x n, all row-major.
+// C is overwritten. This is the layer product of samples (rows of A) with a weight matrix.
+void gemm_half_nt(size_t m, size_t n, size_t k,
+                  const float* a, size_t lda,
+                  const uint16_t* b, size_t ldb, HalfFormat format,
+                  float* c, size_t ldc);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef HOGWILD_HPP
+#define HOGWILD_HPP
+
+#include "NeuralNet.hpp"
+#include "TrainingBatch.hpp"
+#include <string>
+#include <vector>
+
+// Throughput and convergence of NeuralNet::train_hogwild against the synchronous process_batch.
+// Every run starts from a copy of the same network and trains the same epochs over the same batches
+// with plain SGD at the same learning rate: process_batch takes one step per batch (threads split the
+// batch), train_hogwild one step per samples_per_update samples (threads take steps concurrently).
+// Thread counts above the number of cores only add contention, they show the cost of oversubscription.
+
+struct HogwildRun{
+    size_t threads;
+    double sync_samples_per_second;
+    double hogwild_samples_per_second;
+    float sync_cost; // mean squared output error on the test samples after training
+    float hogwild_cost;
+    float sync_accuracy; // fraction of test samples where the largest output matches the desired one
+    float hogwild_accuracy;
+};
+
+struct HogwildReport{
+    size_t samples; // trained per run, all epochs together
+    size_t samples_per_update;
+    float initial_cost;
+    float initial_accuracy;
+    std::vector<HogwildRun> runs;
+    std::string str() const;
+};
+
+HogwildReport compare_hogwild(const NeuralNet& net, float learning_rate, const std::vector<TrainingBatch>& batches,
+                              const TrainingBatch& test, size_t epochs = 1,
+                              const std::vector<size_t>& thread_counts = {1,2,4,8,16,32,64},
+                              size_t samples_per_update = 1);
+
+#endif
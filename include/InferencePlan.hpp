@@ -0,0 +1,50 @@
+#ifndef INFERENCE_PLAN_HPP
+#define INFERENCE_PLAN_HPP
+
+#include "NeuralNet.hpp"
+#include "ModelFile.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Precompiled forward pass for serving.
+//
+// All activation and gemm scratch buffers are allocated once, for max_batch samples,
+// when the plan is built. predict_batch() then runs without any heap allocation.
+// A plan only references the weights of the network or model it was built from:
+// the source must outlive the plan and keep its topology (weight updates in place are fine).
+// predict_batch() writes to the plan's buffers, so every thread needs its own plan;
+// copying a plan is the cheap way to get one, the weights stay shared.
+// With a float16/bfloat16 weight type the plan keeps its own rounded copy of the network's
+// weights (taken when the plan is built), which halves the memory streamed per batch.
+// A plan built from a model file uses the file's weight type in place.
+
+class InferencePlan{
+    public:
+        InferencePlan(const NeuralNet& net, size_t max_batch = 64, ModelDataType weight_type = ModelDataType::float32);
+        InferencePlan(const MappedModel& model, size_t max_batch = 64);
+        // inputs holds n samples of get_input_size() floats back to back, outputs receives
+        // n results of get_output_size() floats. Batches above max_batch are run in chunks.
+        void predict_batch(const float* inputs, size_t n, float* outputs);
+        size_t get_input_size() const;
+        size_t get_output_size() const;
+        size_t get_max_batch() const;
+        ModelDataType get_weight_type() const;
+        size_t get_weight_bytes() const;
+    private:
+        void build(size_t max_batch);
+        void run_chunk(const float* inputs, size_t n, float* outputs);
+        float* get_workspace();
+
+        std::vector<size_t> topology;
+        ModelDataType weight_type;
+        std::vector<const void*> weights; // (size x previous size) row-major, in weight_type
+        std::vector<const float*> biases;
+        std::vector<ActivationKind> activations;
+        std::shared_ptr<const std::vector<std::vector<uint16_t>>> half_weights; // owned rounded copies
+        size_t max_batch;
+        std::vector<float> buffers[2]; // hidden layers alternate between these
+        std::vector<float> workspace_storage; // gemm scratch, aligned on use
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef INGEST_PIPELINE_HPP
+#define INGEST_PIPELINE_HPP
+
+#include "Matrix.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct IngestStats{
+    size_t files;
+    size_t bytes;
+    double seconds;
+    double files_per_second() const { return seconds > 0 ? files / seconds : 0; }
+    double bytes_per_second() const { return seconds > 0 ? bytes / seconds : 0; }
+};
+
+// Loads a list of files on a pool of worker threads. Every worker reads a whole file with a
+// single read and decodes it, the results are handed out by next() in list order. At most
+// queue_capacity files are read ahead of the consumer, so memory use stays bounded.
+class IngestPipeline{
+    public:
+        typedef std::function<Matrix(const std::vector<uint8_t>& bytes)> Decoder;
+
+        IngestPipeline(const std::vector<std::string>& paths, Decoder decoder, size_t n_threads, size_t queue_capacity = 64);
+        ~IngestPipeline();
+        IngestPipeline(const IngestPipeline&) = delete;
+        IngestPipeline& operator=(const IngestPipeline&) = delete;
+        // moves the next sample into sample, returns false once every file was delivered.
+        // If reading or decoding a file failed its exception is rethrown here, the
+        // failed file is skipped so next() can be called again afterwards.
+        bool next(Matrix& sample);
+        IngestStats get_stats() const;
+    private:
+        struct Slot{
+            bool ready = false;
+            Matrix sample;
+            std::exception_ptr error;
+        };
+
+        void worker_loop();
+
+        std::vector<std::string> paths;
+        Decoder decoder;
+        std::vector<Slot> slots;
+        std::vector<std::thread> workers;
+        mutable std::mutex mutex;
+        std::condition_variable slot_ready;
+        std::condition_variable slot_free;
+        size_t next_index;   // next file a worker picks up
+        size_t delivered;    // files handed out by next()
+        size_t bytes_read;
+        bool stopping;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point finish;
+};
+
+#endif
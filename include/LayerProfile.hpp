@@ -0,0 +1,86 @@
+#ifndef LAYER_PROFILE_HPP
+#define LAYER_PROFILE_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Per layer, per phase time and work counters of a NeuralNet (see NeuralNet::set_profiling).
+//
+// Layer n is the weight layer between neuron layers n-1 and n, layer 0 has no counters.
+// Times are summed over all threads, so with several training threads they are thread time.
+// FLOP counts are for the operations as written: a multiply-add is 2, exp counts as 1 so
+// sigmoid and tanh are 4 per element, the others 1. Bytes are the minimal traffic (every operand
+// read or written once).
+
+enum class ProfilePhase{
+    forward_gemm,     // weights * previous activations
+    bias_activation,  // bias add and activation, fused into one pass
+    backward_delta,   // error of the layer's neurons, weights^T * delta of the next layer times f'
+    weight_gradient,  // delta * previous activations^T and the bias sums
+    gradient_reduce,  // summing the gradients of the process_batch workers
+    update,           // applying the summed gradients to the weights and biases
+    count
+};
+
+const char* profile_phase_name(ProfilePhase phase);
+
+struct PhaseCounters{
+    uint64_t calls;
+    uint64_t nanoseconds;
+    double flops;
+    double bytes;
+};
+
+class LayerProfile{
+    public:
+        static const size_t PHASE_COUNT = static_cast<size_t>(ProfilePhase::count);
+
+        void add(size_t n_layer, ProfilePhase phase, uint64_t nanoseconds, double flops, double bytes);
+        void merge(const LayerProfile& other);
+        void clear();
+        size_t get_layer_count() const;
+        PhaseCounters get(size_t n_layer, ProfilePhase phase) const; // zeros for layers without counters
+        PhaseCounters total(ProfilePhase phase) const; // over all layers
+        // one entry per layer and phase with calls, seconds, flops, bytes, GFLOP/s and bytes/s
+        std::string to_json() const;
+        std::string to_csv() const;
+    private:
+        PhaseCounters& counters_of(size_t n_layer, ProfilePhase phase); // grows the layers as needed
+
+        std::vector<std::array<PhaseCounters, PHASE_COUNT>> layers;
+};
+
+// Measures consecutive phases: every lap() records the time since the previous lap (or since
+// construction). With a null profile nothing is read or recorded, so an instrumented loop
+// costs a predictable branch per phase when profiling is off.
+class PhaseTimer{
+    public:
+        explicit PhaseTimer(LayerProfile* profile)
+        :profile(profile)
+        {
+            if(profile){
+                last = std::chrono::steady_clock::now();
+            }
+        }
+
+        void lap(size_t n_layer, ProfilePhase phase, double flops, double bytes)
+        {
+            if(!profile){
+                return;
+            }
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+            profile->add(n_layer,phase,elapsed,flops,bytes);
+            last = now;
+        }
+
+    private:
+        LayerProfile* profile;
+        std::chrono::steady_clock::time_point last;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file, unmapped when the object is destroyed.
+class MappedFile{
+    public:
+        MappedFile(const std::string& path);
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile();
+        const uint8_t* data() const;
+        size_t size() const;
+        const std::string& get_path() const;
+    private:
+        void unmap();
+
+        std::string path;
+        const uint8_t* mapping;
+        size_t length;
+};
+
+// CRC-32 (IEEE 802.3 polynomial) as used by the binary file formats,
+// pass the crc of the previous chunk to checksum data piece by piece
+uint32_t crc32(const void* data, size_t size, uint32_t previous = 0);
+
+// bounds checks for offsets and sizes read from a file, none of them can overflow:
+// true when the block of bytes at offset lies within size
+bool block_in_range(uint64_t offset, uint64_t bytes, uint64_t size);
+// result = a * b, false when the product doesn't fit in 64 bits
+bool checked_multiply(uint64_t a, uint64_t b, uint64_t& result);
+
+#endif
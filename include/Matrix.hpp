@@ -4,46 +4,166 @@
 #include <vector>
 #include <iostream>
 #include <cmath>
+#include "AlignedAllocator.hpp"
+#include "MatrixExpression.hpp"
+#include "MatrixView.hpp"
 
+// storage of a matrix, starts on a 64 byte (cache line) boundary
+typedef std::vector<float, AlignedAllocator<float>> MatrixStorage;
 
-class Matrix{
+// row layout of a matrix: rows back to back, or every row padded to a multiple of
+// 16 floats so each row starts on a cache line and SIMD kernels have no tail loop
+enum class RowPadding{
+    none,
+    cache_line
+};
+
+class Matrix : public MatrixExpression<Matrix>{
     public:
         Matrix();
         Matrix(const std::vector<float>& data);
         Matrix(const std::vector<float>& data, size_t width, size_t height);
         Matrix(size_t width, size_t height);
+        Matrix(size_t width, size_t height, RowPadding padding); // zero initialized, padding included
         Matrix(const Matrix& mat);
+        Matrix(Matrix&& mat) noexcept;
+        Matrix(ConstMatrixView view); // copies the viewed elements
+        template<typename E>
+        Matrix(const MatrixExpression<E>& expr); // evaluates an element-wise expression (see MatrixExpression.hpp)
         ~Matrix();
-        Matrix operator+(const Matrix& mat) const;
-        Matrix operator-(const Matrix& mat) const;
-        Matrix operator-(float value) const;
-        Matrix operator*(const Matrix& mat) const;
-        Matrix operator*(float factor) const;
-        Matrix operator/(float factor) const;
-        void operator+=(const Matrix& mat);
-        void operator-=(const Matrix& mat);
-        void operator*=(const Matrix& mat);
+        // +, -, * (element-wise) and the scalar operators are expression templates, see MatrixExpression.hpp
+        template<typename E>
+        void operator+=(const MatrixExpression<E>& expr);
+        template<typename E>
+        void operator-=(const MatrixExpression<E>& expr);
+        template<typename E>
+        void operator*=(const MatrixExpression<E>& expr);
         void operator*=(float factor);
         Matrix& operator=(const Matrix& mat);
-        Matrix dot(const Matrix& mat) const;
+        Matrix& operator=(Matrix&& mat) noexcept;
+        Matrix& operator=(ConstMatrixView view); // reuses the memory when the size fits
+        template<typename E>
+        Matrix& operator=(const MatrixExpression<E>& expr);
+        float element(size_t x, size_t y) const { return data[y * stride + x]; } // unchecked, used by expressions
+        // operands are views, so a Matrix or any slice of one can be passed without copying
+        Matrix dot(ConstMatrixView mat) const;
+        void dot(ConstMatrixView mat, Matrix& result) const; // result = this * mat, reuses the memory of result
+        // products with a transposed operand, the operand is read in place instead of being transposed first
+        Matrix dot_tn(ConstMatrixView mat) const; // this^T * mat
+        void dot_tn(ConstMatrixView mat, Matrix& result) const;
+        Matrix dot_nt(ConstMatrixView mat) const; // this * mat^T
+        void dot_nt(ConstMatrixView mat, Matrix& result) const;
+        void add_outer_product(ConstMatrixView a, ConstMatrixView b, float factor = 1.0f); // this += factor * a * b^T, a and b column vectors
         float sum(); // returns sum of all elements of matrix
+        Matrix row_sums() const; // returns column vector with the sum of every row
+        void row_sums(Matrix& result) const;
+        void add_column_vector(ConstMatrixView vec); // adds column vector vec to every column
         Matrix transpose();
+        void transpose(Matrix& result) const;
+        // changes the shape, only allocates when the new size exceeds the capacity,
+        // the element values afterwards are unspecified, the row padding is kept
+        void resize(size_t new_width, size_t new_height);
         float get_value(size_t x, size_t y) const;
         void set_value(size_t x, size_t y, float value);
         size_t get_width() const;
         size_t get_height() const;
-        std::vector<float>& get_data();
-        void set_data(const std::vector<float>& new_data);
-        // Matrix get_column(size_t x) const;
-        // Matrix get_row(size_t y) const;
-        void reshape(size_t new_width, size_t new_height);
+        // distance in floats between the starts of two rows, equals the width unless rows are padded
+        size_t get_stride() const { return stride; }
+        RowPadding get_padding() const { return padding; }
+        bool is_contiguous() const { return stride == width || height <= 1; }
+        // the raw storage: height rows of get_stride() floats, of which the first width are elements
+        MatrixStorage& get_data();
+        const MatrixStorage& get_data() const;
+        void set_data(const std::vector<float>& new_data); // width * height elements in row-major order
+        // views of the whole matrix or a part of it, valid until the matrix reallocates
+        operator ConstMatrixView() const { return view(); }
+        ConstMatrixView view() const { return ConstMatrixView(data.data(),width,height,stride); }
+        MatrixView view() { return MatrixView(data.data(),width,height,stride); }
+        ConstMatrixView get_column(size_t x) const;
+        ConstMatrixView get_row(size_t y) const;
+        void reshape(size_t new_width, size_t new_height); // keeps the row-major element order
         std::string str() const;
         void from_str(const std::string& str);
         std::string shape_str() const;
     private:
+        static size_t padded_stride(size_t width, RowPadding padding);
+        void check_same_shape(size_t other_width, size_t other_height, const std::string& other_shape, const char* verb) const;
+        void check_product_operands(ConstMatrixView mat, const Matrix& result, size_t inner_a, size_t inner_b,
+                                    const char* inner_a_name, const char* inner_b_name) const;
+
         size_t width;
         size_t height;
-        std::vector<float> data;
+        size_t stride;
+        RowPadding padding;
+        MatrixStorage data;
 };
 
+template<typename E>
+Matrix::Matrix(const MatrixExpression<E>& expr)
+:width(expr.self().get_width()), height(expr.self().get_height()), stride(width), padding(RowPadding::none), data(width * height)
+{
+    const E& e = expr.self();
+    float* dst = data.data();
+    for(size_t y = 0; y < height; y++){
+        for(size_t x = 0; x < width; x++){
+            dst[y * width + x] = e.element(x,y);
+        }
+    }
+}
+
+template<typename E>
+Matrix& Matrix::operator=(const MatrixExpression<E>& expr)
+{
+    // operands have the same shape as the result, so when this matrix is part of the
+    // expression no reallocation happens and every element is read before it is written
+    const E& e = expr.self();
+    resize(e.get_width(),e.get_height());
+    for(size_t y = 0; y < height; y++){
+        float* dst = data.data() + y * stride;
+        for(size_t x = 0; x < width; x++){
+            dst[x] = e.element(x,y);
+        }
+    }
+    return *this;
+}
+
+template<typename E>
+void Matrix::operator+=(const MatrixExpression<E>& expr)
+{
+    const E& e = expr.self();
+    check_same_shape(e.get_width(),e.get_height(),e.shape_str(),"added");
+    for(size_t y = 0; y < height; y++){
+        float* dst = data.data() + y * stride;
+        for(size_t x = 0; x < width; x++){
+            dst[x] += e.element(x,y);
+        }
+    }
+}
+
+template<typename E>
+void Matrix::operator-=(const MatrixExpression<E>& expr)
+{
+    const E& e = expr.self();
+    check_same_shape(e.get_width(),e.get_height(),e.shape_str(),"subtracted");
+    for(size_t y = 0; y < height; y++){
+        float* dst = data.data() + y * stride;
+        for(size_t x = 0; x < width; x++){
+            dst[x] -= e.element(x,y);
+        }
+    }
+}
+
+template<typename E>
+void Matrix::operator*=(const MatrixExpression<E>& expr)
+{
+    const E& e = expr.self();
+    check_same_shape(e.get_width(),e.get_height(),e.shape_str(),"multiplied (non dot product)");
+    for(size_t y = 0; y < height; y++){
+        float* dst = data.data() + y * stride;
+        for(size_t x = 0; x < width; x++){
+            dst[x] *= e.element(x,y);
+        }
+    }
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,161 @@
+#ifndef MATRIX_EXPRESSION_HPP
+#define MATRIX_EXPRESSION_HPP
+
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+// Lazily evaluated element-wise matrix arithmetic.
+//
+// An expression like a + b * 0.5f does not compute anything by itself, it builds a small
+// tree of expression nodes that only reference (or, for temporaries, own) their operands.
+// The work happens when the tree is assigned to a Matrix: every element of the destination
+// is computed in one fused loop, without temporary matrices in between.
+// Elements are addressed as element(x, y), so operands may have padded or strided rows.
+// Like any expression template, don't keep an expression around (e.g. in an auto variable)
+// after the matrices it references have changed or gone out of scope.
+
+class Matrix;
+
+template<typename E>
+class MatrixExpression{
+    public:
+        const E& self() const
+        {
+            return static_cast<const E&>(*this);
+        }
+
+        float sum() const
+        {
+            const E& expr = self();
+            float result = 0;
+            for(size_t y = 0; y < expr.get_height(); y++){
+                for(size_t x = 0; x < expr.get_width(); x++){
+                    result += expr.element(x, y);
+                }
+            }
+            return result;
+        }
+
+        std::string shape_str() const
+        {
+            return "(" + std::to_string(self().get_width()) + ", " + std::to_string(self().get_height()) + ")";
+        }
+};
+
+template<typename T>
+struct is_matrix_expression : std::is_base_of<MatrixExpression<std::decay_t<T>>, std::decay_t<T>> {};
+
+// named matrices are referenced, temporaries and expression nodes are stored by value
+template<typename T>
+using expression_operand_t = std::conditional_t<
+    std::is_lvalue_reference<T>::value && std::is_same<std::decay_t<T>, Matrix>::value,
+    const Matrix&,
+    std::decay_t<T>>;
+
+struct ElementAdd{
+    static constexpr const char* verb = "added";
+    static float apply(float a, float b) { return a + b; }
+};
+
+struct ElementSubtract{
+    static constexpr const char* verb = "subtracted";
+    static float apply(float a, float b) { return a - b; }
+};
+
+struct ElementMultiply{
+    static constexpr const char* verb = "multiplied (non dot product)";
+    static float apply(float a, float b) { return a * b; }
+};
+
+struct ElementDivide{
+    static float apply(float a, float b) { return a / b; }
+};
+
+template<typename L, typename R, typename Op>
+class BinaryExpression : public MatrixExpression<BinaryExpression<L, R, Op>>{
+    public:
+        template<typename A, typename B>
+        BinaryExpression(A&& a, B&& b)
+        :left(std::forward<A>(a)), right(std::forward<B>(b))
+        {
+            if(left.get_width() != right.get_width() || left.get_height() != right.get_height()){
+                std::cout << "A shape:" << left.shape_str() << std::endl;
+                std::cout << "B shape:" << right.shape_str() << std::endl;
+                throw std::invalid_argument(std::string("matrices must have same dimensions to be ") + Op::verb);
+            }
+        }
+
+        size_t get_width() const { return left.get_width(); }
+        size_t get_height() const { return left.get_height(); }
+        float element(size_t x, size_t y) const { return Op::apply(left.element(x, y), right.element(x, y)); }
+
+    private:
+        L left;
+        R right;
+};
+
+template<typename E, typename Op>
+class ScalarExpression : public MatrixExpression<ScalarExpression<E, Op>>{
+    public:
+        template<typename A>
+        ScalarExpression(A&& a, float value)
+        :operand(std::forward<A>(a)), value(value)
+        {}
+
+        size_t get_width() const { return operand.get_width(); }
+        size_t get_height() const { return operand.get_height(); }
+        float element(size_t x, size_t y) const { return Op::apply(operand.element(x, y), value); }
+
+    private:
+        E operand;
+        float value;
+};
+
+template<typename L, typename R>
+using enable_if_expressions_t = std::enable_if_t<is_matrix_expression<L>::value && is_matrix_expression<R>::value>;
+
+template<typename E>
+using enable_if_expression_t = std::enable_if_t<is_matrix_expression<E>::value>;
+
+template<typename L, typename R, typename = enable_if_expressions_t<L, R>>
+BinaryExpression<expression_operand_t<L>, expression_operand_t<R>, ElementAdd> operator+(L&& left, R&& right)
+{
+    return {std::forward<L>(left), std::forward<R>(right)};
+}
+
+template<typename L, typename R, typename = enable_if_expressions_t<L, R>>
+BinaryExpression<expression_operand_t<L>, expression_operand_t<R>, ElementSubtract> operator-(L&& left, R&& right)
+{
+    return {std::forward<L>(left), std::forward<R>(right)};
+}
+
+// element-wise (Hadamard) product, use Matrix::dot for the matrix product
+template<typename L, typename R, typename = enable_if_expressions_t<L, R>>
+BinaryExpression<expression_operand_t<L>, expression_operand_t<R>, ElementMultiply> operator*(L&& left, R&& right)
+{
+    return {std::forward<L>(left), std::forward<R>(right)};
+}
+
+template<typename E, typename = enable_if_expression_t<E>>
+ScalarExpression<expression_operand_t<E>, ElementSubtract> operator-(E&& expr, float value)
+{
+    return {std::forward<E>(expr), value};
+}
+
+template<typename E, typename = enable_if_expression_t<E>>
+ScalarExpression<expression_operand_t<E>, ElementMultiply> operator*(E&& expr, float factor)
+{
+    return {std::forward<E>(expr), factor};
+}
+
+template<typename E, typename = enable_if_expression_t<E>>
+ScalarExpression<expression_operand_t<E>, ElementDivide> operator/(E&& expr, float factor)
+{
+    return {std::forward<E>(expr), factor};
+}
+
+#endif
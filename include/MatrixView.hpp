@@ -0,0 +1,99 @@
+#ifndef MATRIX_VIEW_HPP
+#define MATRIX_VIEW_HPP
+
+#include "MatrixExpression.hpp"
+#include <cstddef>
+#include <vector>
+
+// Non-owning views of matrix data: a pointer, a shape and a row stride (the number of floats
+// between the starts of two rows, at least the width). Rows, columns and blocks of a view are
+// views of the same memory, so slicing is O(1) and copies nothing.
+// A view doesn't keep its matrix alive and is invalidated when the matrix reallocates
+// (growing resize, assigning a larger matrix).
+// Views take part in element-wise expressions like matrices, and Matrix operations that take
+// a matrix operand (dot, add_column_vector, ...) accept a view instead.
+
+class ConstMatrixView : public MatrixExpression<ConstMatrixView>{
+    public:
+        ConstMatrixView();
+        ConstMatrixView(const float* data, size_t width, size_t height); // rows stored back to back
+        ConstMatrixView(const float* data, size_t width, size_t height, size_t stride);
+
+        size_t get_width() const { return width; }
+        size_t get_height() const { return height; }
+        size_t get_stride() const { return stride; }
+        const float* get_data() const { return data; }
+        bool is_contiguous() const { return stride == width || height <= 1; }
+        float get_value(size_t x, size_t y) const;
+        float element(size_t x, size_t y) const { return data[y * stride + x]; } // unchecked, used by expressions
+
+        ConstMatrixView row(size_t y) const; // 1 high
+        ConstMatrixView column(size_t x) const; // 1 wide, a column vector
+        ConstMatrixView rows(size_t begin, size_t end) const; // rows [begin,end)
+        ConstMatrixView columns(size_t begin, size_t end) const; // columns [begin,end), e.g. samples of a batch
+        ConstMatrixView block(size_t x, size_t y, size_t block_width, size_t block_height) const;
+    private:
+        const float* data;
+        size_t width;
+        size_t height;
+        size_t stride;
+};
+
+class MatrixView : public MatrixExpression<MatrixView>{
+    public:
+        MatrixView();
+        MatrixView(float* data, size_t width, size_t height);
+        MatrixView(float* data, size_t width, size_t height, size_t stride);
+        operator ConstMatrixView() const { return ConstMatrixView(data,width,height,stride); }
+
+        size_t get_width() const { return width; }
+        size_t get_height() const { return height; }
+        size_t get_stride() const { return stride; }
+        float* get_data() const { return data; }
+        bool is_contiguous() const { return stride == width || height <= 1; }
+        float get_value(size_t x, size_t y) const;
+        void set_value(size_t x, size_t y, float value);
+        float element(size_t x, size_t y) const { return data[y * stride + x]; }
+
+        // writes the elements of a same shaped expression (or view) through the view,
+        // unlike operator= which would only rebind the view
+        template<typename E>
+        void assign(const MatrixExpression<E>& expr);
+        void fill(float value);
+
+        MatrixView row(size_t y) const;
+        MatrixView column(size_t x) const;
+        MatrixView rows(size_t begin, size_t end) const;
+        MatrixView columns(size_t begin, size_t end) const;
+        MatrixView block(size_t x, size_t y, size_t block_width, size_t block_height) const;
+    private:
+        void check_same_shape(size_t other_width, size_t other_height, const std::string& other_shape) const;
+
+        float* data;
+        size_t width;
+        size_t height;
+        size_t stride;
+};
+
+template<typename E>
+void MatrixView::assign(const MatrixExpression<E>& expr)
+{
+    // the expression is evaluated row by row, reading element i before writing it,
+    // so a view may appear in its own expression as long as it's the same view
+    const E& e = expr.self();
+    check_same_shape(e.get_width(),e.get_height(),e.shape_str());
+    for(size_t y = 0; y < height; y++){
+        float* dst = data + y * stride;
+        for(size_t x = 0; x < width; x++){
+            dst[x] = e.element(x,y);
+        }
+    }
+}
+
+// the elements of view row by row without the row padding, width * height floats to out
+void copy_elements(ConstMatrixView view, float* out);
+// the same as a pointer: the view's own memory when it has no padding (is_contiguous),
+// otherwise a packed copy in scratch
+const float* packed_elements(ConstMatrixView view, std::vector<float>& scratch);
+
+#endif
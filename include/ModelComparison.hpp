@@ -0,0 +1,38 @@
+#ifndef MODEL_COMPARISON_HPP
+#define MODEL_COMPARISON_HPP
+
+#include "TrainingBatch.hpp"
+#include <cstddef>
+#include <vector>
+
+// Shared by the reports that run a set of samples through a model and compare the results,
+// e.g. an int8 or pruned model against the float network it came from.
+
+// the inputs of the samples back to back, the layout every predict_batch takes,
+// every sample has to be a column vector of input_size values (padded or not)
+std::vector<float> pack_inputs(const TrainingBatch& samples, size_t input_size);
+
+size_t argmax(const float* values, size_t count);
+
+// outputs of a model against those of a reference model for the same samples,
+// both hold samples.size() results of output_size values back to back
+struct OutputComparison{
+    float max_abs_error; // largest difference of an output value
+    float mean_abs_error;
+    float reference_accuracy; // fraction of samples where the largest output matches the desired one
+    float accuracy;
+    float agreement; // fraction of samples where both models pick the same output
+};
+
+OutputComparison compare_outputs(const float* reference, const float* outputs, size_t output_size,
+                                 const TrainingBatch& samples);
+
+// outputs of a single model against the desired outputs of the samples
+struct OutputScore{
+    float cost; // mean squared error of the output values
+    float accuracy; // fraction of samples where the largest output matches the desired one
+};
+
+OutputScore score_outputs(const float* outputs, size_t output_size, const TrainingBatch& samples);
+
+#endif
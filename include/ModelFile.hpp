@@ -0,0 +1,86 @@
+#ifndef MODEL_FILE_HPP
+#define MODEL_FILE_HPP
+
+#include "MappedFile.hpp"
+#include "Matrix.hpp"
+#include "HalfFloat.hpp"
+#include "Activation.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary model file format (little endian), replaces NeuralNet::to_str/from_str for storage:
+//
+//   ModelFileHeader                      64 bytes
+//   ModelLayerEntry[layer_count]         topology and block offsets, entry 0 is the input layer
+//   weight and bias blocks               each starting at a multiple of alignment (64) bytes
+//
+// Weights of layer n are stored row-major (neurons x previous layer neurons) exactly like
+// Matrix stores them, so a mapped file can be used in place without any conversion.
+// Weights are stored in the header's data type (float32, float16 or bfloat16, see HalfFloat.hpp),
+// biases are always float32. Every layer entry records the activation of its layer.
+// The checksum is a crc32 over everything after the header.
+
+enum class ModelDataType : uint32_t { float32 = 0, float16 = 1, bfloat16 = 2 };
+
+size_t model_data_type_size(ModelDataType type); // bytes per weight
+HalfFormat model_data_type_half_format(ModelDataType type); // throws for float32
+
+const uint32_t MODEL_FILE_VERSION = 2; // version 1 (24 byte layer entries, sigmoid everywhere) is still read
+const uint32_t MODEL_FILE_ALIGNMENT = 64;
+
+struct ModelFileHeader{
+    char magic[8];               // "NNMODEL\0"
+    uint32_t version;
+    uint32_t dtype;              // ModelDataType of the weight blocks
+    uint32_t alignment;          // alignment of every block in bytes
+    uint32_t layer_count;        // including the input layer
+    uint64_t layer_table_offset;
+    uint64_t file_size;
+    uint32_t checksum;
+    uint32_t reserved[5];
+};
+
+struct ModelLayerEntry{
+    uint64_t neurons;
+    uint64_t weight_offset;      // 0 for the input layer
+    uint64_t bias_offset;        // 0 for the input layer
+    uint32_t activation;         // ActivationKind, 0 (sigmoid) for the input layer
+    uint32_t reserved;
+};
+
+static_assert(sizeof(ModelFileHeader) == 64, "model file header must be 64 bytes");
+static_assert(sizeof(ModelLayerEntry) == 32, "model layer entry must be 32 bytes");
+
+// writes a model, weights[n], biases[n] and activations[n] are ignored for n = 0 (input layer)
+// the float weights are rounded to weight_type when that is a half precision type,
+// no activations means sigmoid for every layer
+void write_model_file(const std::string& path, const std::vector<size_t>& topology,
+                      const std::vector<const float*>& weights, const std::vector<const float*>& biases,
+                      ModelDataType weight_type = ModelDataType::float32,
+                      const std::vector<ActivationKind>& activations = {});
+
+// Read-only view of a model file mapped into memory. Layer weights point straight into the
+// mapped pages, nothing is copied, so opening a model costs a few page faults regardless of size.
+class MappedModel{
+    public:
+        // the checksum requires reading the whole file, it is only verified on request
+        MappedModel(const std::string& path, bool verify_checksum = false);
+        size_t get_layer_count() const;
+        size_t get_layer_size(size_t n_layer) const;
+        ModelDataType get_data_type() const; // type of the weights
+        const float* get_layer_weights(size_t n_layer) const; // (size x previous size) row-major, float32 models only
+        const void* get_layer_weight_data(size_t n_layer) const; // same, in any data type
+        const float* get_layer_bias(size_t n_layer) const;
+        ActivationKind get_layer_activation(size_t n_layer) const;
+        Matrix feedforward(ConstMatrixView input) const; // single column input, like NeuralNet::feedforward
+    private:
+        MappedFile file;
+        ModelDataType data_type;
+        std::vector<size_t> topology;
+        std::vector<const void*> weights;
+        std::vector<const float*> biases;
+        std::vector<ActivationKind> activations;
+};
+
+#endif
@@ -2,37 +2,111 @@
 #define NEURALNET_HPP
 
 #include "TrainingBatch.hpp"
+#include "ThreadPool.hpp"
+#include "TrainingWorkspace.hpp"
+#include "ModelFile.hpp"
+#include "LayerProfile.hpp"
+#include "SparseInput.hpp"
+#include "Activation.hpp"
+#include "Optimizer.hpp"
+#include <memory>
 
 class NeuralNet{
     public:
         NeuralNet();
-        void add_layer(size_t n_neurons);
-        void set_input(const Matrix& input);
+        // the activation of the input layer (the first one added) is ignored
+        void add_layer(size_t n_neurons, ActivationKind activation = ActivationKind::sigmoid);
+        void set_input(ConstMatrixView input); // a column vector, e.g. one column of a stacked batch
         const Matrix& get_output();
         float sigmoid(float x);
         void sigmoid(Matrix& mat);
         float sigmoid_derivative(float x);
         void sigmoid_derivative(Matrix& mat);
         void feedforward();
-        void randomize();
+        void randomize(); // sigmoid layers in [0, 1), the others centered and scaled to the layer size
+        void set_thread_count(size_t n_threads); // threads used by process_batch, 1 (default) disables threading
+        size_t get_thread_count() const;
         void process_batch(float learning_rate, const TrainingBatch& batch);
-        void backpropagate(const Matrix& input, const Matrix& desired);
-        float calculate_cost(const Matrix& desired);
+        // the same for samples already stacked as columns (inputs x batch size and outputs x batch size),
+        // the workers read their slices in place
+        void process_batch(float learning_rate, ConstMatrixView inputs, ConstMatrixView desired);
+        // Hogwild asynchronous SGD: the set_thread_count() threads each take the next samples_per_update
+        // samples, backpropagate them against the current weights and add the plain SGD step straight
+        // to the shared weights and biases, without locks or a reduction. Racy by design: threads read
+        // weights while others update them and concurrent adds to one weight can lose one of them, which
+        // SGD tolerates as long as the steps are small and (with sparse inputs) mostly touch different weights.
+        // The optimizer of set_optimizer is not used, pruned weights stay 0. See also compare_hogwild.
+        void train_hogwild(float learning_rate, const TrainingBatch& samples, size_t samples_per_update = 1);
+        // update rule of process_batch (see Optimizer.hpp), plain SGD by default, a new rule starts without state
+        void set_optimizer(const OptimizerSettings& settings);
+        const Optimizer& get_optimizer() const;
+        void reset_optimizer(); // drops the moments and the step count, e.g. before training loaded weights
+        void backpropagate(ConstMatrixView input, ConstMatrixView desired);
+        float calculate_cost(ConstMatrixView desired);
+        // the values are copied into the net's own unpadded layout, whatever the padding of mat
         void set_layer_neurons(size_t n_layer, const Matrix& mat);
         void set_layer_weights(size_t n_layer, const Matrix& mat);
         void set_layer_bias(size_t n_layer, const Matrix& mat);
-        const Matrix& get_layer_neurons(size_t n_layer);
-        const Matrix& get_layer_weights(size_t n_layer);
-        const Matrix& get_layer_bias(size_t n_layer);
+        size_t get_layer_count() const;
+        const Matrix& get_layer_neurons(size_t n_layer) const;
+        const Matrix& get_layer_weights(size_t n_layer) const;
+        const Matrix& get_layer_bias(size_t n_layer) const;
+        ActivationKind get_layer_activation(size_t n_layer) const;
         std::string to_str();
         void from_str(const std::string& str);
+        // binary model file, see ModelFile.hpp, weights can be rounded to 16 bit floats to halve the size
+        void save(const std::string& path, ModelDataType weight_type = ModelDataType::float32) const;
+        void load(const std::string& path); // replaces the current layers with the ones in the file
+        // per layer timers and FLOP/byte counters of feedforward, backpropagate and process_batch,
+        // off by default, when off the instrumented code only tests a null pointer per phase
+        void set_profiling(bool enabled);
+        bool get_profiling() const;
+        LayerProfile get_profile() const; // counters of all threads since the last reset
+        void reset_profile();
+        // sparse first layer (see SparseInput.hpp): when at most this fraction of the inputs is non-zero
+        // (for process_batch, non-zero in any sample of the batch) the zero inputs are skipped in the
+        // forward product and the update only touches the weight columns of the non-zero inputs
+        // (with a stateful optimizer their state too, the other weights wait for a batch that uses them),
+        // 0 (default) turns the check off
+        void set_sparse_input_threshold(float density);
+        float get_sparse_input_threshold() const;
+        const SparseInputStats& get_sparse_input_stats() const; // passes checked since the last reset
+        void reset_sparse_input_stats();
+        // magnitude pruning: weights with |w| below threshold become 0 and stay 0 through later
+        // process_batch updates (fine-tuning) until clear_pruning(), n_layer 0 prunes every layer,
+        // returns the number of pruned weights of the pruned layers, earlier prunings included
+        size_t prune_weights(float threshold, size_t n_layer = 0);
+        // the threshold that keeps the given fraction of the weights of a layer (0: of all layers together)
+        float pruning_threshold(float density, size_t n_layer = 0) const;
+        void clear_pruning();
+        float get_weight_density(size_t n_layer = 0) const; // fraction of non-zero weights
     private:
+        // process_batch over BatchSamples or StackedSamples (see NeuralNet.cpp)
+        template<typename Samples>
+        void train_batch(float learning_rate, const Samples& batch);
+        // first_weights is weight_layers[1], or for a sparse first layer its columns of the active inputs
+        // (inputs then only has those rows and the first weight gradient only those columns)
+        void backpropagate_batch(ConstMatrixView inputs, ConstMatrixView desired, TrainingWorkspace& workspace,
+                                 const Matrix& first_weights);
+        bool sparse_first_layer();
+        bool select_sparse_inputs(size_t n_workers);
+
         std::vector<Matrix> neuron_layers;
         std::vector<Matrix> weight_layers;
         std::vector<Matrix> bias_layers;
         std::vector<Matrix> error_layers;
-        std::vector<Matrix> bias_delta;
-        std::vector<Matrix> weight_delta;
+        std::vector<ActivationKind> activation_layers;
+        std::vector<Matrix> weight_masks; // 1 for kept and 0 for pruned weights, empty for unpruned layers
+        std::vector<TrainingWorkspace> thread_workspaces; // one per process_batch worker, reused across batches
+        std::shared_ptr<ThreadPool> thread_pool; // shared between copies, run() serializes concurrent users
+        bool profiling;
+        LayerProfile profile; // phases run by the calling thread outside the workspaces (feedforward, update)
+        float sparse_input_threshold;
+        std::vector<uint32_t> active_inputs; // non-zero inputs of the current pass
+        std::vector<float> active_values; // their values, feedforward only
+        Matrix active_weights; // the first layer weight columns of active_inputs, shared by the workers
+        SparseInputStats sparse_stats;
+        Optimizer optimizer; // slot 2n holds the state of the weights of layer n, 2n+1 of its bias
 
 };
 
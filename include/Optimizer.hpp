@@ -0,0 +1,71 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include "Matrix.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Update rules for process_batch (see NeuralNet::set_optimizer).
+//
+// g is the summed gradient of a batch as NeuralNet computes it (pointing downhill, it is added
+// to the weights) and d = g / batch size its mean. With learning rate lr:
+//   sgd       p += lr * d
+//   momentum  v = momentum * v + d, p += lr * v
+//   nesterov  v = momentum * v + d, p += lr * (d + momentum * v)
+//   rmsprop   s = rms_decay * s + (1 - rms_decay) * d^2, p += lr * d / (sqrt(s) + epsilon)
+//   adam      m = beta1 * m + (1 - beta1) * d, s = beta2 * s + (1 - beta2) * d^2,
+//             p += lr * m_hat / (sqrt(s_hat) + epsilon) with the bias corrected m_hat and s_hat
+// Every rule is a single in-place pass over the parameters, the gradient and its state
+// (v, m and s, one float each per parameter), with AVX-512 or AVX2 kernels when available
+// (see gemm_isa_select).
+
+enum class OptimizerKind{ sgd, momentum, nesterov, rmsprop, adam };
+
+const char* optimizer_name(OptimizerKind kind);
+
+struct OptimizerSettings{
+    OptimizerKind kind = OptimizerKind::sgd;
+    float momentum = 0.9f;  // momentum and nesterov
+    float rms_decay = 0.9f; // rmsprop
+    float beta1 = 0.9f;     // adam
+    float beta2 = 0.999f;   // adam
+    float epsilon = 1e-8f;  // rmsprop and adam
+};
+
+// An update rule with the state of a set of parameter matrices, each in its own slot.
+// A slot's state is created (zeroed) on its first update and again when the parameter count changes.
+class Optimizer{
+    public:
+        Optimizer(const OptimizerSettings& settings = OptimizerSettings());
+        const OptimizerSettings& get_settings() const;
+        // once before the updates of a batch, adam's bias correction counts the steps
+        void next_step();
+        size_t get_step() const;
+        // params += update(gradient), gradient is the sum over batch_size samples,
+        // a mask (1 kept, 0 pruned, see NeuralNet::prune_weights) is applied to the result
+        void update(size_t slot, float learning_rate, size_t batch_size, MatrixView params,
+                    ConstMatrixView gradient, const Matrix* mask = nullptr);
+        // the same for the given columns of params only, gradient holds one column per index
+        // (the sparse first layer), the other parameters and their state are left as they are
+        void update_columns(size_t slot, float learning_rate, size_t batch_size, MatrixView params,
+                            ConstMatrixView gradient, const std::vector<uint32_t>& columns, const Matrix* mask = nullptr);
+        void reset(); // drops the state of all slots and the step count
+        size_t get_state_bytes() const;
+        double get_flops_per_parameter() const; // work of one parameter update, for profiling
+        double get_bytes_per_parameter() const;
+        static const char* get_kernel_name(); // kernel used on this cpu
+    private:
+        struct State{
+            MatrixStorage first;  // v of momentum and nesterov, m of adam
+            MatrixStorage second; // s of rmsprop and adam
+        };
+
+        State& get_state(size_t slot, size_t count);
+
+        OptimizerSettings settings;
+        size_t step;
+        std::vector<State> states;
+};
+
+#endif
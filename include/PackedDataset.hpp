@@ -0,0 +1,71 @@
+#ifndef PACKED_DATASET_HPP
+#define PACKED_DATASET_HPP
+
+#include "MappedFile.hpp"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Packed dataset file (little endian), a preprocessed copy of a whole dataset in one file:
+//
+//   PackedDatasetHeader                  64 bytes
+//   samples                              sample_count blocks of sample_size floats, every
+//                                        block starts at a multiple of 64 bytes (sample_stride)
+//   uint32_t labels[sample_count]
+//
+// The checksum is a crc32 over everything after the header. Labels go last so samples
+// can be streamed into the file without knowing the sample count up front.
+
+const uint32_t PACKED_DATASET_VERSION = 1;
+const uint32_t PACKED_DATASET_ALIGNMENT = 64;
+
+struct PackedDatasetHeader{
+    char magic[8];               // "NNPACK\0\0"
+    uint32_t version;
+    uint32_t alignment;
+    uint64_t sample_count;
+    uint64_t sample_size;        // floats per sample
+    uint64_t sample_stride;      // bytes between the start of two samples
+    uint64_t label_offset;
+    uint64_t sample_offset;
+    uint32_t checksum;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(PackedDatasetHeader) == 64, "packed dataset header must be 64 bytes");
+
+// Writes a packed dataset one sample at a time, the labels are collected in memory
+// and written together with the header by finish() (or the destructor).
+class PackedDatasetWriter{
+    public:
+        PackedDatasetWriter(const std::string& path, size_t sample_size);
+        ~PackedDatasetWriter();
+        void add_sample(const float* sample, uint32_t label);
+        void finish();
+    private:
+        std::string path;
+        std::ofstream out;
+        PackedDatasetHeader header;
+        std::vector<uint32_t> labels;
+        uint32_t crc;
+        bool finished;
+};
+
+// Read-only, memory mapped packed dataset. Samples are handed out as pointers into the
+// mapped pages, so opening the dataset doesn't read or copy any sample data.
+class PackedDataset{
+    public:
+        PackedDataset(const std::string& path, bool verify_checksum = false);
+        size_t size() const;
+        size_t get_sample_size() const;
+        const float* get_sample(size_t index) const;
+        uint32_t get_label(size_t index) const;
+    private:
+        MappedFile file;
+        PackedDatasetHeader header;
+        const uint32_t* labels;
+        const uint8_t* samples;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef QUANTIZED_NET_HPP
+#define QUANTIZED_NET_HPP
+
+#include "NeuralNet.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Int8 post-training quantization of a trained NeuralNet, for inference only.
+//
+// Weights are stored as int8 with one scale per row (neuron), scale = max |w| / 127.
+// The input of every layer is quantized to uint8 with a scale and zero point calibrated from
+// the range the float network produces on a set of sample inputs.
+// Products accumulate in int32 and are rescaled to float before the bias and activation f,
+// so a layer computes f(w_scale * x_scale * (sum(qw * qx) - zero_point * sum(qw)) + b).
+// The kernels use AVX-512 VNNI, AVX-512BW or AVX2 when available (see gemm_isa_select).
+
+class QuantizedNet{
+    public:
+        // calibration samples should be representative of the inputs the model will see
+        QuantizedNet(const NeuralNet& net, const TrainingBatch& calibration);
+        Matrix feedforward(ConstMatrixView input) const; // single column input, like NeuralNet::feedforward
+        // inputs holds n samples of get_input_size() floats back to back, like InferencePlan
+        void predict_batch(const float* inputs, size_t n, float* outputs) const;
+        size_t get_input_size() const;
+        size_t get_output_size() const;
+        size_t get_weight_bytes() const; // int8 weights plus per row scales and sums
+        static const char* get_kernel_name(); // kernel used on this cpu
+    private:
+        struct Layer{
+            size_t inputs;
+            size_t outputs;
+            size_t stride; // row length padded to a multiple of 64 (padding weights are 0)
+            std::vector<int8_t> weights; // row count padded to whole kernel blocks, padding rows are 0
+            std::vector<float> weight_scales;
+            std::vector<int32_t> weight_sums;
+            std::vector<float> bias;
+            ActivationKind activation;
+            float input_scale;
+            int32_t input_zero_point;
+        };
+
+        void run_layer(const Layer& layer, const uint8_t* const* inputs, size_t n, float** outputs) const;
+
+        std::vector<Layer> layers;
+};
+
+// float model against its quantized version on a set of samples
+struct QuantizationReport{
+    size_t samples;
+    float max_abs_error; // largest difference of an output value
+    float mean_abs_error;
+    float float_accuracy; // fraction of samples where the largest output matches the desired one
+    float quantized_accuracy;
+    float agreement; // fraction of samples where both models pick the same output
+    size_t float_weight_bytes;
+    size_t quantized_weight_bytes;
+    double float_seconds; // time to run all samples through each model
+    double quantized_seconds;
+    std::string str() const;
+};
+
+QuantizationReport compare_quantized(const NeuralNet& net, const QuantizedNet& quantized, const TrainingBatch& samples);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef SPARSE_INPUT_HPP
+#define SPARSE_INPUT_HPP
+
+#include "Matrix.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Kernels for the sparse input path of the first layer (see NeuralNet::set_sparse_input_threshold).
+//
+// Inputs like digit bitmaps are mostly zero. Only the input rows (features) that are non-zero
+// in at least one sample of a batch, the active inputs, take part in the first layer:
+// the forward product becomes weights[:, active] * inputs[active, :], still a dense gemm but
+// over active.size() instead of all inputs, and the weight gradient only has active columns.
+// Only exact zeros are skipped, so the results match the dense path up to rounding.
+
+// counts of the forward passes through the first layer, a batch is one pass
+struct SparseInputStats{
+    size_t sparse_passes = 0;
+    size_t dense_passes = 0;
+    size_t active_inputs = 0; // summed over all passes
+    size_t total_inputs = 0;
+
+    void add(size_t active, size_t total, bool sparse);
+    void merge(const SparseInputStats& other);
+    double sparse_fraction() const; // share of passes that took the sparse path
+    double mean_density() const; // share of active inputs over all passes
+};
+
+// sets mask[y] to 1 when row y of inputs has a non-zero element, rows already set are kept,
+// so the masks of several samples or parts of a batch can be collected in one mask
+void mark_active_rows(ConstMatrixView inputs, std::vector<uint8_t>& mask);
+// the non-zero elements of a column vector and their row indices, in ascending order
+void collect_non_zero(ConstMatrixView column, std::vector<uint32_t>& indices, std::vector<float>& values);
+// indices of the set entries of mask, in ascending order
+void mask_to_indices(const std::vector<uint8_t>& mask, std::vector<uint32_t>& indices);
+// result = mat[rows, :] (rows.size() high)
+void gather_rows(ConstMatrixView mat, const std::vector<uint32_t>& rows, Matrix& result);
+// result = mat[:, columns] (columns.size() wide)
+void gather_columns(ConstMatrixView mat, const std::vector<uint32_t>& columns, Matrix& result);
+// result = weights * x for a column vector x given by its non-zero values and their row indices
+void sparse_matrix_vector(ConstMatrixView weights, const std::vector<uint32_t>& indices,
+                          const std::vector<float>& values, Matrix& result);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef SPARSE_NET_HPP
+#define SPARSE_NET_HPP
+
+#include "NeuralNet.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Inference on a pruned NeuralNet (see NeuralNet::prune_weights), for inference only.
+//
+// Layers with at most max_density non-zero weights are stored in compressed sparse row (CSR)
+// form: per row the non-zero values and their column indices, so only they are read and multiplied.
+// Denser layers stay dense and use gemm: the CSR kernels read 8 bytes and gather per weight, on the
+// example network they beat dense gemm for single samples below about 20% density.
+// A single sample runs a sparse matrix-vector product that gathers the inputs of a row's
+// non-zeros. Batches run in blocks of 16 samples stored feature-major (every input a row of 16
+// samples), so every non-zero weight is one multiply-add over a whole vector of samples.
+// The kernels use AVX-512 or AVX2 when available (see gemm_isa_select).
+
+class SparseNet{
+    public:
+        SparseNet(const NeuralNet& net, float max_density = 0.2f);
+        Matrix feedforward(ConstMatrixView input) const; // single column input, like NeuralNet::feedforward
+        // inputs holds n samples of get_input_size() floats back to back, like InferencePlan
+        void predict_batch(const float* inputs, size_t n, float* outputs) const;
+        size_t get_input_size() const;
+        size_t get_output_size() const;
+        size_t get_weight_bytes() const; // values plus the CSR indices
+        float get_density() const; // non-zero weights over all weights
+        bool is_layer_sparse(size_t n_layer) const; // n_layer like NeuralNet, from 1
+        static const char* get_kernel_name(); // kernel used on this cpu
+    private:
+        struct Layer{
+            size_t inputs;
+            size_t outputs;
+            bool sparse; // CSR, otherwise values holds the dense weights row-major
+            std::vector<uint32_t> row_offsets; // row r is [row_offsets[r], row_offsets[r+1]) of columns and values
+            std::vector<uint32_t> columns;
+            std::vector<float> values;
+            std::vector<float> bias;
+            ActivationKind activation;
+        };
+
+        void run_sample(const float* input, float* output, MatrixStorage (&buffers)[2]) const;
+        void run_block(const float* inputs, size_t n, float* outputs, MatrixStorage (&buffers)[2]) const;
+
+        std::vector<Layer> layers;
+        size_t non_zero_weights;
+        size_t total_weights;
+};
+
+// unpruned model against a pruned sparse version on a set of samples
+struct PruningReport{
+    size_t samples;
+    float density; // non-zero weights of the sparse model
+    float max_abs_error; // largest difference of an output value
+    float mean_abs_error;
+    float dense_accuracy; // fraction of samples where the largest output matches the desired one
+    float sparse_accuracy;
+    float agreement; // fraction of samples where both models pick the same output
+    size_t dense_weight_bytes;
+    size_t sparse_weight_bytes;
+    double dense_seconds; // time to run all samples through each model as one batch
+    double sparse_seconds;
+    double dense_sample_seconds; // mean time of a single sample
+    double sparse_sample_seconds;
+    std::string str() const;
+};
+
+PruningReport compare_pruned(const NeuralNet& net, const SparseNet& sparse, const TrainingBatch& samples);
+
+#endif
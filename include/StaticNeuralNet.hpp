@@ -0,0 +1,251 @@
+#ifndef STATIC_NEURAL_NET_HPP
+#define STATIC_NEURAL_NET_HPP
+
+#include "NeuralNet.hpp"
+#include "ModelFile.hpp"
+#include "HalfFloat.hpp"
+#include "Activation.hpp"
+#include "Gemm.hpp"
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Inference network with a topology fixed at compile time, StaticNeuralNet<16384, 32, 10>.
+//
+// Weights and biases live in std::array members sized from the topology, every loop bound is
+// a constant so the layer products are compiled separately for each shape, and feedforward()
+// has no shape checks and does no heap allocation (hidden activations are on the stack).
+// Weights are loaded from the same model files as NeuralNet (any ModelDataType) or copied from
+// a NeuralNet; those are the only places where the topology is checked at runtime.
+// The activations come along with the weights (sigmoid for a default constructed network).
+// The weights are stored inside the object, so large networks should be created with new or
+// as a static rather than on the stack.
+
+template<size_t... Sizes>
+class StaticNeuralNet{
+    static_assert(sizeof...(Sizes) >= 2, "a network needs at least an input and an output layer");
+
+    public:
+        static constexpr size_t layer_count = sizeof...(Sizes);
+        static constexpr std::array<size_t, layer_count> topology = {Sizes...};
+        static constexpr size_t input_size = topology.front();
+        static constexpr size_t output_size = topology.back();
+
+        typedef std::array<float, input_size> Input;
+        typedef std::array<float, output_size> Output;
+
+        StaticNeuralNet() : weights{}, biases{}, activations{} {}
+
+        void feedforward(const Input& input, Output& output) const
+        {
+            std::array<float, widest_hidden()> buffers[2];
+            forward_layer<1>(input.data(), output.data(), buffers);
+        }
+
+        Output feedforward(const Input& input) const
+        {
+            Output output;
+            feedforward(input, output);
+            return output;
+        }
+
+        void load(const std::string& path)
+        {
+            load(MappedModel(path, true));
+        }
+
+        void load(const MappedModel& model)
+        {
+            check_topology(model.get_layer_count(), [&](size_t n_layer){ return model.get_layer_size(n_layer); });
+            for(size_t n_layer = 1; n_layer < layer_count; n_layer++)
+            {
+                size_t count = topology[n_layer] * topology[n_layer-1];
+                float* layer_weights = weights.data() + weight_offset(n_layer);
+                if(model.get_data_type() == ModelDataType::float32){
+                    const float* block = model.get_layer_weights(n_layer);
+                    std::copy(block, block + count, layer_weights);
+                }else{
+                    half_to_float(static_cast<const uint16_t*>(model.get_layer_weight_data(n_layer)), layer_weights,
+                                  count, model_data_type_half_format(model.get_data_type()));
+                }
+                const float* bias = model.get_layer_bias(n_layer);
+                std::copy(bias, bias + topology[n_layer], biases.data() + bias_offset(n_layer));
+                activations[n_layer] = model.get_layer_activation(n_layer);
+            }
+        }
+
+        void load(const NeuralNet& net)
+        {
+            check_topology(net.get_layer_count(), [&](size_t n_layer){ return net.get_layer_neurons(n_layer).get_height(); });
+            for(size_t n_layer = 1; n_layer < layer_count; n_layer++)
+            {
+                const MatrixStorage& layer_weights = net.get_layer_weights(n_layer).get_data();
+                const MatrixStorage& bias = net.get_layer_bias(n_layer).get_data();
+                std::copy(layer_weights.begin(), layer_weights.end(), weights.data() + weight_offset(n_layer));
+                std::copy(bias.begin(), bias.end(), biases.data() + bias_offset(n_layer));
+                activations[n_layer] = net.get_layer_activation(n_layer);
+            }
+        }
+
+        void save(const std::string& path, ModelDataType weight_type = ModelDataType::float32) const
+        {
+            std::vector<size_t> sizes(topology.begin(), topology.end());
+            std::vector<const float*> layer_weights = {nullptr};
+            std::vector<const float*> layer_biases = {nullptr};
+            for(size_t n_layer = 1; n_layer < layer_count; n_layer++)
+            {
+                layer_weights.push_back(weights.data() + weight_offset(n_layer));
+                layer_biases.push_back(biases.data() + bias_offset(n_layer));
+            }
+            write_model_file(path, sizes, layer_weights, layer_biases, weight_type,
+                             std::vector<ActivationKind>(activations.begin(), activations.end()));
+        }
+
+    private:
+        // weights of layer n (n >= 1) start after those of layers 1 to n-1, same for the biases
+        static constexpr size_t weight_offset(size_t n_layer)
+        {
+            size_t offset = 0;
+            for(size_t n = 1; n < n_layer; n++){
+                offset += topology[n] * topology[n-1];
+            }
+            return offset;
+        }
+
+        static constexpr size_t bias_offset(size_t n_layer)
+        {
+            size_t offset = 0;
+            for(size_t n = 1; n < n_layer; n++){
+                offset += topology[n];
+            }
+            return offset;
+        }
+
+        static constexpr size_t widest_hidden()
+        {
+            size_t widest = 1; // keeps the buffers valid arrays without hidden layers
+            for(size_t n = 1; n + 1 < layer_count; n++){
+                widest = (topology[n] > widest) ? topology[n] : widest;
+            }
+            return widest;
+        }
+
+        template<typename LayerSize>
+        static void check_topology(size_t count, LayerSize layer_size)
+        {
+            bool matches = (count == layer_count);
+            for(size_t n_layer = 0; matches && n_layer < layer_count; n_layer++){
+                matches = (layer_size(n_layer) == topology[n_layer]);
+            }
+            if(!matches){
+                throw std::invalid_argument("model topology does not match the static network");
+            }
+        }
+
+        template<size_t N>
+        void forward_layer(const float* in, float* output, std::array<float, widest_hidden()>* buffers) const
+        {
+            constexpr size_t in_size = topology[N-1];
+            constexpr size_t out_size = topology[N];
+            float* out = (N + 1 == layer_count) ? output : buffers[N % 2].data();
+
+            const float* layer_weights = weights.data() + weight_offset(N);
+#if defined(__x86_64__) || defined(__i386__)
+            if(gemm_get_isa() == GemmIsa::avx512){
+                product_avx512<in_size, out_size>(layer_weights, in, out);
+            }else if(gemm_get_isa() == GemmIsa::avx2){
+                product_avx2<in_size, out_size>(layer_weights, in, out);
+            }else
+#endif
+            {
+                product<Lanes4, in_size, out_size>(layer_weights, in, out);
+            }
+            bias_activation_by_row(activations[N], out, out_size, 1, biases.data() + bias_offset(N));
+
+            if constexpr(N + 1 < layer_count){
+                forward_layer<N + 1>(out, output, buffers);
+            }
+        }
+
+        // out = W * in for a row-major (Out x In) W. Blocks of ROWS rows are summed together so
+        // every loaded piece of the input is used for all of them. Partial sums are kept in
+        // generic vectors as wide as the target's registers, the compiler emits the instructions.
+        static constexpr size_t ROWS = 4;
+        typedef float Lanes4 __attribute__((vector_size(16)));
+        typedef float Lanes8 __attribute__((vector_size(32)));
+        typedef float Lanes16 __attribute__((vector_size(64)));
+
+        template<typename Lanes>
+        __attribute__((always_inline))
+        static inline void load_lanes(Lanes& lanes, const float* p)
+        {
+            std::memcpy(&lanes, p, sizeof(lanes)); // the rows are not aligned to the vector size
+        }
+
+        template<typename Lanes, size_t In, size_t Out>
+        __attribute__((always_inline))
+        static inline void product(const float* w, const float* in, float* out)
+        {
+            size_t row = 0;
+            for(; row + ROWS <= Out; row += ROWS){
+                rows_dot<Lanes, In, ROWS>(w + row * In, in, out + row);
+            }
+            if constexpr(Out % ROWS != 0){
+                rows_dot<Lanes, In, Out % ROWS>(w + row * In, in, out + row);
+            }
+        }
+
+        template<typename Lanes, size_t In, size_t R>
+        __attribute__((always_inline))
+        static inline void rows_dot(const float* w, const float* in, float* out)
+        {
+            constexpr size_t width = sizeof(Lanes) / sizeof(float);
+            constexpr size_t body = In / width * width;
+            Lanes sums[R] = {};
+            for(size_t i = 0; i < body; i += width){
+                Lanes values;
+                load_lanes(values, in + i);
+                for(size_t r = 0; r < R; r++){
+                    Lanes row;
+                    load_lanes(row, w + r * In + i);
+                    sums[r] += row * values;
+                }
+            }
+            for(size_t r = 0; r < R; r++){
+                float sum = 0.0f;
+                for(size_t l = 0; l < width; l++){
+                    sum += sums[r][l];
+                }
+                for(size_t i = body; i < In; i++){
+                    sum += w[r * In + i] * in[i];
+                }
+                out[r] = sum;
+            }
+        }
+
+#if defined(__x86_64__) || defined(__i386__)
+        // the same product compiled for the instruction set gemm is using
+        template<size_t In, size_t Out>
+        __attribute__((target("avx2,fma")))
+        static void product_avx2(const float* w, const float* in, float* out)
+        {
+            product<Lanes8, In, Out>(w, in, out);
+        }
+
+        template<size_t In, size_t Out>
+        __attribute__((target("avx512f")))
+        static void product_avx512(const float* w, const float* in, float* out)
+        {
+            product<Lanes16, In, Out>(w, in, out);
+        }
+#endif
+
+        std::array<float, weight_offset(layer_count)> weights; // per layer (size x previous size) row-major
+        std::array<float, bias_offset(layer_count)> biases;
+        std::array<ActivationKind, layer_count> activations; // entry 0 (input) unused
+};
+
+#endif
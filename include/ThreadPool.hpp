@@ -0,0 +1,43 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for fork/join style parallel loops.
+// The calling thread takes part in the work, so a pool of size n starts n-1 threads.
+class ThreadPool{
+    public:
+        ThreadPool(size_t n_threads);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        size_t size() const;
+        // calls task(0) ... task(n_tasks-1) spread over the threads and returns when all are done,
+        // the first exception thrown by a task is rethrown here
+        void run(size_t n_tasks, const std::function<void(size_t)>& task);
+    private:
+        void worker_loop();
+        void work_on_current_job();
+
+        std::vector<std::thread> workers;
+        std::mutex run_mutex; // one job at a time
+        std::mutex mutex;
+        std::condition_variable job_available;
+        std::condition_variable job_done;
+        const std::function<void(size_t)>* job;
+        size_t job_tasks;
+        size_t next_task;
+        size_t finished_tasks;
+        size_t busy_workers;
+        size_t generation;
+        bool stopping;
+        std::exception_ptr error;
+};
+
+#endif
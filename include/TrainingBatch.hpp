@@ -2,16 +2,38 @@
 #define TRAINING_BATCH_HPP
 
 #include "Matrix.hpp"
+#include "Dataset.hpp"
+#include <cstdint>
+#include <memory>
 #include <vector>
 
+// A batch is a list of sample indices into a Dataset, the samples themselves are never copied.
+// A default constructed batch owns a private dataset that add_sample(input,desired) copies into,
+// a batch constructed from a shared dataset only references samples of that dataset.
 class TrainingBatch{
     public:
         TrainingBatch();
+        TrainingBatch(std::shared_ptr<const Dataset> dataset);
         void add_sample(const Matrix& input, const Matrix& desired_output);
+        void add_sample(size_t index); // adds sample index of the dataset
+        void clear(); // removes all samples from the batch (not from the dataset)
+        void reserve(size_t n_samples); // room for n_samples indices, clear() keeps it
         std::pair<const Matrix&,const Matrix&> operator[](size_t index) const;
         size_t size() const;
+        const std::vector<size_t>& get_indices() const;
+        const Dataset& get_dataset() const;
+        Matrix get_input_matrix() const; // all inputs stacked as columns (inputs x batch size)
+        Matrix get_desired_matrix() const; // all desired outputs stacked as columns
+        Matrix get_input_matrix(size_t begin, size_t end) const; // inputs of samples [begin,end) stacked as columns
+        Matrix get_desired_matrix(size_t begin, size_t end) const;
+        void get_input_matrix(size_t begin, size_t end, Matrix& result) const; // same, reuses the memory of result
+        void get_desired_matrix(size_t begin, size_t end, Matrix& result) const;
+        // only the input rows given in ascending order, e.g. the non-zero inputs (rows.size() x samples)
+        void get_input_rows(size_t begin, size_t end, const std::vector<uint32_t>& rows, Matrix& result) const;
     private:
-        std::vector<std::pair<Matrix, Matrix>> training_cases;
+        std::shared_ptr<const Dataset> dataset;
+        std::shared_ptr<Dataset> owned_dataset; // same as dataset when the batch owns it, otherwise null
+        std::vector<size_t> indices;
 };      
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,32 @@
+#ifndef TRAINING_WORKSPACE_HPP
+#define TRAINING_WORKSPACE_HPP
+
+#include "Matrix.hpp"
+#include "LayerProfile.hpp"
+#include <cstdint>
+#include <vector>
+
+// All buffers one training thread needs to backpropagate a batch.
+// prepare() shapes them for the network and batch size but only allocates when a buffer
+// has to grow, so once the largest batch has been seen a training step allocates nothing.
+// Every matrix holds one column per sample, except the gradients which are summed over the batch.
+struct TrainingWorkspace{
+    // weight_layers are the weight matrices of the network (layer 0 unused)
+    void prepare(const std::vector<Matrix>& weight_layers, size_t batch_size);
+
+    Matrix inputs;
+    Matrix desired;
+    std::vector<Matrix> activations; // layer 0 is unused, the inputs are read directly
+    Matrix derivative; // activation derivative of the layer being propagated
+    Matrix delta;
+    Matrix next_delta;
+    std::vector<Matrix> bias_gradient;
+    std::vector<Matrix> weight_gradient; // for a sparse first layer only the columns of the active inputs
+    std::vector<uint8_t> input_mask; // inputs that are non-zero in this thread's samples
+    Matrix sparse_inputs; // only the active rows of the inputs, instead of inputs for a sparse first layer
+    std::vector<uint32_t> active_inputs; // train_hogwild's own sparse first layer (process_batch shares the net's)
+    Matrix active_weights;
+    LayerProfile profile; // phases this thread ran, only filled while the network is profiling
+};
+
+#endif
@@ -0,0 +1,406 @@
+#include "Activation.hpp"
+#include "Gemm.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ACTIVATION_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// exp(x) = 2^n * exp(r) with n = round(x / ln2) and |r| <= ln2/2, exp(r) is the cephes expf polynomial.
+// ln2 is split in a part that is exact in float and a correction so n * ln2 adds no rounding error.
+// Outside [EXP_MIN, EXP_MAX] the result is forced to 0 or inf like an underflowing/overflowing expf,
+// so sigmoid saturates to exactly 1 or 0 instead of producing (slow) denormals.
+const float EXP_MIN = -87.3f; // n stays >= -126 so 2^n is a normal float
+const float EXP_MAX = 88.0f; // n stays <= 127
+const float LOG2E = 1.44269504088896341f;
+const float LN2_HI = 0.693359375f;
+const float LN2_LO = -2.12194440e-4f;
+const float EXP_P0 = 1.9875691500e-4f;
+const float EXP_P1 = 1.3981999507e-3f;
+const float EXP_P2 = 8.3334519073e-3f;
+const float EXP_P3 = 4.1665795894e-2f;
+const float EXP_P4 = 1.6666665459e-1f;
+const float EXP_P5 = 5.0000001201e-1f;
+
+// ---------------------------------------------------------------- scalar
+
+void exp_scalar(const float* in, float* out, size_t count)
+{
+    for(size_t i = 0; i < count; i++){
+        out[i] = std::exp(in[i]);
+    }
+}
+
+#ifdef ACTIVATION_X86
+
+// ---------------------------------------------------------------- avx2
+
+__attribute__((target("avx2,fma")))
+inline __m256 exp_avx2(__m256 input)
+{
+    __m256 x = _mm256_min_ps(_mm256_max_ps(input, _mm256_set1_ps(EXP_MIN)), _mm256_set1_ps(EXP_MAX));
+    __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(LN2_HI), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(LN2_LO), r);
+
+    __m256 p = _mm256_set1_ps(EXP_P0);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P1));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P2));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P3));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P4));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(EXP_P5));
+    p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+    __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    __m256 result = _mm256_mul_ps(p, _mm256_castsi256_ps(exponent));
+    result = _mm256_blendv_ps(result, _mm256_set1_ps(INFINITY), _mm256_cmp_ps(input, _mm256_set1_ps(EXP_MAX), _CMP_GT_OQ));
+    return _mm256_blendv_ps(result, _mm256_setzero_ps(), _mm256_cmp_ps(input, _mm256_set1_ps(EXP_MIN), _CMP_LT_OQ));
+}
+
+__attribute__((target("avx2,fma")))
+void exp_avx2(const float* in, float* out, size_t count)
+{
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        _mm256_storeu_ps(out + i, exp_avx2(_mm256_loadu_ps(in + i)));
+    }
+    if(i < count){
+        // tail through a buffer so every element sees the same arithmetic
+        alignas(32) float tail[8] = {};
+        std::copy(in + i, in + count, tail);
+        _mm256_store_ps(tail, exp_avx2(_mm256_load_ps(tail)));
+        std::copy(tail, tail + (count - i), out + i);
+    }
+}
+
+// ---------------------------------------------------------------- avx512
+
+__attribute__((target("avx512f")))
+inline __m512 exp_avx512(__m512 input)
+{
+    __m512 x = _mm512_min_ps(_mm512_max_ps(input, _mm512_set1_ps(EXP_MIN)), _mm512_set1_ps(EXP_MAX));
+    __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(LOG2E)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(LN2_HI), x);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(LN2_LO), r);
+
+    __m512 p = _mm512_set1_ps(EXP_P0);
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P1));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P2));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P3));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P4));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(EXP_P5));
+    p = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+
+    __m512i exponent = _mm512_slli_epi32(_mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127)), 23);
+    __m512 result = _mm512_mul_ps(p, _mm512_castsi512_ps(exponent));
+    result = _mm512_mask_mov_ps(result, _mm512_cmp_ps_mask(input, _mm512_set1_ps(EXP_MAX), _CMP_GT_OQ), _mm512_set1_ps(INFINITY));
+    return _mm512_mask_mov_ps(result, _mm512_cmp_ps_mask(input, _mm512_set1_ps(EXP_MIN), _CMP_LT_OQ), _mm512_setzero_ps());
+}
+
+__attribute__((target("avx512f")))
+void exp_avx512(const float* in, float* out, size_t count)
+{
+    for(size_t i = 0; i < count; i += 16){
+        __mmask16 mask = (count - i >= 16) ? 0xFFFF : static_cast<__mmask16>((1u << (count - i)) - 1);
+        _mm512_mask_storeu_ps(out + i, mask, exp_avx512(_mm512_maskz_loadu_ps(mask, in + i)));
+    }
+}
+
+#endif
+
+// ---------------------------------------------------------------- activations
+//
+// Every activation is a struct with the function for one float, one avx2 and one avx512 vector,
+// and its derivative from the output. The kernels below are templates over them, so the kind is
+// picked once per call (a layer) and the loops themselves have no branches.
+
+struct Sigmoid{
+    static float scalar(float x) { return 1 / (1 + std::exp(x)); }
+    // d/dx 1/(1+exp(x)) = -a(1-a), the function falls
+    static float derivative(float a) { return -(a * (1 - a)); }
+#ifdef ACTIVATION_X86
+    __attribute__((target("avx2,fma")))
+    static __m256 avx2(__m256 x)
+    {
+        __m256 one = _mm256_set1_ps(1.0f);
+        return _mm256_div_ps(one, _mm256_add_ps(one, exp_avx2(x)));
+    }
+    __attribute__((target("avx512f")))
+    static __m512 avx512(__m512 x)
+    {
+        __m512 one = _mm512_set1_ps(1.0f);
+        return _mm512_div_ps(one, _mm512_add_ps(one, exp_avx512(x)));
+    }
+#endif
+};
+
+struct Tanh{
+    static float scalar(float x) { return std::tanh(x); }
+    static float derivative(float a) { return 1 - a * a; }
+#ifdef ACTIVATION_X86
+    // tanh(x) = 1 - 2 / (1 + exp(2x)), exp saturating to inf or 0 gives exactly 1 or -1
+    __attribute__((target("avx2,fma")))
+    static __m256 avx2(__m256 x)
+    {
+        __m256 one = _mm256_set1_ps(1.0f);
+        __m256 e = exp_avx2(_mm256_add_ps(x, x));
+        return _mm256_sub_ps(one, _mm256_div_ps(_mm256_set1_ps(2.0f), _mm256_add_ps(one, e)));
+    }
+    __attribute__((target("avx512f")))
+    static __m512 avx512(__m512 x)
+    {
+        __m512 one = _mm512_set1_ps(1.0f);
+        __m512 e = exp_avx512(_mm512_add_ps(x, x));
+        return _mm512_sub_ps(one, _mm512_div_ps(_mm512_set1_ps(2.0f), _mm512_add_ps(one, e)));
+    }
+#endif
+};
+
+struct Relu{
+    static float scalar(float x) { return std::max(x, 0.0f); }
+    static float derivative(float a) { return a > 0 ? 1.0f : 0.0f; }
+#ifdef ACTIVATION_X86
+    __attribute__((target("avx2,fma")))
+    static __m256 avx2(__m256 x) { return _mm256_max_ps(x, _mm256_setzero_ps()); }
+    __attribute__((target("avx512f")))
+    static __m512 avx512(__m512 x) { return _mm512_max_ps(x, _mm512_setzero_ps()); }
+#endif
+};
+
+// max(x, slope * x) is x for x > 0 and slope * x below, as slope < 1
+struct LeakyRelu{
+    static float scalar(float x) { return std::max(x, LEAKY_RELU_SLOPE * x); }
+    static float derivative(float a) { return a > 0 ? 1.0f : LEAKY_RELU_SLOPE; }
+#ifdef ACTIVATION_X86
+    __attribute__((target("avx2,fma")))
+    static __m256 avx2(__m256 x) { return _mm256_max_ps(x, _mm256_mul_ps(x, _mm256_set1_ps(LEAKY_RELU_SLOPE))); }
+    __attribute__((target("avx512f")))
+    static __m512 avx512(__m512 x) { return _mm512_max_ps(x, _mm512_mul_ps(x, _mm512_set1_ps(LEAKY_RELU_SLOPE))); }
+#endif
+};
+
+struct Identity{
+    static float scalar(float x) { return x; }
+    static float derivative(float) { return 1.0f; }
+#ifdef ACTIVATION_X86
+    __attribute__((target("avx2,fma")))
+    static __m256 avx2(__m256 x) { return x; }
+    __attribute__((target("avx512f")))
+    static __m512 avx512(__m512 x) { return x; }
+#endif
+};
+
+// out = f(in + add + offset), add may be null
+template<typename F>
+void activate_scalar(const float* in, const float* add, float offset, float* out, size_t count)
+{
+    for(size_t i = 0; i < count; i++){
+        out[i] = F::scalar(in[i] + offset + (add ? add[i] : 0.0f));
+    }
+}
+
+template<typename F>
+void derivative_scalar(const float* activation, float* out, size_t count)
+{
+    for(size_t i = 0; i < count; i++){
+        out[i] = F::derivative(activation[i]);
+    }
+}
+
+#ifdef ACTIVATION_X86
+
+template<typename F>
+__attribute__((target("avx2,fma")))
+void activate_avx2(const float* in, const float* add, float offset, float* out, size_t count)
+{
+    __m256 shift = _mm256_set1_ps(offset);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m256 x = _mm256_add_ps(_mm256_loadu_ps(in + i), shift);
+        if(add){
+            x = _mm256_add_ps(x, _mm256_loadu_ps(add + i));
+        }
+        _mm256_storeu_ps(out + i, F::avx2(x));
+    }
+    if(i < count){
+        alignas(32) float tail[8] = {};
+        for(size_t j = i; j < count; j++){
+            tail[j - i] = in[j] + offset + (add ? add[j] : 0.0f);
+        }
+        _mm256_store_ps(tail, F::avx2(_mm256_load_ps(tail)));
+        std::copy(tail, tail + (count - i), out + i);
+    }
+}
+
+// the derivatives are simple enough for the compiler to vectorize, compiled for each instruction set
+template<typename F>
+__attribute__((target("avx2,fma")))
+void derivative_avx2(const float* activation, float* out, size_t count)
+{
+    for(size_t i = 0; i < count; i++){
+        out[i] = F::derivative(activation[i]);
+    }
+}
+
+template<typename F>
+__attribute__((target("avx512f")))
+void activate_avx512(const float* in, const float* add, float offset, float* out, size_t count)
+{
+    __m512 shift = _mm512_set1_ps(offset);
+    for(size_t i = 0; i < count; i += 16){
+        __mmask16 mask = (count - i >= 16) ? 0xFFFF : static_cast<__mmask16>((1u << (count - i)) - 1);
+        __m512 x = _mm512_add_ps(_mm512_maskz_loadu_ps(mask, in + i), shift);
+        if(add){
+            x = _mm512_add_ps(x, _mm512_maskz_loadu_ps(mask, add + i));
+        }
+        _mm512_mask_storeu_ps(out + i, mask, F::avx512(x));
+    }
+}
+
+template<typename F>
+__attribute__((target("avx512f")))
+void derivative_avx512(const float* activation, float* out, size_t count)
+{
+    for(size_t i = 0; i < count; i++){
+        out[i] = F::derivative(activation[i]);
+    }
+}
+
+#endif
+
+typedef void (*ExpKernel)(const float* in, float* out, size_t count);
+typedef void (*ActivationFunction)(const float* in, const float* add, float offset, float* out, size_t count);
+typedef void (*DerivativeFunction)(const float* activation, float* out, size_t count);
+
+ExpKernel exp_for_isa()
+{
+#ifdef ACTIVATION_X86
+    return gemm_isa_select<ExpKernel>(exp_scalar, exp_avx2, exp_avx512);
+#else
+    return exp_scalar;
+#endif
+}
+
+template<typename F>
+ActivationFunction activation_for_isa()
+{
+#ifdef ACTIVATION_X86
+    return gemm_isa_select<ActivationFunction>(activate_scalar<F>, activate_avx2<F>, activate_avx512<F>);
+#else
+    return activate_scalar<F>;
+#endif
+}
+
+template<typename F>
+DerivativeFunction derivative_for_isa()
+{
+#ifdef ACTIVATION_X86
+    return gemm_isa_select<DerivativeFunction>(derivative_scalar<F>, derivative_avx2<F>, derivative_avx512<F>);
+#else
+    return derivative_scalar<F>;
+#endif
+}
+
+ActivationFunction activation_for(ActivationKind kind)
+{
+    switch(kind){
+        case ActivationKind::sigmoid: return activation_for_isa<Sigmoid>();
+        case ActivationKind::tanh: return activation_for_isa<Tanh>();
+        case ActivationKind::relu: return activation_for_isa<Relu>();
+        case ActivationKind::leaky_relu: return activation_for_isa<LeakyRelu>();
+        case ActivationKind::identity: return activation_for_isa<Identity>();
+    }
+    throw std::invalid_argument("unknown activation " + std::to_string(static_cast<uint32_t>(kind)));
+}
+
+DerivativeFunction derivative_for(ActivationKind kind)
+{
+    switch(kind){
+        case ActivationKind::sigmoid: return derivative_for_isa<Sigmoid>();
+        case ActivationKind::tanh: return derivative_for_isa<Tanh>();
+        case ActivationKind::relu: return derivative_for_isa<Relu>();
+        case ActivationKind::leaky_relu: return derivative_for_isa<LeakyRelu>();
+        case ActivationKind::identity: return derivative_for_isa<Identity>();
+    }
+    throw std::invalid_argument("unknown activation " + std::to_string(static_cast<uint32_t>(kind)));
+}
+
+const char* const ACTIVATION_NAMES[] = {"sigmoid", "tanh", "relu", "leaky_relu", "identity"};
+
+}
+
+const char* activation_name(ActivationKind kind)
+{
+    if(!is_known_activation(static_cast<uint32_t>(kind))){
+        throw std::invalid_argument("unknown activation " + std::to_string(static_cast<uint32_t>(kind)));
+    }
+    return ACTIVATION_NAMES[static_cast<uint32_t>(kind)];
+}
+
+ActivationKind activation_from_name(const std::string& name)
+{
+    for(uint32_t kind = 0; is_known_activation(kind); kind++)
+    {
+        if(name == ACTIVATION_NAMES[kind]){
+            return static_cast<ActivationKind>(kind);
+        }
+    }
+    throw std::invalid_argument("unknown activation " + name);
+}
+
+bool is_known_activation(uint32_t kind)
+{
+    return kind <= static_cast<uint32_t>(ActivationKind::identity);
+}
+
+void exp_kernel(const float* in, float* out, size_t count)
+{
+    exp_for_isa()(in, out, count);
+}
+
+void activation_kernel(ActivationKind kind, const float* in, float* out, size_t count)
+{
+    activation_for(kind)(in, nullptr, 0.0f, out, count);
+}
+
+void activation_derivative_kernel(ActivationKind kind, const float* activation, float* out, size_t count)
+{
+    derivative_for(kind)(activation, out, count);
+}
+
+void sigmoid_kernel(const float* in, float* out, size_t count)
+{
+    activation_kernel(ActivationKind::sigmoid, in, out, count);
+}
+
+void sigmoid_derivative_kernel(const float* activation, float* out, size_t count)
+{
+    activation_derivative_kernel(ActivationKind::sigmoid, activation, out, count);
+}
+
+void bias_activation_by_row(ActivationKind kind, float* data, size_t rows, size_t cols, const float* bias)
+{
+    ActivationFunction activate = activation_for(kind);
+    if(cols == 1){
+        // a single column vector, the bias lines up with the data
+        activate(data, bias, 0.0f, data, rows);
+        return;
+    }
+    for(size_t row = 0; row < rows; row++){
+        activate(data + row * cols, nullptr, bias[row], data + row * cols, cols);
+    }
+}
+
+void bias_activation_by_column(ActivationKind kind, float* data, size_t rows, size_t cols, const float* bias)
+{
+    ActivationFunction activate = activation_for(kind);
+    for(size_t row = 0; row < rows; row++){
+        activate(data + row * cols, bias, 0.0f, data + row * cols, cols);
+    }
+}
@@ -0,0 +1,163 @@
+#include "BatchProducer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+BatchProducer::BatchProducer(std::shared_ptr<const Dataset> dataset, size_t batch_size, uint32_t seed,
+                             const std::vector<size_t>& samples, size_t slots)
+:dataset(dataset), batch_size(batch_size), order(samples), position(0), epoch(0), rng(seed), slots(slots),
+ produced(0), released(0), holding(false), stopping(false), failed(false), producer_waiting(false),
+ consumer_waiting(false), consumer_waits(0), wait_seconds(0.0), producer_waits(0), produce_nanoseconds(0)
+{
+    if(!dataset || dataset->size() == 0){
+        throw std::invalid_argument("batch producer needs a dataset with samples");
+    }
+    if(batch_size == 0){
+        throw std::invalid_argument("batch size must be at least 1");
+    }
+    if(slots < 2){
+        throw std::invalid_argument("batch producer needs at least 2 slots");
+    }
+    if(order.empty()){
+        order.resize(dataset->size());
+        for(size_t i = 0; i < order.size(); i++){
+            order[i] = i;
+        }
+    }
+    for(size_t index : order){
+        if(index >= dataset->size()){
+            throw std::out_of_range("sample index out of range");
+        }
+    }
+
+    // every slot at its largest, later batches only reuse the memory
+    size_t input_size = (*dataset)[0].first.get_height();
+    size_t output_size = (*dataset)[0].second.get_height();
+    for(ProducedBatch& slot : this->slots)
+    {
+        slot.epoch = 0;
+        slot.batch = TrainingBatch(dataset);
+        slot.batch.reserve(batch_size);
+        slot.inputs.resize(batch_size,input_size);
+        slot.desired.resize(batch_size,output_size);
+    }
+    std::shuffle(order.begin(),order.end(),rng);
+    producer = std::thread(&BatchProducer::producer_loop,this);
+}
+
+BatchProducer::~BatchProducer()
+{
+    stopping.store(true);
+    wake(producer_waiting,producer_wake);
+    producer.join();
+}
+
+// A side that has to wait sets its waiting flag and then checks the other side's counter again,
+// the other side publishes its counter and then checks the flag. All of these are sequentially
+// consistent, so at least one of them sees the other and no wake up is lost.
+void BatchProducer::wake(std::atomic<bool>& waiting, std::condition_variable& condition)
+{
+    if(waiting.load()){
+        std::lock_guard<std::mutex> lock(wait_mutex);
+        condition.notify_one();
+    }
+}
+
+const ProducedBatch& BatchProducer::next()
+{
+    if(holding){
+        released.store(released.load(std::memory_order_relaxed) + 1);
+        holding = false;
+        wake(producer_waiting,producer_wake);
+    }
+
+    size_t index = released.load(std::memory_order_relaxed);
+    auto ready = [&]{ return produced.load() > index || failed.load(); };
+    if(!ready()){
+        auto start = std::chrono::steady_clock::now();
+        consumer_waits++;
+        std::unique_lock<std::mutex> lock(wait_mutex);
+        consumer_waiting.store(true);
+        consumer_wake.wait(lock,ready);
+        consumer_waiting.store(false);
+        wait_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    if(produced.load() <= index){
+        std::rethrow_exception(error);
+    }
+    holding = true;
+    return slots[index % slots.size()];
+}
+
+void BatchProducer::producer_loop()
+{
+    try
+    {
+        for(size_t n_batch = 0; ; n_batch++)
+        {
+            // batch n_batch - slots.size() has to be released before its slot is reused
+            auto slot_free = [&]{ return stopping.load() || n_batch < released.load() + slots.size(); };
+            if(!slot_free()){
+                producer_waits++;
+                std::unique_lock<std::mutex> lock(wait_mutex);
+                producer_waiting.store(true);
+                producer_wake.wait(lock,slot_free);
+                producer_waiting.store(false);
+            }
+            if(stopping.load()){
+                return;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            fill(slots[n_batch % slots.size()]);
+            produce_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            produced.store(n_batch + 1);
+            wake(consumer_waiting,consumer_wake);
+        }
+    }
+    catch(...)
+    {
+        error = std::current_exception();
+        failed.store(true);
+        wake(consumer_waiting,consumer_wake);
+    }
+}
+
+void BatchProducer::fill(ProducedBatch& slot)
+{
+    if(position == order.size()){
+        std::shuffle(order.begin(),order.end(),rng);
+        position = 0;
+        epoch++;
+    }
+    size_t end = std::min(position + batch_size,order.size());
+    slot.epoch = epoch;
+    slot.batch.clear();
+    for(size_t i = position; i < end; i++){
+        slot.batch.add_sample(order[i]);
+    }
+    position = end;
+    slot.batch.get_input_matrix(0,slot.batch.size(),slot.inputs);
+    slot.batch.get_desired_matrix(0,slot.batch.size(),slot.desired);
+}
+
+size_t BatchProducer::get_batch_size() const
+{
+    return batch_size;
+}
+
+size_t BatchProducer::get_batches_per_epoch() const
+{
+    return (order.size() + batch_size - 1) / batch_size;
+}
+
+BatchProducerStats BatchProducer::get_stats() const
+{
+    BatchProducerStats stats;
+    stats.batches = released.load() + (holding ? 1 : 0);
+    stats.consumer_waits = consumer_waits;
+    stats.producer_waits = producer_waits.load();
+    stats.wait_seconds = wait_seconds;
+    stats.produce_seconds = produce_nanoseconds.load() * 1e-9;
+    return stats;
+}
@@ -0,0 +1,33 @@
+#include "Dataset.hpp"
+#include <stdexcept>
+
+Dataset::Dataset()
+:inputs({}), desired_outputs({})
+{}
+
+size_t Dataset::add_sample(const Matrix& input, const Matrix& desired_output)
+{
+    inputs.push_back(input);
+    desired_outputs.push_back(desired_output);
+    return inputs.size() - 1;
+}
+
+size_t Dataset::add_sample(Matrix&& input, Matrix&& desired_output)
+{
+    inputs.push_back(std::move(input));
+    desired_outputs.push_back(std::move(desired_output));
+    return inputs.size() - 1;
+}
+
+std::pair<const Matrix&,const Matrix&> Dataset::operator[](size_t index) const
+{
+    if(index >= inputs.size()){
+        throw std::out_of_range("sample index out of range");
+    }
+    return {inputs[index],desired_outputs[index]};
+}
+
+size_t Dataset::size() const
+{
+    return inputs.size();
+}
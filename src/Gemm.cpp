@@ -0,0 +1,679 @@
+#include "Gemm.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GEMM_X86 1
+#include <immintrin.h>
+#endif
+
+// Blocking follows the usual Goto/BLIS scheme:
+//  - B is packed in KC x NC blocks (lives in L3/L2) as NR wide column panels
+//  - A is packed in MC x KC blocks (lives in L2) as MR high row panels
+//  - the micro-kernel computes an MR x NR tile of C from one A and one B panel (L1)
+// Matrix-vector products skip the packing entirely and stream the matrix once.
+
+namespace {
+
+const size_t KC = 256;
+const size_t MC = 120;
+const size_t NC = 2048;
+
+// largest micro tile of all kernels, used to size the edge buffer
+const size_t MAX_MR = 6;
+const size_t MAX_NR = 32;
+
+typedef void (*MicroKernel)(size_t kc, const float* a, const float* b, float* c, size_t ldc);
+typedef void (*DotRowsKernel)(size_t rows, size_t len, const float* mat, size_t ld, const float* x, float* out);
+typedef void (*AxpyKernel)(size_t len, float alpha, const float* x, float* y);
+
+struct KernelSet{
+    size_t mr;
+    size_t nr;
+    MicroKernel micro;
+    DotRowsKernel dot_rows;
+    AxpyKernel axpy;
+};
+
+// 64 byte aligned scratch memory, grows on demand and is kept per thread
+class PackBuffer{
+    public:
+        ~PackBuffer()
+        {
+            ::operator delete(ptr, std::align_val_t(64));
+        }
+        float* get(size_t count)
+        {
+            if(count > capacity){
+                ::operator delete(ptr, std::align_val_t(64));
+                ptr = static_cast<float*>(::operator new(count * sizeof(float), std::align_val_t(64)));
+                capacity = count;
+            }
+            return ptr;
+        }
+    private:
+        float* ptr = nullptr;
+        size_t capacity = 0;
+};
+
+thread_local PackBuffer pack_a_buffer;
+thread_local PackBuffer pack_b_buffer;
+thread_local PackBuffer vector_buffer;
+thread_local PackBuffer result_buffer;
+
+// rounds a float count up to a whole number of 64 byte lines
+size_t round_to_line(size_t count)
+{
+    return (count + 15) / 16 * 16;
+}
+
+// scratch for one gemm call, either carved out of a caller provided workspace
+// or taken from the per thread buffers
+class Scratch{
+    public:
+        explicit Scratch(float* workspace)
+        :workspace(workspace)
+        {}
+        float* pack_a(size_t count)
+        {
+            return workspace ? workspace : pack_a_buffer.get(count);
+        }
+        float* pack_b(size_t count, size_t pack_a_count)
+        {
+            return workspace ? workspace + round_to_line(pack_a_count) : pack_b_buffer.get(count);
+        }
+        float* vector(size_t count)
+        {
+            return workspace ? workspace : vector_buffer.get(count);
+        }
+        float* result(size_t count, size_t vector_count)
+        {
+            return workspace ? workspace + round_to_line(vector_count) : result_buffer.get(count);
+        }
+    private:
+        float* workspace;
+};
+
+// ---------------------------------------------------------------- scalar
+
+const size_t SCALAR_MR = 4;
+const size_t SCALAR_NR = 8;
+
+void micro_kernel_scalar(size_t kc, const float* a, const float* b, float* c, size_t ldc)
+{
+    float acc[SCALAR_MR][SCALAR_NR] = {};
+    for(size_t p = 0; p < kc; p++){
+        for(size_t i = 0; i < SCALAR_MR; i++){
+            for(size_t j = 0; j < SCALAR_NR; j++){
+                acc[i][j] += a[i] * b[j];
+            }
+        }
+        a += SCALAR_MR;
+        b += SCALAR_NR;
+    }
+    for(size_t i = 0; i < SCALAR_MR; i++){
+        for(size_t j = 0; j < SCALAR_NR; j++){
+            c[i * ldc + j] += acc[i][j];
+        }
+    }
+}
+
+void dot_rows_scalar(size_t rows, size_t len, const float* mat, size_t ld, const float* x, float* out)
+{
+    for(size_t row = 0; row < rows; row++){
+        const float* r = mat + row * ld;
+        float sum[4] = {0, 0, 0, 0};
+        size_t p = 0;
+        for(; p + 4 <= len; p += 4){
+            sum[0] += r[p] * x[p];
+            sum[1] += r[p + 1] * x[p + 1];
+            sum[2] += r[p + 2] * x[p + 2];
+            sum[3] += r[p + 3] * x[p + 3];
+        }
+        for(; p < len; p++){
+            sum[0] += r[p] * x[p];
+        }
+        out[row] = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    }
+}
+
+void axpy_scalar(size_t len, float alpha, const float* x, float* y)
+{
+    for(size_t i = 0; i < len; i++){
+        y[i] += alpha * x[i];
+    }
+}
+
+const KernelSet scalar_kernels = {SCALAR_MR, SCALAR_NR, micro_kernel_scalar, dot_rows_scalar, axpy_scalar};
+
+#ifdef GEMM_X86
+
+// ---------------------------------------------------------------- avx2
+
+const size_t AVX2_MR = 6;
+const size_t AVX2_NR = 16;
+
+__attribute__((target("avx2,fma")))
+void micro_kernel_avx2(size_t kc, const float* a, const float* b, float* c, size_t ldc)
+{
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+    for(size_t p = 0; p < kc; p++){
+        __m256 b0 = _mm256_load_ps(b);
+        __m256 b1 = _mm256_load_ps(b + 8);
+        __m256 ai;
+        ai = _mm256_broadcast_ss(a + 0); c00 = _mm256_fmadd_ps(ai, b0, c00); c01 = _mm256_fmadd_ps(ai, b1, c01);
+        ai = _mm256_broadcast_ss(a + 1); c10 = _mm256_fmadd_ps(ai, b0, c10); c11 = _mm256_fmadd_ps(ai, b1, c11);
+        ai = _mm256_broadcast_ss(a + 2); c20 = _mm256_fmadd_ps(ai, b0, c20); c21 = _mm256_fmadd_ps(ai, b1, c21);
+        ai = _mm256_broadcast_ss(a + 3); c30 = _mm256_fmadd_ps(ai, b0, c30); c31 = _mm256_fmadd_ps(ai, b1, c31);
+        ai = _mm256_broadcast_ss(a + 4); c40 = _mm256_fmadd_ps(ai, b0, c40); c41 = _mm256_fmadd_ps(ai, b1, c41);
+        ai = _mm256_broadcast_ss(a + 5); c50 = _mm256_fmadd_ps(ai, b0, c50); c51 = _mm256_fmadd_ps(ai, b1, c51);
+        a += AVX2_MR;
+        b += AVX2_NR;
+    }
+
+    float* r;
+    r = c + 0 * ldc; _mm256_storeu_ps(r, _mm256_add_ps(_mm256_loadu_ps(r), c00)); _mm256_storeu_ps(r + 8, _mm256_add_ps(_mm256_loadu_ps(r + 8), c01));
+    r = c + 1 * ldc; _mm256_storeu_ps(r, _mm256_add_ps(_mm256_loadu_ps(r), c10)); _mm256_storeu_ps(r + 8, _mm256_add_ps(_mm256_loadu_ps(r + 8), c11));
+    r = c + 2 * ldc; _mm256_storeu_ps(r, _mm256_add_ps(_mm256_loadu_ps(r), c20)); _mm256_storeu_ps(r + 8, _mm256_add_ps(_mm256_loadu_ps(r + 8), c21));
+    r = c + 3 * ldc; _mm256_storeu_ps(r, _mm256_add_ps(_mm256_loadu_ps(r), c30)); _mm256_storeu_ps(r + 8, _mm256_add_ps(_mm256_loadu_ps(r + 8), c31));
+    r = c + 4 * ldc; _mm256_storeu_ps(r, _mm256_add_ps(_mm256_loadu_ps(r), c40)); _mm256_storeu_ps(r + 8, _mm256_add_ps(_mm256_loadu_ps(r + 8), c41));
+    r = c + 5 * ldc; _mm256_storeu_ps(r, _mm256_add_ps(_mm256_loadu_ps(r), c50)); _mm256_storeu_ps(r + 8, _mm256_add_ps(_mm256_loadu_ps(r + 8), c51));
+}
+
+__attribute__((target("avx2,fma")))
+inline float hsum_avx2(__m256 v)
+{
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+    return _mm_cvtss_f32(lo);
+}
+
+__attribute__((target("avx2,fma")))
+void dot_rows_avx2(size_t rows, size_t len, const float* mat, size_t ld, const float* x, float* out)
+{
+    size_t row = 0;
+    // four rows at a time so every load of x is used four times
+    for(; row + 4 <= rows; row += 4){
+        const float* r0 = mat + (row + 0) * ld;
+        const float* r1 = mat + (row + 1) * ld;
+        const float* r2 = mat + (row + 2) * ld;
+        const float* r3 = mat + (row + 3) * ld;
+        __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+        __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+        size_t p = 0;
+        for(; p + 8 <= len; p += 8){
+            __m256 xv = _mm256_loadu_ps(x + p);
+            s0 = _mm256_fmadd_ps(_mm256_loadu_ps(r0 + p), xv, s0);
+            s1 = _mm256_fmadd_ps(_mm256_loadu_ps(r1 + p), xv, s1);
+            s2 = _mm256_fmadd_ps(_mm256_loadu_ps(r2 + p), xv, s2);
+            s3 = _mm256_fmadd_ps(_mm256_loadu_ps(r3 + p), xv, s3);
+        }
+        float t0 = hsum_avx2(s0), t1 = hsum_avx2(s1), t2 = hsum_avx2(s2), t3 = hsum_avx2(s3);
+        for(; p < len; p++){
+            t0 += r0[p] * x[p];
+            t1 += r1[p] * x[p];
+            t2 += r2[p] * x[p];
+            t3 += r3[p] * x[p];
+        }
+        out[row + 0] = t0;
+        out[row + 1] = t1;
+        out[row + 2] = t2;
+        out[row + 3] = t3;
+    }
+    for(; row < rows; row++){
+        const float* r = mat + row * ld;
+        __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+        size_t p = 0;
+        for(; p + 16 <= len; p += 16){
+            s0 = _mm256_fmadd_ps(_mm256_loadu_ps(r + p), _mm256_loadu_ps(x + p), s0);
+            s1 = _mm256_fmadd_ps(_mm256_loadu_ps(r + p + 8), _mm256_loadu_ps(x + p + 8), s1);
+        }
+        for(; p + 8 <= len; p += 8){
+            s0 = _mm256_fmadd_ps(_mm256_loadu_ps(r + p), _mm256_loadu_ps(x + p), s0);
+        }
+        float t = hsum_avx2(_mm256_add_ps(s0, s1));
+        for(; p < len; p++){
+            t += r[p] * x[p];
+        }
+        out[row] = t;
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void axpy_avx2(size_t len, float alpha, const float* x, float* y)
+{
+    __m256 av = _mm256_set1_ps(alpha);
+    size_t i = 0;
+    for(; i + 8 <= len; i += 8){
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(av, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+    }
+    for(; i < len; i++){
+        y[i] += alpha * x[i];
+    }
+}
+
+const KernelSet avx2_kernels = {AVX2_MR, AVX2_NR, micro_kernel_avx2, dot_rows_avx2, axpy_avx2};
+
+// ---------------------------------------------------------------- avx512
+
+const size_t AVX512_MR = 6;
+const size_t AVX512_NR = 32;
+
+__attribute__((target("avx512f")))
+void micro_kernel_avx512(size_t kc, const float* a, const float* b, float* c, size_t ldc)
+{
+    __m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps();
+    __m512 c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+    __m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps();
+    __m512 c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+    __m512 c40 = _mm512_setzero_ps(), c41 = _mm512_setzero_ps();
+    __m512 c50 = _mm512_setzero_ps(), c51 = _mm512_setzero_ps();
+
+    for(size_t p = 0; p < kc; p++){
+        __m512 b0 = _mm512_load_ps(b);
+        __m512 b1 = _mm512_load_ps(b + 16);
+        __m512 ai;
+        ai = _mm512_set1_ps(a[0]); c00 = _mm512_fmadd_ps(ai, b0, c00); c01 = _mm512_fmadd_ps(ai, b1, c01);
+        ai = _mm512_set1_ps(a[1]); c10 = _mm512_fmadd_ps(ai, b0, c10); c11 = _mm512_fmadd_ps(ai, b1, c11);
+        ai = _mm512_set1_ps(a[2]); c20 = _mm512_fmadd_ps(ai, b0, c20); c21 = _mm512_fmadd_ps(ai, b1, c21);
+        ai = _mm512_set1_ps(a[3]); c30 = _mm512_fmadd_ps(ai, b0, c30); c31 = _mm512_fmadd_ps(ai, b1, c31);
+        ai = _mm512_set1_ps(a[4]); c40 = _mm512_fmadd_ps(ai, b0, c40); c41 = _mm512_fmadd_ps(ai, b1, c41);
+        ai = _mm512_set1_ps(a[5]); c50 = _mm512_fmadd_ps(ai, b0, c50); c51 = _mm512_fmadd_ps(ai, b1, c51);
+        a += AVX512_MR;
+        b += AVX512_NR;
+    }
+
+    float* r;
+    r = c + 0 * ldc; _mm512_storeu_ps(r, _mm512_add_ps(_mm512_loadu_ps(r), c00)); _mm512_storeu_ps(r + 16, _mm512_add_ps(_mm512_loadu_ps(r + 16), c01));
+    r = c + 1 * ldc; _mm512_storeu_ps(r, _mm512_add_ps(_mm512_loadu_ps(r), c10)); _mm512_storeu_ps(r + 16, _mm512_add_ps(_mm512_loadu_ps(r + 16), c11));
+    r = c + 2 * ldc; _mm512_storeu_ps(r, _mm512_add_ps(_mm512_loadu_ps(r), c20)); _mm512_storeu_ps(r + 16, _mm512_add_ps(_mm512_loadu_ps(r + 16), c21));
+    r = c + 3 * ldc; _mm512_storeu_ps(r, _mm512_add_ps(_mm512_loadu_ps(r), c30)); _mm512_storeu_ps(r + 16, _mm512_add_ps(_mm512_loadu_ps(r + 16), c31));
+    r = c + 4 * ldc; _mm512_storeu_ps(r, _mm512_add_ps(_mm512_loadu_ps(r), c40)); _mm512_storeu_ps(r + 16, _mm512_add_ps(_mm512_loadu_ps(r + 16), c41));
+    r = c + 5 * ldc; _mm512_storeu_ps(r, _mm512_add_ps(_mm512_loadu_ps(r), c50)); _mm512_storeu_ps(r + 16, _mm512_add_ps(_mm512_loadu_ps(r + 16), c51));
+}
+
+__attribute__((target("avx512f")))
+void dot_rows_avx512(size_t rows, size_t len, const float* mat, size_t ld, const float* x, float* out)
+{
+    size_t row = 0;
+    for(; row + 4 <= rows; row += 4){
+        const float* r0 = mat + (row + 0) * ld;
+        const float* r1 = mat + (row + 1) * ld;
+        const float* r2 = mat + (row + 2) * ld;
+        const float* r3 = mat + (row + 3) * ld;
+        __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+        __m512 s2 = _mm512_setzero_ps(), s3 = _mm512_setzero_ps();
+        size_t p = 0;
+        for(; p + 16 <= len; p += 16){
+            __m512 xv = _mm512_loadu_ps(x + p);
+            s0 = _mm512_fmadd_ps(_mm512_loadu_ps(r0 + p), xv, s0);
+            s1 = _mm512_fmadd_ps(_mm512_loadu_ps(r1 + p), xv, s1);
+            s2 = _mm512_fmadd_ps(_mm512_loadu_ps(r2 + p), xv, s2);
+            s3 = _mm512_fmadd_ps(_mm512_loadu_ps(r3 + p), xv, s3);
+        }
+        if(p < len){
+            __mmask16 mask = (__mmask16)((1u << (len - p)) - 1);
+            __m512 xv = _mm512_maskz_loadu_ps(mask, x + p);
+            s0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, r0 + p), xv, s0);
+            s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, r1 + p), xv, s1);
+            s2 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, r2 + p), xv, s2);
+            s3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, r3 + p), xv, s3);
+        }
+        out[row + 0] = _mm512_reduce_add_ps(s0);
+        out[row + 1] = _mm512_reduce_add_ps(s1);
+        out[row + 2] = _mm512_reduce_add_ps(s2);
+        out[row + 3] = _mm512_reduce_add_ps(s3);
+    }
+    for(; row < rows; row++){
+        const float* r = mat + row * ld;
+        __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+        size_t p = 0;
+        for(; p + 32 <= len; p += 32){
+            s0 = _mm512_fmadd_ps(_mm512_loadu_ps(r + p), _mm512_loadu_ps(x + p), s0);
+            s1 = _mm512_fmadd_ps(_mm512_loadu_ps(r + p + 16), _mm512_loadu_ps(x + p + 16), s1);
+        }
+        for(; p + 16 <= len; p += 16){
+            s0 = _mm512_fmadd_ps(_mm512_loadu_ps(r + p), _mm512_loadu_ps(x + p), s0);
+        }
+        if(p < len){
+            __mmask16 mask = (__mmask16)((1u << (len - p)) - 1);
+            s1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, r + p), _mm512_maskz_loadu_ps(mask, x + p), s1);
+        }
+        out[row] = _mm512_reduce_add_ps(_mm512_add_ps(s0, s1));
+    }
+}
+
+__attribute__((target("avx512f")))
+void axpy_avx512(size_t len, float alpha, const float* x, float* y)
+{
+    __m512 av = _mm512_set1_ps(alpha);
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16){
+        _mm512_storeu_ps(y + i, _mm512_fmadd_ps(av, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+    }
+    if(i < len){
+        __mmask16 mask = (__mmask16)((1u << (len - i)) - 1);
+        __m512 yv = _mm512_maskz_loadu_ps(mask, y + i);
+        _mm512_mask_storeu_ps(y + i, mask, _mm512_fmadd_ps(av, _mm512_maskz_loadu_ps(mask, x + i), yv));
+    }
+}
+
+const KernelSet avx512_kernels = {AVX512_MR, AVX512_NR, micro_kernel_avx512, dot_rows_avx512, axpy_avx512};
+
+#endif
+
+// ---------------------------------------------------------------- dispatch
+
+GemmIsa best_supported_isa()
+{
+#ifdef GEMM_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")){
+        return GemmIsa::avx512;
+    }
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+        return GemmIsa::avx2;
+    }
+#endif
+    return GemmIsa::scalar;
+}
+
+const KernelSet& kernels_for(GemmIsa isa)
+{
+#ifdef GEMM_X86
+    if(isa == GemmIsa::avx512){
+        return avx512_kernels;
+    }
+    if(isa == GemmIsa::avx2){
+        return avx2_kernels;
+    }
+#endif
+    return scalar_kernels;
+}
+
+GemmIsa supported_isa = best_supported_isa();
+GemmIsa active_isa = supported_isa;
+const KernelSet* active_kernels = &kernels_for(active_isa);
+
+// ---------------------------------------------------------------- driver
+
+// C = beta * C
+void scale_c(size_t m, size_t n, float beta, float* c, size_t ldc)
+{
+    if(beta == 1.0f){
+        return;
+    }
+    for(size_t i = 0; i < m; i++){
+        float* row = c + i * ldc;
+        if(beta == 0.0f){
+            std::fill(row, row + n, 0.0f);
+        }else{
+            for(size_t j = 0; j < n; j++){
+                row[j] *= beta;
+            }
+        }
+    }
+}
+
+// packs the mc x kc block of alpha * op(A) starting at (ic,pc) into panels of mr rows,
+// each panel is stored column by column so the micro-kernel reads it sequentially
+void pack_a(Transpose trans, const float* a, size_t lda, size_t ic, size_t pc, size_t mc, size_t kc,
+            float alpha, size_t mr, float* packed)
+{
+    for(size_t ir = 0; ir < mc; ir += mr){
+        size_t rows = std::min(mr, mc - ir);
+        for(size_t p = 0; p < kc; p++){
+            size_t i = 0;
+            if(trans == Transpose::no){
+                const float* src = a + (ic + ir) * lda + (pc + p);
+                for(; i < rows; i++){
+                    packed[i] = alpha * src[i * lda];
+                }
+            }else{
+                const float* src = a + (pc + p) * lda + (ic + ir);
+                for(; i < rows; i++){
+                    packed[i] = alpha * src[i];
+                }
+            }
+            for(; i < mr; i++){
+                packed[i] = 0.0f;
+            }
+            packed += mr;
+        }
+    }
+}
+
+// packs the kc x nc block of op(B) starting at (pc,jc) into panels of nr columns,
+// each panel is stored row by row
+void pack_b(Transpose trans, const float* b, size_t ldb, size_t pc, size_t jc, size_t kc, size_t nc,
+            size_t nr, float* packed)
+{
+    for(size_t jr = 0; jr < nc; jr += nr){
+        size_t cols = std::min(nr, nc - jr);
+        for(size_t p = 0; p < kc; p++){
+            size_t j = 0;
+            if(trans == Transpose::no){
+                const float* src = b + (pc + p) * ldb + (jc + jr);
+                std::memcpy(packed, src, cols * sizeof(float));
+                j = cols;
+            }else{
+                const float* src = b + (jc + jr) * ldb + (pc + p);
+                for(; j < cols; j++){
+                    packed[j] = src[j * ldb];
+                }
+            }
+            for(; j < nr; j++){
+                packed[j] = 0.0f;
+            }
+            packed += nr;
+        }
+    }
+}
+
+void gemm_blocked(const KernelSet& ks, Transpose trans_a, Transpose trans_b,
+                  size_t m, size_t n, size_t k,
+                  float alpha, const float* a, size_t lda,
+                  const float* b, size_t ldb,
+                  float* c, size_t ldc, Scratch& scratch)
+{
+    const size_t mr = ks.mr;
+    const size_t nr = ks.nr;
+    const size_t mc_max = (MC / mr) * mr;
+
+    float* packed_a = scratch.pack_a(mc_max * KC);
+    float* packed_b = scratch.pack_b(KC * ((std::min(n, NC) + nr - 1) / nr) * nr, MC * KC);
+    alignas(64) float edge[MAX_MR * MAX_NR];
+
+    for(size_t jc = 0; jc < n; jc += NC){
+        size_t nc = std::min(NC, n - jc);
+        for(size_t pc = 0; pc < k; pc += KC){
+            size_t kc = std::min(KC, k - pc);
+            pack_b(trans_b, b, ldb, pc, jc, kc, nc, nr, packed_b);
+
+            for(size_t ic = 0; ic < m; ic += mc_max){
+                size_t mc = std::min(mc_max, m - ic);
+                pack_a(trans_a, a, lda, ic, pc, mc, kc, alpha, mr, packed_a);
+
+                for(size_t jr = 0; jr < nc; jr += nr){
+                    size_t cols = std::min(nr, nc - jr);
+                    const float* pb = packed_b + jr * kc;
+                    for(size_t ir = 0; ir < mc; ir += mr){
+                        size_t rows = std::min(mr, mc - ir);
+                        const float* pa = packed_a + ir * kc;
+                        float* tile = c + (ic + ir) * ldc + (jc + jr);
+                        if(rows == mr && cols == nr){
+                            ks.micro(kc, pa, pb, tile, ldc);
+                        }else{
+                            // partial tile at the matrix edge, compute into a buffer first
+                            std::fill(edge, edge + mr * nr, 0.0f);
+                            ks.micro(kc, pa, pb, edge, nr);
+                            for(size_t i = 0; i < rows; i++){
+                                for(size_t j = 0; j < cols; j++){
+                                    tile[i * ldc + j] += edge[i * nr + j];
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// y = alpha * M * x + beta * y, M is rows x len row-major, x contiguous, y with stride incy
+void gemv_n(const KernelSet& ks, size_t rows, size_t len, float alpha, const float* mat, size_t ld,
+            const float* x, float beta, float* y, size_t incy)
+{
+    const size_t chunk = 64;
+    float out[chunk];
+    for(size_t row = 0; row < rows; row += chunk){
+        size_t count = std::min(chunk, rows - row);
+        ks.dot_rows(count, len, mat + row * ld, ld, x, out);
+        for(size_t i = 0; i < count; i++){
+            float* dst = y + (row + i) * incy;
+            *dst = (beta == 0.0f) ? alpha * out[i] : alpha * out[i] + beta * *dst;
+        }
+    }
+}
+
+// y = alpha * M^T * x + beta * y, M is len x cols row-major, x with stride incx, y contiguous
+void gemv_t(const KernelSet& ks, size_t len, size_t cols, float alpha, const float* mat, size_t ld,
+            const float* x, size_t incx, float beta, float* y)
+{
+    scale_c(1, cols, beta, y, cols);
+    // no shortcut for x[p] == 0, NaN and Inf in the matrix still reach y as they do in gemm
+    for(size_t p = 0; p < len; p++){
+        ks.axpy(cols, alpha * x[p * incx], mat + p * ld, y);
+    }
+}
+
+// copies a strided vector into contiguous scratch
+const float* contiguous(const float* x, size_t len, size_t inc, Scratch& scratch)
+{
+    if(inc == 1){
+        return x;
+    }
+    float* buf = scratch.vector(len);
+    for(size_t i = 0; i < len; i++){
+        buf[i] = x[i * inc];
+    }
+    return buf;
+}
+
+void gemm_dispatch(Transpose trans_a, Transpose trans_b,
+                   size_t m, size_t n, size_t k,
+                   float alpha, const float* a, size_t lda,
+                   const float* b, size_t ldb,
+                   float beta, float* c, size_t ldc, Scratch scratch)
+{
+    if(m == 0 || n == 0){
+        return;
+    }
+    if(k == 0 || alpha == 0.0f){
+        scale_c(m, n, beta, c, ldc);
+        return;
+    }
+
+    const KernelSet& ks = *active_kernels;
+
+    // matrix-vector products: no packing, stream the matrix exactly once
+    if(n == 1){
+        // b is a column, element p at b[p * ldb] (or b[p] when transposed)
+        const float* x = (trans_b == Transpose::no) ? contiguous(b, k, ldb, scratch) : b;
+        if(trans_a == Transpose::no){
+            gemv_n(ks, m, k, alpha, a, lda, x, beta, c, ldc);
+        }else{
+            if(ldc == 1){
+                gemv_t(ks, k, m, alpha, a, lda, x, 1, beta, c);
+            }else{
+                float* y = scratch.result(m, k);
+                for(size_t i = 0; i < m; i++){
+                    y[i] = c[i * ldc];
+                }
+                gemv_t(ks, k, m, alpha, a, lda, x, 1, beta, y);
+                for(size_t i = 0; i < m; i++){
+                    c[i * ldc] = y[i];
+                }
+            }
+        }
+        return;
+    }
+    if(m == 1){
+        // a is a row, element p at a[p] (or a[p * lda] when transposed)
+        if(trans_b == Transpose::yes){
+            const float* x = (trans_a == Transpose::no) ? a : contiguous(a, k, lda, scratch);
+            gemv_n(ks, n, k, alpha, b, ldb, x, beta, c, 1);
+        }else{
+            gemv_t(ks, k, n, alpha, b, ldb, a, (trans_a == Transpose::no) ? 1 : lda, beta, c);
+        }
+        return;
+    }
+
+    scale_c(m, n, beta, c, ldc);
+    gemm_blocked(ks, trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, c, ldc, scratch);
+}
+
+}
+
+void gemm(Transpose trans_a, Transpose trans_b,
+          size_t m, size_t n, size_t k,
+          float alpha, const float* a, size_t lda,
+          const float* b, size_t ldb,
+          float beta, float* c, size_t ldc)
+{
+    gemm_dispatch(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc, Scratch(nullptr));
+}
+
+void gemm(Transpose trans_a, Transpose trans_b,
+          size_t m, size_t n, size_t k,
+          float alpha, const float* a, size_t lda,
+          const float* b, size_t ldb,
+          float beta, float* c, size_t ldc, float* workspace)
+{
+    gemm_dispatch(trans_a, trans_b, m, n, k, alpha, a, lda, b, ldb, beta, c, ldc, Scratch(workspace));
+}
+
+size_t gemm_workspace_size(size_t m, size_t n, size_t k)
+{
+    // matrix-vector paths: a gathered vector plus a gathered result
+    size_t size = round_to_line(k) + round_to_line(m);
+    if(m > 1 && n > 1){
+        // blocked path: a packed block of A followed by a packed panel of B
+        size_t panel = KC * ((std::min(n, NC) + MAX_NR - 1) / MAX_NR) * MAX_NR;
+        size = std::max(size, round_to_line(MC * KC) + panel);
+    }
+    return size;
+}
+
+GemmIsa gemm_get_isa()
+{
+    return active_isa;
+}
+
+void gemm_set_isa(GemmIsa isa)
+{
+    if(static_cast<int>(isa) > static_cast<int>(supported_isa)){
+        isa = supported_isa;
+    }
+    active_isa = isa;
+    active_kernels = &kernels_for(isa);
+}
+
+const char* gemm_isa_name(GemmIsa isa)
+{
+    switch(isa){
+        case GemmIsa::avx512: return "avx512";
+        case GemmIsa::avx2: return "avx2";
+        default: return "scalar";
+    }
+}
@@ -0,0 +1,304 @@
+#include "HalfFloat.hpp"
+#include "Gemm.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HALF_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+uint32_t float_bits(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+float bits_float(uint32_t bits)
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+uint16_t to_float16(float value)
+{
+    uint32_t bits = float_bits(value);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+    if(magnitude >= 0x7F800000){
+        // inf stays inf, nan stays (quiet) nan
+        return sign | (magnitude > 0x7F800000 ? 0x7E00 : 0x7C00);
+    }
+    if(magnitude >= 0x477FF000){
+        // rounds to 65520 or more
+        return sign | 0x7C00;
+    }
+    if(magnitude < 0x38800000){
+        // subnormal half, adding 0.5 lines the mantissa up so the fpu does the rounding
+        uint32_t rounded = float_bits(bits_float(magnitude) + 0.5f);
+        return sign | (rounded - 0x3F000000);
+    }
+    // rebias the exponent (127 -> 15) and round the mantissa to nearest even
+    uint32_t odd = (magnitude >> 13) & 1;
+    magnitude += 0xC8000FFF + odd;
+    return sign | (magnitude >> 13);
+}
+
+float from_float16(uint16_t half)
+{
+    uint32_t sign = uint32_t(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+    if(exponent == 0){
+        float value = mantissa * (1.0f / 16777216.0f); // subnormal, mantissa * 2^-24
+        return sign ? -value : value;
+    }
+    if(exponent == 31){
+        return bits_float(sign | 0x7F800000 | (mantissa << 13));
+    }
+    return bits_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+uint16_t to_bfloat16(float value)
+{
+    uint32_t bits = float_bits(value);
+    if((bits & 0x7FFFFFFF) > 0x7F800000){
+        return (bits >> 16) | 0x40; // keep nan a (quiet) nan
+    }
+    bits += 0x7FFF + ((bits >> 16) & 1);
+    return bits >> 16;
+}
+
+float from_bfloat16(uint16_t half)
+{
+    return bits_float(uint32_t(half) << 16);
+}
+
+template<HalfFormat F>
+float from_half(uint16_t half)
+{
+    return (F == HalfFormat::float16) ? from_float16(half) : from_bfloat16(half);
+}
+
+// A block kernel computes the dot products of 4 rows of B with S rows of A over the full
+// length k, out[row * S + sample]. Every converted B vector is used for all S samples.
+const size_t BLOCK_ROWS = 4;
+typedef void (*BlockKernel)(size_t k, const float* const* a, const uint16_t* const* b, float* out);
+
+// adds the elements from begin to k that the vector loop didn't cover
+template<size_t S, HalfFormat F>
+void add_tail(size_t begin, size_t k, const float* const* a, const uint16_t* const* b, float* out)
+{
+    for(size_t r = 0; r < BLOCK_ROWS; r++){
+        for(size_t s = 0; s < S; s++){
+            float sum = 0.0f;
+            for(size_t p = begin; p < k; p++){
+                sum += a[s][p] * from_half<F>(b[r][p]);
+            }
+            out[r * S + s] += sum;
+        }
+    }
+}
+
+// ---------------------------------------------------------------- scalar
+
+template<size_t S, HalfFormat F>
+void block_scalar(size_t k, const float* const* a, const uint16_t* const* b, float* out)
+{
+    std::fill(out, out + BLOCK_ROWS * S, 0.0f);
+    add_tail<S, F>(0, k, a, b, out);
+}
+
+#ifdef HALF_X86
+
+// ---------------------------------------------------------------- avx2 + f16c
+
+template<HalfFormat F>
+__attribute__((target("avx2,fma,f16c")))
+inline __m256 load_half_avx2(const uint16_t* p)
+{
+    __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    if constexpr(F == HalfFormat::float16){
+        return _mm256_cvtph_ps(raw);
+    }else{
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(raw), 16));
+    }
+}
+
+template<size_t S, HalfFormat F>
+__attribute__((target("avx2,fma,f16c")))
+void block_avx2(size_t k, const float* const* a, const uint16_t* const* b, float* out)
+{
+    __m256 acc[BLOCK_ROWS][S];
+    for(size_t r = 0; r < BLOCK_ROWS; r++){
+        for(size_t s = 0; s < S; s++){
+            acc[r][s] = _mm256_setzero_ps();
+        }
+    }
+    size_t p = 0;
+    for(; p + 8 <= k; p += 8){
+        __m256 values[S];
+        for(size_t s = 0; s < S; s++){
+            values[s] = _mm256_loadu_ps(a[s] + p);
+        }
+        for(size_t r = 0; r < BLOCK_ROWS; r++){
+            __m256 weights = load_half_avx2<F>(b[r] + p);
+            for(size_t s = 0; s < S; s++){
+                acc[r][s] = _mm256_fmadd_ps(weights, values[s], acc[r][s]);
+            }
+        }
+    }
+    for(size_t r = 0; r < BLOCK_ROWS; r++){
+        for(size_t s = 0; s < S; s++){
+            __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc[r][s]), _mm256_extractf128_ps(acc[r][s], 1));
+            sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+            sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+            out[r * S + s] = _mm_cvtss_f32(sum);
+        }
+    }
+    add_tail<S, F>(p, k, a, b, out);
+}
+
+// ---------------------------------------------------------------- avx512
+
+template<HalfFormat F>
+__attribute__((target("avx512f")))
+inline __m512 load_half_avx512(const uint16_t* p)
+{
+    __m256i raw = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    if constexpr(F == HalfFormat::float16){
+        return _mm512_cvtph_ps(raw);
+    }else{
+        return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(raw), 16));
+    }
+}
+
+template<size_t S, HalfFormat F>
+__attribute__((target("avx512f")))
+void block_avx512(size_t k, const float* const* a, const uint16_t* const* b, float* out)
+{
+    __m512 acc[BLOCK_ROWS][S];
+    for(size_t r = 0; r < BLOCK_ROWS; r++){
+        for(size_t s = 0; s < S; s++){
+            acc[r][s] = _mm512_setzero_ps();
+        }
+    }
+    size_t p = 0;
+    for(; p + 16 <= k; p += 16){
+        __m512 values[S];
+        for(size_t s = 0; s < S; s++){
+            values[s] = _mm512_loadu_ps(a[s] + p);
+        }
+        for(size_t r = 0; r < BLOCK_ROWS; r++){
+            __m512 weights = load_half_avx512<F>(b[r] + p);
+            for(size_t s = 0; s < S; s++){
+                acc[r][s] = _mm512_fmadd_ps(weights, values[s], acc[r][s]);
+            }
+        }
+    }
+    for(size_t r = 0; r < BLOCK_ROWS; r++){
+        for(size_t s = 0; s < S; s++){
+            out[r * S + s] = _mm512_reduce_add_ps(acc[r][s]);
+        }
+    }
+    add_tail<S, F>(p, k, a, b, out);
+}
+
+#endif
+
+// kernels for 4 samples and for a single sample, per format
+struct HalfKernels{
+    BlockKernel four[2];
+    BlockKernel one[2];
+};
+
+const HalfKernels scalar_kernels = {
+    {block_scalar<4, HalfFormat::float16>, block_scalar<4, HalfFormat::bfloat16>},
+    {block_scalar<1, HalfFormat::float16>, block_scalar<1, HalfFormat::bfloat16>}};
+
+#ifdef HALF_X86
+
+const HalfKernels avx2_kernels = {
+    {block_avx2<4, HalfFormat::float16>, block_avx2<4, HalfFormat::bfloat16>},
+    {block_avx2<1, HalfFormat::float16>, block_avx2<1, HalfFormat::bfloat16>}};
+
+const HalfKernels avx512_kernels = {
+    {block_avx512<4, HalfFormat::float16>, block_avx512<4, HalfFormat::bfloat16>},
+    {block_avx512<1, HalfFormat::float16>, block_avx512<1, HalfFormat::bfloat16>}};
+
+bool cpu_has_f16c()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("f16c");
+}
+
+const bool has_f16c = cpu_has_f16c();
+
+#endif
+
+const HalfKernels& active_kernels()
+{
+#ifdef HALF_X86
+    return *gemm_isa_select(&scalar_kernels, has_f16c ? &avx2_kernels : &scalar_kernels, &avx512_kernels);
+#else
+    return scalar_kernels;
+#endif
+}
+
+}
+
+void float_to_half(const float* in, uint16_t* out, size_t count, HalfFormat format)
+{
+    for(size_t i = 0; i < count; i++){
+        out[i] = (format == HalfFormat::float16) ? to_float16(in[i]) : to_bfloat16(in[i]);
+    }
+}
+
+void half_to_float(const uint16_t* in, float* out, size_t count, HalfFormat format)
+{
+    for(size_t i = 0; i < count; i++){
+        out[i] = (format == HalfFormat::float16) ? from_float16(in[i]) : from_bfloat16(in[i]);
+    }
+}
+
+void gemm_half_nt(size_t m, size_t n, size_t k,
+                  const float* a, size_t lda,
+                  const uint16_t* b, size_t ldb, HalfFormat format,
+                  float* c, size_t ldc)
+{
+    const HalfKernels& kernels = active_kernels();
+    size_t f = (format == HalfFormat::float16) ? 0 : 1;
+    float out[BLOCK_ROWS * 4];
+
+    // samples on the outside, so with a few samples the weights are streamed exactly once
+    for(size_t i = 0; i < m; )
+    {
+        size_t samples = (m - i >= 4) ? 4 : 1;
+        const float* a_rows[4];
+        for(size_t s = 0; s < samples; s++){
+            a_rows[s] = a + (i + s) * lda;
+        }
+        BlockKernel kernel = (samples == 4) ? kernels.four[f] : kernels.one[f];
+
+        for(size_t j = 0; j < n; j += BLOCK_ROWS)
+        {
+            // rows past the end of B repeat the last row, their results are dropped
+            size_t rows = std::min(BLOCK_ROWS, n - j);
+            const uint16_t* b_rows[BLOCK_ROWS];
+            for(size_t r = 0; r < BLOCK_ROWS; r++){
+                b_rows[r] = b + (j + std::min(r, rows - 1)) * ldb;
+            }
+            kernel(k, a_rows, b_rows, out);
+            for(size_t r = 0; r < rows; r++){
+                for(size_t s = 0; s < samples; s++){
+                    c[(i + s) * ldc + j + r] = out[r * samples + s];
+                }
+            }
+        }
+        i += samples;
+    }
+}
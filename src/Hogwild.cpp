@@ -0,0 +1,96 @@
+#include "Hogwild.hpp"
+#include "InferencePlan.hpp"
+#include "ModelComparison.hpp"
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+// mean squared output error and accuracy of the network on the samples
+static void evaluate(const NeuralNet& net, const TrainingBatch& samples, float& cost, float& accuracy)
+{
+    InferencePlan plan(net);
+    std::vector<float> inputs = pack_inputs(samples, plan.get_input_size());
+    std::vector<float> outputs(samples.size() * plan.get_output_size());
+    plan.predict_batch(inputs.data(), samples.size(), outputs.data());
+    OutputScore score = score_outputs(outputs.data(), plan.get_output_size(), samples);
+    cost = score.cost;
+    accuracy = score.accuracy;
+}
+
+HogwildReport compare_hogwild(const NeuralNet& net, float learning_rate, const std::vector<TrainingBatch>& batches,
+                              const TrainingBatch& test, size_t epochs, const std::vector<size_t>& thread_counts,
+                              size_t samples_per_update)
+{
+    if(samples_per_update == 0){
+        throw std::invalid_argument("samples per update must be at least 1");
+    }
+    typedef std::chrono::steady_clock clock;
+    HogwildReport report = {};
+    report.samples_per_update = samples_per_update;
+    for(const TrainingBatch& batch : batches){
+        report.samples += batch.size() * epochs;
+    }
+    evaluate(net, test, report.initial_cost, report.initial_accuracy);
+
+    for(size_t threads : thread_counts)
+    {
+        HogwildRun run = {};
+        run.threads = threads;
+
+        NeuralNet sync = net;
+        sync.set_optimizer(OptimizerSettings());
+        sync.set_thread_count(threads);
+        auto start = clock::now();
+        for(size_t epoch = 0; epoch < epochs; epoch++){
+            for(const TrainingBatch& batch : batches){
+                sync.process_batch(learning_rate, batch);
+            }
+        }
+        double sync_seconds = std::chrono::duration<double>(clock::now() - start).count();
+        evaluate(sync, test, run.sync_cost, run.sync_accuracy);
+
+        NeuralNet hogwild = net;
+        hogwild.set_thread_count(threads);
+        start = clock::now();
+        for(size_t epoch = 0; epoch < epochs; epoch++){
+            for(const TrainingBatch& batch : batches){
+                hogwild.train_hogwild(learning_rate, batch, samples_per_update);
+            }
+        }
+        double hogwild_seconds = std::chrono::duration<double>(clock::now() - start).count();
+        evaluate(hogwild, test, run.hogwild_cost, run.hogwild_accuracy);
+
+        if(sync_seconds > 0){
+            run.sync_samples_per_second = report.samples / sync_seconds;
+        }
+        if(hogwild_seconds > 0){
+            run.hogwild_samples_per_second = report.samples / hogwild_seconds;
+        }
+        report.runs.push_back(run);
+    }
+    return report;
+}
+
+std::string HogwildReport::str() const
+{
+    std::stringstream out;
+    out << "samples per run: " << samples << ", hogwild samples per update: " << samples_per_update << "\n";
+    out << "before training, cost: " << initial_cost << " accuracy: " << initial_accuracy * 100 << "%\n";
+    out << std::setw(8) << "threads"
+        << std::setw(14) << "sync/s" << std::setw(14) << "hogwild/s"
+        << std::setw(12) << "sync cost" << std::setw(14) << "hogwild cost"
+        << std::setw(10) << "sync %" << std::setw(12) << "hogwild %" << "\n";
+    for(const HogwildRun& run : runs)
+    {
+        out << std::setw(8) << run.threads
+            << std::setw(14) << std::fixed << std::setprecision(0) << run.sync_samples_per_second
+            << std::setw(14) << run.hogwild_samples_per_second
+            << std::setw(12) << std::setprecision(5) << run.sync_cost
+            << std::setw(14) << run.hogwild_cost
+            << std::setw(10) << std::setprecision(1) << run.sync_accuracy * 100
+            << std::setw(12) << run.hogwild_accuracy * 100 << "\n";
+        out.unsetf(std::ios::floatfield);
+    }
+    return out.str();
+}
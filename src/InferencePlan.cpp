@@ -0,0 +1,150 @@
+#include "InferencePlan.hpp"
+#include "Gemm.hpp"
+#include "Activation.hpp"
+#include "HalfFloat.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+static const size_t WORKSPACE_ALIGNMENT = 64;
+
+InferencePlan::InferencePlan(const NeuralNet& net, size_t max_batch, ModelDataType weight_type)
+    : weight_type(weight_type)
+{
+    std::shared_ptr<std::vector<std::vector<uint16_t>>> converted;
+    if(weight_type != ModelDataType::float32){
+        converted = std::make_shared<std::vector<std::vector<uint16_t>>>(net.get_layer_count());
+    }
+    for(size_t n_layer = 0; n_layer < net.get_layer_count(); n_layer++)
+    {
+        const MatrixStorage& layer_weights = net.get_layer_weights(n_layer).get_data();
+        topology.push_back(net.get_layer_neurons(n_layer).get_height());
+        biases.push_back(net.get_layer_bias(n_layer).get_data().data());
+        activations.push_back(net.get_layer_activation(n_layer));
+        if(!converted){
+            weights.push_back(layer_weights.data());
+            continue;
+        }
+        std::vector<uint16_t>& halves = (*converted)[n_layer];
+        halves.resize(layer_weights.size());
+        float_to_half(layer_weights.data(),halves.data(),halves.size(),model_data_type_half_format(weight_type));
+        weights.push_back(halves.data());
+    }
+    half_weights = converted;
+    build(max_batch);
+}
+
+InferencePlan::InferencePlan(const MappedModel& model, size_t max_batch)
+    : weight_type(model.get_data_type())
+{
+    for(size_t n_layer = 0; n_layer < model.get_layer_count(); n_layer++)
+    {
+        topology.push_back(model.get_layer_size(n_layer));
+        weights.push_back(model.get_layer_weight_data(n_layer));
+        biases.push_back(model.get_layer_bias(n_layer));
+        activations.push_back(model.get_layer_activation(n_layer));
+    }
+    build(max_batch);
+}
+
+void InferencePlan::build(size_t max_batch)
+{
+    if(topology.size() < 2){
+        throw std::invalid_argument("inference plan needs at least an input and an output layer");
+    }
+    if(max_batch == 0){
+        throw std::invalid_argument("inference plan max batch size must be at least 1");
+    }
+    this->max_batch = max_batch;
+
+    // the input and output layers live in the caller's buffers, only hidden layers need storage
+    size_t widest_hidden = 0;
+    size_t workspace_size = 0;
+    for(size_t n_layer = 1; n_layer < topology.size(); n_layer++)
+    {
+        if(n_layer + 1 < topology.size()){
+            widest_hidden = std::max(widest_hidden, topology[n_layer]);
+        }
+        workspace_size = std::max(workspace_size, gemm_workspace_size(max_batch, topology[n_layer], topology[n_layer-1]));
+    }
+    buffers[0].assign(max_batch * widest_hidden, 0.0f);
+    buffers[1].assign(max_batch * widest_hidden, 0.0f);
+    workspace_storage.assign(workspace_size + WORKSPACE_ALIGNMENT / sizeof(float), 0.0f);
+}
+
+float* InferencePlan::get_workspace()
+{
+    // the storage is a plain vector so plans stay copyable, align the start here
+    uintptr_t address = reinterpret_cast<uintptr_t>(workspace_storage.data());
+    uintptr_t aligned = (address + WORKSPACE_ALIGNMENT - 1) / WORKSPACE_ALIGNMENT * WORKSPACE_ALIGNMENT;
+    return reinterpret_cast<float*>(aligned);
+}
+
+void InferencePlan::predict_batch(const float* inputs, size_t n, float* outputs)
+{
+    for(size_t begin = 0; begin < n; begin += max_batch)
+    {
+        size_t count = std::min(max_batch, n - begin);
+        run_chunk(inputs + begin * topology.front(), count, outputs + begin * topology.back());
+    }
+}
+
+void InferencePlan::run_chunk(const float* inputs, size_t n, float* outputs)
+{
+    float* workspace = get_workspace();
+    const float* current = inputs;
+    for(size_t n_layer = 1; n_layer < topology.size(); n_layer++)
+    {
+        size_t in_size = topology[n_layer-1];
+        size_t out_size = topology[n_layer];
+        bool last = (n_layer + 1 == topology.size());
+        float* next = last ? outputs : buffers[n_layer % 2].data();
+
+        // samples are rows here, so the layer is next = current * W^T + bias
+        if(weight_type == ModelDataType::float32){
+            gemm(Transpose::no, Transpose::yes,
+                 n, out_size, in_size,
+                 1.0f, current, in_size,
+                 static_cast<const float*>(weights[n_layer]), in_size,
+                 0.0f, next, out_size, workspace);
+        }else{
+            gemm_half_nt(n, out_size, in_size,
+                         current, in_size,
+                         static_cast<const uint16_t*>(weights[n_layer]), in_size,
+                         model_data_type_half_format(weight_type),
+                         next, out_size);
+        }
+        bias_activation_by_column(activations[n_layer], next, n, out_size, biases[n_layer]);
+        current = next;
+    }
+}
+
+size_t InferencePlan::get_input_size() const
+{
+    return topology.front();
+}
+
+size_t InferencePlan::get_output_size() const
+{
+    return topology.back();
+}
+
+size_t InferencePlan::get_max_batch() const
+{
+    return max_batch;
+}
+
+ModelDataType InferencePlan::get_weight_type() const
+{
+    return weight_type;
+}
+
+size_t InferencePlan::get_weight_bytes() const
+{
+    size_t count = 0;
+    for(size_t n_layer = 1; n_layer < topology.size(); n_layer++)
+    {
+        count += topology[n_layer] * topology[n_layer-1];
+    }
+    return count * model_data_type_size(weight_type);
+}
@@ -0,0 +1,119 @@
+#include "IngestPipeline.hpp"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+IngestPipeline::IngestPipeline(const std::vector<std::string>& paths, Decoder decoder, size_t n_threads, size_t queue_capacity)
+:paths(paths), decoder(decoder), slots(std::max<size_t>(queue_capacity,1)), next_index(0), delivered(0), bytes_read(0),
+ stopping(false), start(std::chrono::steady_clock::now()), finish(start)
+{
+    n_threads = std::max<size_t>(n_threads,1);
+    for(size_t n = 0; n < n_threads; n++)
+    {
+        workers.emplace_back(&IngestPipeline::worker_loop,this);
+    }
+}
+
+IngestPipeline::~IngestPipeline()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    slot_free.notify_all();
+    for(auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void IngestPipeline::worker_loop()
+{
+    std::vector<uint8_t> bytes;
+    while(true)
+    {
+        size_t index;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if(stopping || next_index >= paths.size()){
+                return;
+            }
+            index = next_index++;
+            // don't run further ahead of the consumer than there are slots
+            slot_free.wait(lock,[&]{ return stopping || index < delivered + slots.size(); });
+            if(stopping){
+                return;
+            }
+        }
+
+        Matrix sample;
+        std::exception_ptr error;
+        try
+        {
+            std::ifstream in(paths[index],std::ios_base::binary | std::ios_base::ate);
+            if(!in){
+                throw std::runtime_error("unable to open " + paths[index]);
+            }
+            bytes.resize(static_cast<size_t>(in.tellg()));
+            in.seekg(0);
+            in.read(reinterpret_cast<char*>(bytes.data()),bytes.size());
+            if(!in){
+                throw std::runtime_error("unable to read " + paths[index]);
+            }
+            sample = decoder(bytes);
+        }
+        catch(...)
+        {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Slot& slot = slots[index % slots.size()];
+            slot.sample = std::move(sample);
+            slot.error = error;
+            slot.ready = true;
+            if(!error){
+                bytes_read += bytes.size();
+            }
+        }
+        slot_ready.notify_all();
+    }
+}
+
+bool IngestPipeline::next(Matrix& sample)
+{
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if(delivered >= paths.size()){
+            return false;
+        }
+        Slot& slot = slots[delivered % slots.size()];
+        slot_ready.wait(lock,[&]{ return slot.ready; });
+        sample = std::move(slot.sample);
+        error = slot.error;
+        slot.error = nullptr;
+        slot.ready = false;
+        delivered++;
+        if(delivered == paths.size()){
+            finish = std::chrono::steady_clock::now();
+        }
+    }
+    slot_free.notify_all();
+    if(error){
+        std::rethrow_exception(error);
+    }
+    return true;
+}
+
+IngestStats IngestPipeline::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto end = (delivered == paths.size()) ? finish : std::chrono::steady_clock::now();
+    IngestStats stats;
+    stats.files = delivered;
+    stats.bytes = bytes_read;
+    stats.seconds = std::chrono::duration<double>(end - start).count();
+    return stats;
+}
@@ -0,0 +1,146 @@
+#include "LayerProfile.hpp"
+#include <sstream>
+#include <stdexcept>
+
+const char* profile_phase_name(ProfilePhase phase)
+{
+    switch(phase){
+        case ProfilePhase::forward_gemm: return "forward_gemm";
+        case ProfilePhase::bias_activation: return "bias_activation";
+        case ProfilePhase::backward_delta: return "backward_delta";
+        case ProfilePhase::weight_gradient: return "weight_gradient";
+        case ProfilePhase::gradient_reduce: return "gradient_reduce";
+        case ProfilePhase::update: return "update";
+        default: throw std::invalid_argument("unknown profile phase");
+    }
+}
+
+PhaseCounters& LayerProfile::counters_of(size_t n_layer, ProfilePhase phase)
+{
+    if(n_layer >= layers.size()){
+        layers.resize(n_layer + 1,std::array<PhaseCounters,PHASE_COUNT>{});
+    }
+    return layers[n_layer][static_cast<size_t>(phase)];
+}
+
+void LayerProfile::add(size_t n_layer, ProfilePhase phase, uint64_t nanoseconds, double flops, double bytes)
+{
+    PhaseCounters& counters = counters_of(n_layer,phase);
+    counters.calls++;
+    counters.nanoseconds += nanoseconds;
+    counters.flops += flops;
+    counters.bytes += bytes;
+}
+
+void LayerProfile::merge(const LayerProfile& other)
+{
+    for(size_t n_layer = 0; n_layer < other.layers.size(); n_layer++)
+    {
+        for(size_t n_phase = 0; n_phase < PHASE_COUNT; n_phase++)
+        {
+            const PhaseCounters& counters = other.layers[n_layer][n_phase];
+            if(counters.calls == 0){
+                continue;
+            }
+            PhaseCounters& target = counters_of(n_layer,static_cast<ProfilePhase>(n_phase));
+            target.calls += counters.calls;
+            target.nanoseconds += counters.nanoseconds;
+            target.flops += counters.flops;
+            target.bytes += counters.bytes;
+        }
+    }
+}
+
+void LayerProfile::clear()
+{
+    layers.clear();
+}
+
+size_t LayerProfile::get_layer_count() const
+{
+    return layers.size();
+}
+
+PhaseCounters LayerProfile::get(size_t n_layer, ProfilePhase phase) const
+{
+    if(n_layer >= layers.size()){
+        return PhaseCounters{};
+    }
+    return layers[n_layer][static_cast<size_t>(phase)];
+}
+
+PhaseCounters LayerProfile::total(ProfilePhase phase) const
+{
+    PhaseCounters sum = {};
+    for(size_t n_layer = 0; n_layer < layers.size(); n_layer++)
+    {
+        const PhaseCounters& counters = layers[n_layer][static_cast<size_t>(phase)];
+        sum.calls += counters.calls;
+        sum.nanoseconds += counters.nanoseconds;
+        sum.flops += counters.flops;
+        sum.bytes += counters.bytes;
+    }
+    return sum;
+}
+
+// GFLOP/s and bytes/s of a set of counters, 0 when nothing was timed
+static double gflops(const PhaseCounters& counters)
+{
+    return counters.nanoseconds ? counters.flops / counters.nanoseconds : 0.0;
+}
+
+static double bytes_per_second(const PhaseCounters& counters)
+{
+    return counters.nanoseconds ? counters.bytes / (counters.nanoseconds * 1e-9) : 0.0;
+}
+
+std::string LayerProfile::to_json() const
+{
+    std::ostringstream out;
+    out.precision(10);
+    out << "{\"layers\": [";
+    bool first = true;
+    for(size_t n_layer = 0; n_layer < layers.size(); n_layer++)
+    {
+        for(size_t n_phase = 0; n_phase < PHASE_COUNT; n_phase++)
+        {
+            const PhaseCounters& counters = layers[n_layer][n_phase];
+            if(counters.calls == 0){
+                continue;
+            }
+            out << (first ? "\n" : ",\n") << "  {\"layer\": " << n_layer
+                << ", \"phase\": \"" << profile_phase_name(static_cast<ProfilePhase>(n_phase)) << "\""
+                << ", \"calls\": " << counters.calls
+                << ", \"seconds\": " << counters.nanoseconds * 1e-9
+                << ", \"flops\": " << counters.flops
+                << ", \"bytes\": " << counters.bytes
+                << ", \"gflops\": " << gflops(counters)
+                << ", \"bytes_per_second\": " << bytes_per_second(counters) << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    return out.str();
+}
+
+std::string LayerProfile::to_csv() const
+{
+    std::ostringstream out;
+    out.precision(10);
+    out << "layer,phase,calls,seconds,flops,bytes,gflops,bytes_per_second\n";
+    for(size_t n_layer = 0; n_layer < layers.size(); n_layer++)
+    {
+        for(size_t n_phase = 0; n_phase < PHASE_COUNT; n_phase++)
+        {
+            const PhaseCounters& counters = layers[n_layer][n_phase];
+            if(counters.calls == 0){
+                continue;
+            }
+            out << n_layer << "," << profile_phase_name(static_cast<ProfilePhase>(n_phase)) << ","
+                << counters.calls << "," << counters.nanoseconds * 1e-9 << ","
+                << counters.flops << "," << counters.bytes << ","
+                << gflops(counters) << "," << bytes_per_second(counters) << "\n";
+        }
+    }
+    return out.str();
+}
@@ -0,0 +1,117 @@
+#include "MappedFile.hpp"
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path)
+:path(path), mapping(nullptr), length(0)
+{
+    int fd = open(path.c_str(),O_RDONLY);
+    if(fd < 0){
+        throw std::runtime_error("unable to open " + path);
+    }
+    struct stat info;
+    if(fstat(fd,&info) != 0){
+        close(fd);
+        throw std::runtime_error("unable to stat " + path);
+    }
+    length = static_cast<size_t>(info.st_size);
+    if(length > 0){
+        void* ptr = mmap(nullptr,length,PROT_READ,MAP_PRIVATE,fd,0);
+        if(ptr == MAP_FAILED){
+            close(fd);
+            throw std::runtime_error("unable to map " + path);
+        }
+        mapping = static_cast<const uint8_t*>(ptr);
+    }
+    // the mapping stays valid after closing the descriptor
+    close(fd);
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+:path(std::move(other.path)), mapping(other.mapping), length(other.length)
+{
+    other.mapping = nullptr;
+    other.length = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if(&other != this){
+        unmap();
+        path = std::move(other.path);
+        mapping = other.mapping;
+        length = other.length;
+        other.mapping = nullptr;
+        other.length = 0;
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+void MappedFile::unmap()
+{
+    if(mapping != nullptr){
+        munmap(const_cast<uint8_t*>(mapping),length);
+        mapping = nullptr;
+        length = 0;
+    }
+}
+
+const uint8_t* MappedFile::data() const
+{
+    return mapping;
+}
+
+size_t MappedFile::size() const
+{
+    return length;
+}
+
+const std::string& MappedFile::get_path() const
+{
+    return path;
+}
+
+uint32_t crc32(const void* data, size_t size, uint32_t previous)
+{
+    static uint32_t table[256];
+    static bool table_ready = [](){
+        for(uint32_t n = 0; n < 256; n++){
+            uint32_t c = n;
+            for(int k = 0; k < 8; k++){
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        return true;
+    }();
+    (void)table_ready;
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint32_t crc = previous ^ 0xFFFFFFFFu;
+    for(size_t i = 0; i < size; i++){
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+bool block_in_range(uint64_t offset, uint64_t bytes, uint64_t size)
+{
+    return offset <= size && bytes <= size - offset;
+}
+
+bool checked_multiply(uint64_t a, uint64_t b, uint64_t& result)
+{
+    if(a != 0 && b > UINT64_MAX / a){
+        return false;
+    }
+    result = a * b;
+    return true;
+}
@@ -1,194 +1,290 @@
 #include "Matrix.hpp"
+#include "Gemm.hpp"
 
 Matrix::Matrix()
-:width(0), height(0), data({})
+:width(0), height(0), stride(0), padding(RowPadding::none), data({})
 {}
 
 Matrix::Matrix(const std::vector<float>& data)
-:width(data.size()), height(1), data(data)
+:width(data.size()), height(1), stride(width), padding(RowPadding::none), data(data.begin(),data.end())
 {}
 
 Matrix::Matrix(const std::vector<float>& data, size_t width, size_t height)
-:width(width), height(height), data(data)
+:width(width), height(height), stride(width), padding(RowPadding::none), data(data.begin(),data.end())
 {}
 
 Matrix::Matrix(size_t width, size_t height)
-:width(width), height(height), data({})
+:width(width), height(height), stride(width), padding(RowPadding::none), data(width * height, 0.0f)
+{}
+
+Matrix::Matrix(size_t width, size_t height, RowPadding padding)
+:width(width), height(height), stride(padded_stride(width,padding)), padding(padding), data(stride * height, 0.0f)
+{}
+
+Matrix::Matrix(const Matrix& mat)
+:width(mat.width), height(mat.height), stride(mat.stride), padding(mat.padding), data(mat.data)
+{}
+
+Matrix::Matrix(Matrix&& mat) noexcept
+:width(mat.width), height(mat.height), stride(mat.stride), padding(mat.padding), data(std::move(mat.data))
 {
-    for(size_t i = 0; i < width * height; i++){
-        data.push_back(0);
-    }
+    mat.width = 0;
+    mat.height = 0;
+    mat.stride = 0;
 }
 
-Matrix::Matrix(const Matrix& mat)
-:width(mat.width), height(mat.height), data({})
+Matrix::Matrix(ConstMatrixView view)
+:width(0), height(0), stride(0), padding(RowPadding::none)
 {
-    // std::cout << "vector max: " << data.max_size() << " vs requested: " << mat.width * mat.height << std::endl;
+    *this = view;
+}
 
-    data.reserve(mat.width*mat.height);
+Matrix::~Matrix()
+{}
 
-    for(size_t i = 0; i < mat.data.size(); i++)
-    {
-        // std::cout << "at element: " << i << std::endl;
-        data.push_back(mat.data.at(i));
+size_t Matrix::padded_stride(size_t width, RowPadding padding)
+{
+    const size_t floats_per_line = 64 / sizeof(float);
+    if(padding == RowPadding::none){
+        return width;
     }
+    return (width + floats_per_line - 1) / floats_per_line * floats_per_line;
 }
 
-Matrix::~Matrix()
-{}
+void Matrix::operator*=(float factor)
+{
+    for(auto& value : data){
+        value *= factor;
+    }
+}
 
-Matrix Matrix::operator+(const Matrix& mat) const
+Matrix& Matrix::operator=(const Matrix& mat)
 {
-    if(mat.width != width || mat.height != height){
-        std::cout << "A:" << str() << std::endl;
-        std::cout << "B:" << mat.str() << std::endl;
-        throw std::invalid_argument("matrices must have same dimensions to be added");
+    if(&mat != this){
+        width = mat.width;
+        height = mat.height;
+        stride = mat.stride;
+        padding = mat.padding;
+        data = mat.data;
     }
-    std::vector<float> result;
-    result.reserve(width*height);
-    for(size_t i = 0; i < data.size(); i++){
-        result.push_back(data.at(i) + mat.data.at(i));
+    return *this;
+}
+
+Matrix& Matrix::operator=(Matrix&& mat) noexcept
+{
+    if(&mat != this){
+        width = mat.width;
+        height = mat.height;
+        stride = mat.stride;
+        padding = mat.padding;
+        data = std::move(mat.data);
+        mat.width = 0;
+        mat.height = 0;
+        mat.stride = 0;
     }
-    Matrix new_mat(result,width,height);
-    return new_mat;
+    return *this;
 }
 
-Matrix Matrix::operator-(const Matrix& mat) const
+Matrix& Matrix::operator=(ConstMatrixView view)
 {
-    if(mat.width != width || mat.height != height){
-        std::cout << "A:" << str() << std::endl;
-        std::cout << "B:" << mat.str() << std::endl;
-        throw std::invalid_argument("matrices must have same dimensions to be subtracted");
+    // a view into this matrix must be read before the storage changes,
+    // the copy is made with this matrix's padding so it survives the move
+    if(view.get_data() >= data.data() && view.get_data() < data.data() + data.size()){
+        Matrix copy(view.get_width(),view.get_height(),padding);
+        copy.view().assign(view);
+        return *this = std::move(copy);
     }
-    std::vector<float> result;
-    result.reserve(width*height);
-    for(size_t i = 0; i < data.size(); i++){
-        result.push_back(data.at(i) - mat.data.at(i));
+    resize(view.get_width(),view.get_height());
+    for(size_t y = 0; y < height; y++){
+        const float* row = view.get_data() + y * view.get_stride();
+        std::copy(row,row + width,data.data() + y * stride);
     }
-    Matrix new_mat(result,width,height);
-    return new_mat;
+    return *this;
 }
 
-Matrix Matrix::operator-(float value) const{
-    std::vector<float> result;
-    result.reserve(data.size());
-    for(size_t i = 0; i < data.size(); i++){
-        result.push_back(data.at(i) - value);
+void Matrix::check_same_shape(size_t other_width, size_t other_height, const std::string& other_shape, const char* verb) const
+{
+    if(other_width != width || other_height != height){
+        std::cout << "A shape:" << shape_str() << std::endl;
+        std::cout << "B shape:" << other_shape << std::endl;
+        throw std::invalid_argument(std::string("matrices must have same dimensions to be ") + verb);
     }
-    Matrix new_mat(result,width,height);
-    return new_mat;
 }
 
-Matrix Matrix::operator*(const Matrix& mat) const
+
+Matrix Matrix::dot(ConstMatrixView mat) const
 {
-    if(mat.width != width || mat.height != height){
+    if(width != mat.get_height()){
         std::cout << "A shape:" << shape_str() << std::endl;
         std::cout << "B shape:" << mat.shape_str() << std::endl;
-        throw std::invalid_argument("matrices must have same dimensions to be multiplied (non dot product)");
-    }
-    std::vector<float> result;
-    result.reserve(width*height);
-    for(size_t i = 0; i < data.size(); i++){
-        result.push_back(data.at(i) * mat.data.at(i));
+        throw std::invalid_argument("the width of matrix A must be equal to the height of matrix B to calculate the dot product.\n A width = " + std::to_string(width) + ", B height = " + std::to_string(mat.get_height()));
     }
-    Matrix new_mat(result,width,height);
+
+    Matrix new_mat(mat.get_width(),height);
+    dot(mat,new_mat);
     return new_mat;
 }
 
-Matrix Matrix::operator*(float factor) const{
-    std::vector<float> result;
-    result.reserve(data.size());
-    for(size_t i = 0; i < data.size(); i++){
-        result.push_back(data.at(i) * factor);
-    }
-    Matrix new_mat(result,width,height);
-    return new_mat;
+void Matrix::dot(ConstMatrixView mat, Matrix& result) const
+{
+    check_product_operands(mat,result,width,mat.get_height(),"width of matrix A","height of matrix B");
+    result.resize(mat.get_width(),height);
+    gemm(Transpose::no, Transpose::no,
+         height, mat.get_width(), width,
+         1.0f, data.data(), stride,
+         mat.get_data(), mat.get_stride(),
+         0.0f, result.data.data(), result.stride);
 }
 
-Matrix Matrix::operator/(float factor) const{
-    std::vector<float> result;
-    result.reserve(data.size());
-    for(size_t i = 0; i < data.size(); i++){
-        result.push_back(data.at(i) / factor);
-    }
-    Matrix new_mat(result,width,height);
+Matrix Matrix::dot_tn(ConstMatrixView mat) const
+{
+    Matrix new_mat(mat.get_width(),width);
+    dot_tn(mat,new_mat);
     return new_mat;
 }
 
-void Matrix::operator+=(const Matrix& mat)
+void Matrix::dot_tn(ConstMatrixView mat, Matrix& result) const
 {
-    *this = *this + mat;
+    check_product_operands(mat,result,height,mat.get_height(),"height of matrix A","height of matrix B");
+    result.resize(mat.get_width(),width);
+    gemm(Transpose::yes, Transpose::no,
+         width, mat.get_width(), height,
+         1.0f, data.data(), stride,
+         mat.get_data(), mat.get_stride(),
+         0.0f, result.data.data(), result.stride);
 }
 
-void Matrix::operator-=(const Matrix& mat)
+Matrix Matrix::dot_nt(ConstMatrixView mat) const
 {
-    *this = *this - mat;
+    Matrix new_mat(mat.get_height(),height);
+    dot_nt(mat,new_mat);
+    return new_mat;
 }
 
-void Matrix::operator*=(const Matrix& mat)
+void Matrix::dot_nt(ConstMatrixView mat, Matrix& result) const
 {
-    *this = *this * mat;
+    check_product_operands(mat,result,width,mat.get_width(),"width of matrix A","width of matrix B");
+    result.resize(mat.get_height(),height);
+    gemm(Transpose::no, Transpose::yes,
+         height, mat.get_height(), width,
+         1.0f, data.data(), stride,
+         mat.get_data(), mat.get_stride(),
+         0.0f, result.data.data(), result.stride);
 }
 
-void Matrix::operator*=(float factor)
+void Matrix::add_outer_product(ConstMatrixView a, ConstMatrixView b, float factor)
 {
-    *this = *this * factor;
+    if(a.get_width() != 1 || b.get_width() != 1 || a.get_height() != height || b.get_height() != width){
+        std::cout << "A shape:" << a.shape_str() << std::endl;
+        std::cout << "B shape:" << b.shape_str() << std::endl;
+        throw std::invalid_argument("outer product needs column vectors with the height and width of the matrix, got result shape " + shape_str());
+    }
+    // a rank 1 product accumulated in place (k = 1, beta = 1)
+    gemm(Transpose::no, Transpose::yes,
+         height, width, 1,
+         factor, a.get_data(), a.get_stride(),
+         b.get_data(), b.get_stride(),
+         1.0f, data.data(), stride);
 }
 
-Matrix& Matrix::operator=(const Matrix& mat)
+// whether any element of view lies in the storage of a matrix
+static bool overlaps(ConstMatrixView view, const MatrixStorage& storage)
 {
-    if(&mat != this){
-        width = mat.width;
-        height = mat.height;
-        data = mat.data;
+    if(view.get_width() == 0 || view.get_height() == 0 || storage.capacity() == 0){
+        return false;
     }
-    return *this;
+    const float* view_end = view.get_data() + (view.get_height() - 1) * view.get_stride() + view.get_width();
+    return view.get_data() < storage.data() + storage.capacity() && view_end > storage.data();
 }
 
-
-Matrix Matrix::dot(const Matrix& mat) const
+void Matrix::check_product_operands(ConstMatrixView mat, const Matrix& result, size_t inner_a, size_t inner_b,
+                                    const char* inner_a_name, const char* inner_b_name) const
 {
-    if(width != mat.height){
+    if(inner_a != inner_b){
         std::cout << "A shape:" << shape_str() << std::endl;
         std::cout << "B shape:" << mat.shape_str() << std::endl;
-        throw std::invalid_argument("the width of matrix A must be equal to the height of matrix B to calculate the dot product.\n A width = " + std::to_string(width) + ", B height = " + std::to_string(mat.height));
+        throw std::invalid_argument(std::string("the ") + inner_a_name + " must be equal to the " + inner_b_name + " to calculate the dot product.\n A = " + std::to_string(inner_a) + ", B = " + std::to_string(inner_b));
     }
-
-    std::vector<float> result;
-    result.reserve(mat.width*height);
-
-    for(size_t row_n = 0; row_n < height; row_n++){
-        for(size_t col_n = 0; col_n < mat.width; col_n++){
-            float sub_total = 0;
-            for(size_t index = 0; index < width; index++){
-                sub_total += get_value(index,row_n) * mat.get_value(col_n,index);
-            }
-            result.push_back(sub_total);
-        }
+    if(&result == this || overlaps(mat,result.data)){
+        throw std::invalid_argument("the result of a dot product cannot be one of its operands");
     }
-    Matrix new_mat(result,mat.width,height);
-    return new_mat;
 }
 
 float Matrix::sum()
 {
     float result = 0;
-    for(float value : data)
-    {
-        result += value;
+    for(size_t y = 0; y < height; y++){
+        const float* row = data.data() + y * stride;
+        for(size_t x = 0; x < width; x++){
+            result += row[x];
+        }
     }
     return result;
 }
 
+Matrix Matrix::row_sums() const
+{
+    Matrix result(1,height);
+    row_sums(result);
+    return result;
+}
+
+void Matrix::row_sums(Matrix& result) const
+{
+    result.resize(1,height);
+    for(size_t y = 0; y < height; y++){
+        const float* row = data.data() + y * stride;
+        float total = 0;
+        for(size_t x = 0; x < width; x++){
+            total += row[x];
+        }
+        result.data[y * result.stride] = total;
+    }
+}
+
+void Matrix::add_column_vector(ConstMatrixView vec)
+{
+    if(vec.get_width() != 1 || vec.get_height() != height){
+        std::cout << "A shape:" << shape_str() << std::endl;
+        std::cout << "B shape:" << vec.shape_str() << std::endl;
+        throw std::invalid_argument("column vector must have width 1 and the same height as the matrix to be added to its columns");
+    }
+    for(size_t y = 0; y < height; y++){
+        float* row = data.data() + y * stride;
+        float value = vec.get_data()[y * vec.get_stride()];
+        for(size_t x = 0; x < width; x++){
+            row[x] += value;
+        }
+    }
+}
+
 Matrix Matrix::transpose()
 {
     Matrix t(height,width);
-    for(size_t x = 0; x < width; x++){
-        for(size_t y = 0; y < height; y++){
-            t.set_value(y,x,get_value(x,y));
+    transpose(t);
+    return t;
+}
+
+void Matrix::transpose(Matrix& result) const
+{
+    if(&result == this){
+        throw std::invalid_argument("cannot transpose a matrix into itself");
+    }
+    result.resize(height,width);
+    for(size_t y = 0; y < height; y++){
+        const float* row = data.data() + y * stride;
+        for(size_t x = 0; x < width; x++){
+            result.data[x * result.stride + y] = row[x];
         }
     }
-    return t;
+}
+
+void Matrix::resize(size_t new_width, size_t new_height)
+{
+    width = new_width;
+    height = new_height;
+    stride = padded_stride(width,padding);
+    data.resize(stride * height);
 }
 
 float Matrix::get_value(size_t x, size_t y) const
@@ -197,8 +293,7 @@ float Matrix::get_value(size_t x, size_t y) const
         throw std::invalid_argument("x and or y value out of range");
     }
 
-    size_t index = y * width + x;
-    return data.at(index);
+    return data[y * stride + x];
 }
 
 void Matrix::set_value(size_t x, size_t y, float value)
@@ -207,8 +302,7 @@ void Matrix::set_value(size_t x, size_t y, float value)
         throw std::invalid_argument("x and or y value out of range");
     }
 
-    size_t index = y * width + x;
-    data.at(index) = value;
+    data[y * stride + x] = value;
 }
 
 size_t Matrix::get_width() const
@@ -221,14 +315,32 @@ size_t Matrix::get_height() const
     return height;
 }
 
-std::vector<float>& Matrix::get_data()
+MatrixStorage& Matrix::get_data()
+{
+    return data;
+}
+
+const MatrixStorage& Matrix::get_data() const
 {
     return data;
 }
 
 void Matrix::set_data(const std::vector<float>& new_data)
 {
-    data = new_data;
+    if(new_data.size() != width * height){
+        throw std::invalid_argument("data of " + std::to_string(new_data.size()) + " elements does not fit matrix of shape " + shape_str());
+    }
+    *this = ConstMatrixView(new_data.data(),width,height);
+}
+
+ConstMatrixView Matrix::get_column(size_t x) const
+{
+    return view().column(x);
+}
+
+ConstMatrixView Matrix::get_row(size_t y) const
+{
+    return view().row(y);
 }
 
 void Matrix::reshape(size_t new_width, size_t new_height)
@@ -236,8 +348,19 @@ void Matrix::reshape(size_t new_width, size_t new_height)
     if(new_width * new_height != width * height){
         throw std::invalid_argument("cannot reshape from (" + std::to_string(width) + "," + std::to_string(height) + ") to (" + std::to_string(new_width) + "," + std::to_string(new_height) + ")");
     }
+    if(padded_stride(new_width,padding) != new_width || !is_contiguous()){
+        // padded rows don't line up with the new shape, repack through a contiguous copy
+        Matrix packed(view());
+        packed.width = new_width;
+        packed.height = new_height;
+        packed.stride = new_width;
+        resize(new_width,new_height);
+        view().assign(packed);
+        return;
+    }
     width = new_width;
     height = new_height;
+    stride = new_width;
 }
 
 std::string Matrix::str() const
@@ -263,6 +386,8 @@ void Matrix::from_str(const std::string& str)
 {
     width = 0;
     height = 0;
+    stride = 0;
+    padding = RowPadding::none;
     data.clear();
     std::string num_buf("");
     std::cout <<'"' + str + '"' << "---" << std::endl;
@@ -297,6 +422,7 @@ void Matrix::from_str(const std::string& str)
             num_buf += str.at(n_char);
         }
     }
+    stride = width;
 }
 
 std::string Matrix::shape_str() const
@@ -0,0 +1,158 @@
+#include "MatrixView.hpp"
+#include <algorithm>
+
+// slice bounds shared by both view types, throws for anything outside width x height
+static void check_range(size_t begin, size_t end, size_t size, const char* what)
+{
+    if(begin > end || end > size){
+        throw std::invalid_argument(std::string(what) + " [" + std::to_string(begin) + "," + std::to_string(end) +
+                                    ") out of range for a view of size " + std::to_string(size));
+    }
+}
+
+static void check_stride(size_t width, size_t stride)
+{
+    if(stride < width){
+        throw std::invalid_argument("view stride " + std::to_string(stride) + " is less than its width " + std::to_string(width));
+    }
+}
+
+ConstMatrixView::ConstMatrixView()
+:data(nullptr), width(0), height(0), stride(0)
+{}
+
+ConstMatrixView::ConstMatrixView(const float* data, size_t width, size_t height)
+:data(data), width(width), height(height), stride(width)
+{}
+
+ConstMatrixView::ConstMatrixView(const float* data, size_t width, size_t height, size_t stride)
+:data(data), width(width), height(height), stride(stride)
+{
+    check_stride(width,stride);
+}
+
+float ConstMatrixView::get_value(size_t x, size_t y) const
+{
+    if(x >= width || y >= height){
+        throw std::invalid_argument("x and or y value out of range");
+    }
+    return data[y * stride + x];
+}
+
+ConstMatrixView ConstMatrixView::row(size_t y) const
+{
+    return rows(y,y + 1);
+}
+
+ConstMatrixView ConstMatrixView::column(size_t x) const
+{
+    return columns(x,x + 1);
+}
+
+ConstMatrixView ConstMatrixView::rows(size_t begin, size_t end) const
+{
+    check_range(begin,end,height,"rows");
+    return ConstMatrixView(data + begin * stride,width,end - begin,stride);
+}
+
+ConstMatrixView ConstMatrixView::columns(size_t begin, size_t end) const
+{
+    check_range(begin,end,width,"columns");
+    return ConstMatrixView(data + begin,end - begin,height,stride);
+}
+
+ConstMatrixView ConstMatrixView::block(size_t x, size_t y, size_t block_width, size_t block_height) const
+{
+    return rows(y,y + block_height).columns(x,x + block_width);
+}
+
+MatrixView::MatrixView()
+:data(nullptr), width(0), height(0), stride(0)
+{}
+
+MatrixView::MatrixView(float* data, size_t width, size_t height)
+:data(data), width(width), height(height), stride(width)
+{}
+
+MatrixView::MatrixView(float* data, size_t width, size_t height, size_t stride)
+:data(data), width(width), height(height), stride(stride)
+{
+    check_stride(width,stride);
+}
+
+float MatrixView::get_value(size_t x, size_t y) const
+{
+    return ConstMatrixView(*this).get_value(x,y);
+}
+
+void MatrixView::set_value(size_t x, size_t y, float value)
+{
+    if(x >= width || y >= height){
+        throw std::invalid_argument("x and or y value out of range");
+    }
+    data[y * stride + x] = value;
+}
+
+void MatrixView::fill(float value)
+{
+    for(size_t y = 0; y < height; y++){
+        float* dst = data + y * stride;
+        for(size_t x = 0; x < width; x++){
+            dst[x] = value;
+        }
+    }
+}
+
+MatrixView MatrixView::row(size_t y) const
+{
+    return rows(y,y + 1);
+}
+
+MatrixView MatrixView::column(size_t x) const
+{
+    return columns(x,x + 1);
+}
+
+MatrixView MatrixView::rows(size_t begin, size_t end) const
+{
+    check_range(begin,end,height,"rows");
+    return MatrixView(data + begin * stride,width,end - begin,stride);
+}
+
+MatrixView MatrixView::columns(size_t begin, size_t end) const
+{
+    check_range(begin,end,width,"columns");
+    return MatrixView(data + begin,end - begin,height,stride);
+}
+
+MatrixView MatrixView::block(size_t x, size_t y, size_t block_width, size_t block_height) const
+{
+    return rows(y,y + block_height).columns(x,x + block_width);
+}
+
+void MatrixView::check_same_shape(size_t other_width, size_t other_height, const std::string& other_shape) const
+{
+    if(other_width != width || other_height != height){
+        std::cout << "A shape:" << shape_str() << std::endl;
+        std::cout << "B shape:" << other_shape << std::endl;
+        throw std::invalid_argument("matrices must have same dimensions to be assigned");
+    }
+}
+
+void copy_elements(ConstMatrixView view, float* out)
+{
+    for(size_t y = 0; y < view.get_height(); y++){
+        const float* row = view.get_data() + y * view.get_stride();
+        std::copy(row,row + view.get_width(),out + y * view.get_width());
+    }
+}
+
+const float* packed_elements(ConstMatrixView view, std::vector<float>& scratch)
+{
+    if(view.is_contiguous()){
+        return view.get_data();
+    }
+    scratch.resize(view.get_width() * view.get_height());
+    copy_elements(view,scratch.data());
+    return scratch.data();
+}
@@ -0,0 +1,81 @@
+#include "ModelComparison.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+std::vector<float> pack_inputs(const TrainingBatch& samples, size_t input_size)
+{
+    std::vector<float> inputs(samples.size() * input_size);
+    for(size_t i = 0; i < samples.size(); i++)
+    {
+        const Matrix& input = samples[i].first;
+        if(input.get_width() != 1 || input.get_height() != input_size){
+            throw std::invalid_argument("samples must be column vectors with the size of the input layer");
+        }
+        copy_elements(input, inputs.data() + i * input_size);
+    }
+    return inputs;
+}
+
+size_t argmax(const float* values, size_t count)
+{
+    return std::max_element(values, values + count) - values;
+}
+
+OutputComparison compare_outputs(const float* reference, const float* outputs, size_t output_size,
+                                 const TrainingBatch& samples)
+{
+    OutputComparison comparison = {};
+    size_t n = samples.size();
+    std::vector<float> packed_desired;
+    double total_error = 0.0;
+    size_t reference_correct = 0;
+    size_t correct = 0;
+    size_t agreeing = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        const float* expected = reference + i * output_size;
+        const float* actual = outputs + i * output_size;
+        for(size_t j = 0; j < output_size; j++){
+            float error = std::abs(expected[j] - actual[j]);
+            comparison.max_abs_error = std::max(comparison.max_abs_error, error);
+            total_error += error;
+        }
+        const Matrix& desired = samples[i].second;
+        size_t label = argmax(packed_elements(desired, packed_desired), desired.get_height());
+        reference_correct += (argmax(expected, output_size) == label);
+        correct += (argmax(actual, output_size) == label);
+        agreeing += (argmax(expected, output_size) == argmax(actual, output_size));
+    }
+    if(n > 0){
+        comparison.mean_abs_error = total_error / (n * output_size);
+        comparison.reference_accuracy = float(reference_correct) / n;
+        comparison.accuracy = float(correct) / n;
+        comparison.agreement = float(agreeing) / n;
+    }
+    return comparison;
+}
+
+OutputScore score_outputs(const float* outputs, size_t output_size, const TrainingBatch& samples)
+{
+    OutputScore score = {};
+    size_t n = samples.size();
+    std::vector<float> packed_desired;
+    double total_error = 0.0;
+    size_t correct = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        const float* actual = outputs + i * output_size;
+        const float* desired = packed_elements(samples[i].second, packed_desired);
+        for(size_t j = 0; j < output_size; j++){
+            double error = actual[j] - desired[j];
+            total_error += error * error;
+        }
+        correct += (argmax(actual, output_size) == argmax(desired, output_size));
+    }
+    if(n > 0){
+        score.cost = float(total_error / (n * output_size));
+        score.accuracy = float(correct) / n;
+    }
+    return score;
+}
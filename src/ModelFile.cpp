@@ -0,0 +1,238 @@
+#include "ModelFile.hpp"
+#include "Gemm.hpp"
+#include "Activation.hpp"
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+static const char MODEL_MAGIC[8] = {'N','N','M','O','D','E','L','\0'};
+
+static uint64_t align_up(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+size_t model_data_type_size(ModelDataType type)
+{
+    return (type == ModelDataType::float32) ? sizeof(float) : sizeof(uint16_t);
+}
+
+HalfFormat model_data_type_half_format(ModelDataType type)
+{
+    switch(type){
+        case ModelDataType::float16: return HalfFormat::float16;
+        case ModelDataType::bfloat16: return HalfFormat::bfloat16;
+        default: throw std::invalid_argument("model data type is not a half precision type");
+    }
+}
+
+static bool is_known_data_type(uint32_t type)
+{
+    return type <= static_cast<uint32_t>(ModelDataType::bfloat16);
+}
+
+void write_model_file(const std::string& path, const std::vector<size_t>& topology,
+                      const std::vector<const float*>& weights, const std::vector<const float*>& biases,
+                      ModelDataType weight_type, const std::vector<ActivationKind>& activations)
+{
+    if(topology.size() == 0 || weights.size() != topology.size() || biases.size() != topology.size() ||
+       (!activations.empty() && activations.size() != topology.size())){
+        throw std::invalid_argument("model topology, weights, biases and activations must have one entry per layer");
+    }
+
+    // lay out the blocks
+    std::vector<ModelLayerEntry> table(topology.size());
+    uint64_t offset = sizeof(ModelFileHeader) + table.size() * sizeof(ModelLayerEntry);
+    for(size_t n_layer = 0; n_layer < topology.size(); n_layer++)
+    {
+        table[n_layer].neurons = topology[n_layer];
+        table[n_layer].weight_offset = 0;
+        table[n_layer].bias_offset = 0;
+        table[n_layer].activation = 0;
+        table[n_layer].reserved = 0;
+        if(n_layer == 0){
+            continue;
+        }
+        if(!activations.empty()){
+            table[n_layer].activation = static_cast<uint32_t>(activations[n_layer]);
+        }
+        offset = align_up(offset,MODEL_FILE_ALIGNMENT);
+        table[n_layer].weight_offset = offset;
+        offset += topology[n_layer] * topology[n_layer-1] * model_data_type_size(weight_type);
+        offset = align_up(offset,MODEL_FILE_ALIGNMENT);
+        table[n_layer].bias_offset = offset;
+        offset += topology[n_layer] * sizeof(float);
+    }
+
+    std::vector<char> buffer(offset,0);
+    std::memcpy(buffer.data() + sizeof(ModelFileHeader),table.data(),table.size() * sizeof(ModelLayerEntry));
+    for(size_t n_layer = 1; n_layer < topology.size(); n_layer++)
+    {
+        size_t weight_count = topology[n_layer] * topology[n_layer-1];
+        char* weight_block = buffer.data() + table[n_layer].weight_offset;
+        if(weight_type == ModelDataType::float32){
+            std::memcpy(weight_block,weights[n_layer],weight_count * sizeof(float));
+        }else{
+            // blocks are 64 byte aligned so the halves can be written in place
+            float_to_half(weights[n_layer],reinterpret_cast<uint16_t*>(weight_block),weight_count,
+                          model_data_type_half_format(weight_type));
+        }
+        std::memcpy(buffer.data() + table[n_layer].bias_offset,biases[n_layer],topology[n_layer] * sizeof(float));
+    }
+
+    ModelFileHeader header = {};
+    std::memcpy(header.magic,MODEL_MAGIC,sizeof(MODEL_MAGIC));
+    header.version = MODEL_FILE_VERSION;
+    header.dtype = static_cast<uint32_t>(weight_type);
+    header.alignment = MODEL_FILE_ALIGNMENT;
+    header.layer_count = static_cast<uint32_t>(topology.size());
+    header.layer_table_offset = sizeof(ModelFileHeader);
+    header.file_size = buffer.size();
+    header.checksum = crc32(buffer.data() + sizeof(ModelFileHeader),buffer.size() - sizeof(ModelFileHeader));
+    std::memcpy(buffer.data(),&header,sizeof(header));
+
+    std::ofstream out(path,std::ios_base::binary);
+    if(!out){
+        throw std::runtime_error("unable to open " + path + " for writing");
+    }
+    out.write(buffer.data(),buffer.size());
+    if(!out){
+        throw std::runtime_error("unable to write " + path);
+    }
+}
+
+MappedModel::MappedModel(const std::string& path, bool verify_checksum)
+:file(path)
+{
+    const uint8_t* data = file.data();
+    size_t size = file.size();
+
+    ModelFileHeader header;
+    if(size < sizeof(header)){
+        throw std::runtime_error(path + " is too small to be a model file");
+    }
+    std::memcpy(&header,data,sizeof(header));
+    if(std::memcmp(header.magic,MODEL_MAGIC,sizeof(MODEL_MAGIC)) != 0){
+        throw std::runtime_error(path + " is not a model file");
+    }
+    if(header.version != MODEL_FILE_VERSION && header.version != 1){
+        throw std::runtime_error(path + " has unsupported model file version " + std::to_string(header.version));
+    }
+    if(!is_known_data_type(header.dtype)){
+        throw std::runtime_error(path + " has unsupported data type " + std::to_string(header.dtype));
+    }
+    if(header.alignment != MODEL_FILE_ALIGNMENT){
+        throw std::runtime_error(path + " has unsupported alignment " + std::to_string(header.alignment));
+    }
+    // version 1 entries end before the activation, which then stays 0 (sigmoid)
+    size_t entry_size = (header.version == 1) ? offsetof(ModelLayerEntry,activation) : sizeof(ModelLayerEntry);
+    if(header.file_size != size || header.layer_count == 0 ||
+       !block_in_range(header.layer_table_offset,uint64_t(header.layer_count) * entry_size,size)){
+        throw std::runtime_error(path + " is truncated or corrupt");
+    }
+    if(verify_checksum && crc32(data + sizeof(header),size - sizeof(header)) != header.checksum){
+        throw std::runtime_error(path + " checksum mismatch");
+    }
+
+    data_type = static_cast<ModelDataType>(header.dtype);
+    const uint8_t* table = data + header.layer_table_offset;
+    for(size_t n_layer = 0; n_layer < header.layer_count; n_layer++)
+    {
+        ModelLayerEntry entry = {};
+        std::memcpy(&entry,table + n_layer * entry_size,entry_size);
+        topology.push_back(entry.neurons);
+        if(n_layer == 0){
+            weights.push_back(nullptr);
+            biases.push_back(nullptr);
+            activations.push_back(ActivationKind::sigmoid);
+            continue;
+        }
+        if(!is_known_activation(entry.activation)){
+            throw std::runtime_error(path + " has unsupported activation " + std::to_string(entry.activation) +
+                                     " for layer " + std::to_string(n_layer));
+        }
+        // sizes from a corrupt file could wrap around, every product and sum is checked
+        uint64_t weight_count = 0;
+        uint64_t weight_bytes = 0;
+        uint64_t bias_bytes = 0;
+        if(!checked_multiply(entry.neurons,topology[n_layer-1],weight_count) ||
+           !checked_multiply(weight_count,model_data_type_size(data_type),weight_bytes) ||
+           !checked_multiply(entry.neurons,sizeof(float),bias_bytes) ||
+           entry.weight_offset % MODEL_FILE_ALIGNMENT != 0 || entry.bias_offset % MODEL_FILE_ALIGNMENT != 0 ||
+           !block_in_range(entry.weight_offset,weight_bytes,size) || !block_in_range(entry.bias_offset,bias_bytes,size)){
+            throw std::runtime_error(path + " has an invalid block for layer " + std::to_string(n_layer));
+        }
+        weights.push_back(data + entry.weight_offset);
+        biases.push_back(reinterpret_cast<const float*>(data + entry.bias_offset));
+        activations.push_back(static_cast<ActivationKind>(entry.activation));
+    }
+}
+
+size_t MappedModel::get_layer_count() const
+{
+    return topology.size();
+}
+
+size_t MappedModel::get_layer_size(size_t n_layer) const
+{
+    return topology.at(n_layer);
+}
+
+ModelDataType MappedModel::get_data_type() const
+{
+    return data_type;
+}
+
+const float* MappedModel::get_layer_weights(size_t n_layer) const
+{
+    if(data_type != ModelDataType::float32){
+        throw std::runtime_error("model weights are not stored as float32, use get_layer_weight_data");
+    }
+    return static_cast<const float*>(weights.at(n_layer));
+}
+
+const void* MappedModel::get_layer_weight_data(size_t n_layer) const
+{
+    return weights.at(n_layer);
+}
+
+const float* MappedModel::get_layer_bias(size_t n_layer) const
+{
+    return biases.at(n_layer);
+}
+
+ActivationKind MappedModel::get_layer_activation(size_t n_layer) const
+{
+    return activations.at(n_layer);
+}
+
+Matrix MappedModel::feedforward(ConstMatrixView input) const
+{
+    if(input.get_width() != 1 || input.get_height() != topology.front()){
+        throw std::invalid_argument("input must be a column vector with the size of the input layer");
+    }
+    Matrix current(input); // copied without padding, the products below read height contiguous floats
+    for(size_t n_layer = 1; n_layer < topology.size(); n_layer++)
+    {
+        Matrix next(1,topology[n_layer]);
+        MatrixStorage& out = next.get_data();
+        if(data_type == ModelDataType::float32){
+            gemm(Transpose::no, Transpose::no,
+                 topology[n_layer], 1, topology[n_layer-1],
+                 1.0f, static_cast<const float*>(weights[n_layer]), topology[n_layer-1],
+                 current.get_data().data(), 1,
+                 0.0f, out.data(), 1);
+        }else{
+            // the input as a single row times the transposed weights gives the same column
+            gemm_half_nt(1, topology[n_layer], topology[n_layer-1],
+                         current.get_data().data(), topology[n_layer-1],
+                         static_cast<const uint16_t*>(weights[n_layer]), topology[n_layer-1],
+                         model_data_type_half_format(data_type),
+                         out.data(), topology[n_layer]);
+        }
+        bias_activation_by_row(activations[n_layer],out.data(),out.size(),1,biases[n_layer]);
+        current = std::move(next);
+    }
+    return current;
+}
@@ -1,12 +1,22 @@
 #include "NeuralNet.hpp"
+#include "ModelFile.hpp"
+#include "Activation.hpp"
 #include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
 
 NeuralNet::NeuralNet()
-:neuron_layers({}),weight_layers({}),bias_layers({})
+:neuron_layers({}),weight_layers({}),bias_layers({}),profiling(false),sparse_input_threshold(0.0f)
 {}
 
-void NeuralNet::add_layer(size_t n_neurons)
+void NeuralNet::add_layer(size_t n_neurons, ActivationKind activation)
 {
+    if(!is_known_activation(static_cast<uint32_t>(activation))){
+        throw std::invalid_argument("unknown activation " + std::to_string(static_cast<uint32_t>(activation)));
+    }
     if(neuron_layers.size() > 0)
     {
         size_t previous_layer_height = neuron_layers.back().get_height();
@@ -14,15 +24,19 @@ void NeuralNet::add_layer(size_t n_neurons)
         weight_layers.emplace_back(previous_layer_height,n_neurons);
         bias_layers.emplace_back(1,n_neurons);
         error_layers.emplace_back(1,n_neurons);
+        weight_masks.emplace_back();
+        activation_layers.push_back(activation);
     }else{
         neuron_layers.emplace_back(1,n_neurons);
         weight_layers.emplace_back(1,1); // not used
         bias_layers.emplace_back(1,1); // not used
         error_layers.emplace_back(1,1); // not used
+        weight_masks.emplace_back(); // not used
+        activation_layers.push_back(ActivationKind::identity); // not used
     }
 }
 
-void NeuralNet::set_input(const Matrix& input)
+void NeuralNet::set_input(ConstMatrixView input)
 {
     if(input.get_width() != 1){
         throw std::invalid_argument("input data must be column vector thus the width must be 1");
@@ -42,27 +56,48 @@ float NeuralNet::sigmoid(float x)
 
 void NeuralNet::sigmoid(Matrix& mat)
 {
-    for(auto& value : mat.get_data())
-    {
-        value = sigmoid(value);
-    }
+    MatrixStorage& data = mat.get_data();
+    sigmoid_kernel(data.data(),data.data(),data.size());
 }
 
 float NeuralNet::sigmoid_derivative(float x)
 {
-    return sigmoid(x)*(1-sigmoid(x));
+    return -sigmoid(x)*(1-sigmoid(x));
 }
 
 void NeuralNet::sigmoid_derivative(Matrix& mat)
 {
-    for(auto& value : mat.get_data())
-    {
-        value = sigmoid_derivative(value);
+    // one exp per element, the derivative follows from the sigmoid itself
+    MatrixStorage& data = mat.get_data();
+    sigmoid_kernel(data.data(),data.data(),data.size());
+    sigmoid_derivative_kernel(data.data(),data.data(),data.size());
+}
+
+// adds the bias column to every column of mat and applies the activation, in a single pass
+static void add_bias_and_activate(Matrix& mat, const Matrix& bias, ActivationKind activation)
+{
+    if(bias.get_width() != 1 || bias.get_height() != mat.get_height()){
+        std::cout << "A shape:" << mat.shape_str() << std::endl;
+        std::cout << "B shape:" << bias.shape_str() << std::endl;
+        throw std::invalid_argument("bias must be a column vector with the height of the layer");
     }
+    bias_activation_by_row(activation,mat.get_data().data(),mat.get_height(),mat.get_width(),bias.get_data().data());
 }
 
+// work of the forward pass of one layer for a batch of n samples
+static double forward_flops(size_t inputs, size_t outputs, size_t n) { return 2.0 * outputs * inputs * n; }
+static double forward_bytes(size_t inputs, size_t outputs, size_t n) { return 4.0 * (outputs * inputs + inputs * n + outputs * n); }
+// bias add and activation, sigmoid and tanh count 4 per element, the others 1
+static double activation_flops(ActivationKind activation, size_t outputs, size_t n)
+{
+    bool uses_exp = activation == ActivationKind::sigmoid || activation == ActivationKind::tanh;
+    return (uses_exp ? 5.0 : 2.0) * outputs * n;
+}
+static double activation_bytes(size_t outputs, size_t n) { return 4.0 * (2 * outputs * n + outputs); }
+
 void NeuralNet::feedforward()
 {
+    PhaseTimer timer(profiling ? &profile : nullptr);
     for(size_t n_layer = 1; n_layer < neuron_layers.size(); n_layer++)
     {
         // //std::cout << "compute layer " + std::to_string(n_layer) << std::endl;
@@ -70,147 +105,660 @@ void NeuralNet::feedforward()
         // //std::cout << "neurons: " << neuron_layers.at(n_layer-1).str() << std::endl;
         // //std::cout << "weights: " << weight_layers.at(n_layer).str() << std::endl;
         // //std::cout << "biases: " << bias_layers.at(n_layer).str() << std::endl;
-        neuron_layers.at(n_layer) = weight_layers.at(n_layer).dot(neuron_layers.at(n_layer-1)) + bias_layers.at(n_layer);
-        sigmoid(neuron_layers.at(n_layer));
+        Matrix& neurons = neuron_layers.at(n_layer);
+        size_t inputs = neuron_layers.at(n_layer-1).get_height();
+        if(n_layer == 1 && sparse_input_threshold > 0 && sparse_first_layer()){
+            inputs = active_inputs.size();
+        }else{
+            weight_layers.at(n_layer).dot(neuron_layers.at(n_layer-1),neurons);
+        }
+        size_t outputs = neurons.get_height();
+        timer.lap(n_layer,ProfilePhase::forward_gemm,forward_flops(inputs,outputs,1),forward_bytes(inputs,outputs,1));
+        add_bias_and_activate(neurons,bias_layers.at(n_layer),activation_layers[n_layer]);
+        timer.lap(n_layer,ProfilePhase::bias_activation,activation_flops(activation_layers[n_layer],outputs,1),
+                  activation_bytes(outputs,1));
         // //std::cout << "output: " << bias_layers.at(n_layer-1).str() << std::endl;
 
     }
 }
 
+// the first layer product over the non-zero inputs only, false (nothing computed) when the input is too dense
+bool NeuralNet::sparse_first_layer()
+{
+    const Matrix& input = neuron_layers[0];
+    collect_non_zero(input,active_inputs,active_values);
+    bool sparse = active_inputs.size() <= sparse_input_threshold * input.get_height();
+    sparse_stats.add(active_inputs.size(),input.get_height(),sparse);
+    if(sparse){
+        sparse_matrix_vector(weight_layers[1],active_inputs,active_values,neuron_layers[1]);
+    }
+    return sparse;
+}
+
+// merges the input masks of the workers, true when the batch is sparse enough for the sparse first layer,
+// which then reads active_inputs and active_weights
+bool NeuralNet::select_sparse_inputs(size_t n_workers)
+{
+    std::vector<uint8_t>& mask = thread_workspaces[0].input_mask;
+    for(size_t n_worker = 1; n_worker < n_workers; n_worker++)
+    {
+        const std::vector<uint8_t>& other = thread_workspaces[n_worker].input_mask;
+        for(size_t i = 0; i < mask.size(); i++){
+            mask[i] |= other[i];
+        }
+    }
+    mask_to_indices(mask,active_inputs);
+    bool sparse = active_inputs.size() <= sparse_input_threshold * mask.size();
+    sparse_stats.add(active_inputs.size(),mask.size(),sparse);
+    if(sparse){
+        gather_columns(weight_layers[1],active_inputs,active_weights);
+    }
+    return sparse;
+}
+
 void NeuralNet::randomize()
 {
     //randomize weights
     for(size_t n_layer = 1; n_layer < neuron_layers.size(); n_layer++)
     {
-        std::vector<float>& data = weight_layers.at(n_layer).get_data();
+        MatrixStorage& data = weight_layers.at(n_layer).get_data();
+        // sigmoid layers keep weights in [0, 1), the others are centered with a range scaled to the layer
+        // (He for relu and leaky relu, Glorot for tanh and identity) so the activations neither die nor blow up
+        ActivationKind activation = activation_layers[n_layer];
+        float fan_in = (float)weight_layers[n_layer].get_width();
+        float fan_out = (float)weight_layers[n_layer].get_height();
+        bool rectifier = activation == ActivationKind::relu || activation == ActivationKind::leaky_relu;
+        float limit = std::sqrt(6.0f / (rectifier ? fan_in : fan_in + fan_out));
         for(auto& value : data)
         {
             value = (float) (rand() % 10000);
             value /= 10000.0f;
+            if(activation != ActivationKind::sigmoid){
+                value = (2 * value - 1) * limit;
+            }
         }
     }
 
     //randomize bias
     for(size_t n_layer = 1; n_layer < neuron_layers.size(); n_layer++)
     {
-        std::vector<float>& data = bias_layers.at(n_layer).get_data();
+        MatrixStorage& data = bias_layers.at(n_layer).get_data();
         for(auto& value : data)
         {
             value = (float) (rand() % 10000);
             value /= 10000.0f;
+            if(activation_layers[n_layer] != ActivationKind::sigmoid){
+                value = 0.0f;
+            }
         }
     }
 }
 
-void NeuralNet::process_batch(float learning_rate, const TrainingBatch& batch)
+void NeuralNet::set_thread_count(size_t n_threads)
 {
-    bias_delta = bias_layers;
-    weight_delta = weight_layers;
+    if(n_threads == 0){
+        n_threads = 1;
+    }
+    if(n_threads == get_thread_count()){
+        return;
+    }
+    if(n_threads == 1){
+        thread_pool.reset();
+    }else{
+        thread_pool = std::make_shared<ThreadPool>(n_threads);
+    }
+}
 
-    std::vector<Matrix> bias_delta_sum = bias_layers;
-    std::vector<Matrix> weight_delta_sum = weight_layers;
-    for(size_t n_layer = 0; n_layer < neuron_layers.size(); n_layer++)
+size_t NeuralNet::get_thread_count() const
+{
+    return thread_pool ? thread_pool->size() : 1;
+}
+
+namespace {
+
+// process_batch's view of its samples, a worker asks for the columns of its slice [begin,end)
+
+// samples referenced by a TrainingBatch, slices are stacked into the worker's workspace
+struct BatchSamples{
+    const TrainingBatch& batch;
+
+    size_t size() const { return batch.size(); }
+    void mark_active(size_t begin, size_t end, std::vector<uint8_t>& mask) const
+    {
+        for(size_t n_case = begin; n_case < end; n_case++){
+            mark_active_rows(batch[n_case].first,mask);
+        }
+    }
+    ConstMatrixView desired(size_t begin, size_t end, TrainingWorkspace& workspace) const
+    {
+        batch.get_desired_matrix(begin,end,workspace.desired);
+        return workspace.desired;
+    }
+    ConstMatrixView inputs(size_t begin, size_t end, TrainingWorkspace& workspace) const
+    {
+        batch.get_input_matrix(begin,end,workspace.inputs);
+        return workspace.inputs;
+    }
+    ConstMatrixView input_rows(size_t begin, size_t end, const std::vector<uint32_t>& rows, TrainingWorkspace& workspace) const
     {
-        bias_delta_sum[n_layer] *= 0;
-        weight_delta_sum[n_layer] *= 0;
+        batch.get_input_rows(begin,end,rows,workspace.sparse_inputs);
+        return workspace.sparse_inputs;
     }
+};
 
+// samples already stacked as columns (e.g. by a BatchProducer), slices are views, nothing is copied
+struct StackedSamples{
+    ConstMatrixView stacked_inputs;
+    ConstMatrixView stacked_desired;
 
-    for(size_t n_batch = 0; n_batch < batch.size(); n_batch++)
+    size_t size() const { return stacked_inputs.get_width(); }
+    void mark_active(size_t begin, size_t end, std::vector<uint8_t>& mask) const
+    {
+        mark_active_rows(stacked_inputs.columns(begin,end),mask);
+    }
+    ConstMatrixView desired(size_t begin, size_t end, TrainingWorkspace&) const
+    {
+        return stacked_desired.columns(begin,end);
+    }
+    ConstMatrixView inputs(size_t begin, size_t end, TrainingWorkspace&) const
+    {
+        return stacked_inputs.columns(begin,end);
+    }
+    ConstMatrixView input_rows(size_t begin, size_t end, const std::vector<uint32_t>& rows, TrainingWorkspace& workspace) const
     {
-        Matrix input = batch[n_batch].first;
-        Matrix desired = batch[n_batch].second;
+        gather_rows(stacked_inputs.columns(begin,end),rows,workspace.sparse_inputs);
+        return workspace.sparse_inputs;
+    }
+};
+
+}
+
+void NeuralNet::process_batch(float learning_rate, const TrainingBatch& batch)
+{
+    train_batch(learning_rate,BatchSamples{batch});
+}
 
-        backpropagate(input,desired);
+void NeuralNet::process_batch(float learning_rate, ConstMatrixView inputs, ConstMatrixView desired)
+{
+    if(neuron_layers.size() < 2 || inputs.get_height() != neuron_layers[0].get_height()
+       || desired.get_height() != neuron_layers.back().get_height() || inputs.get_width() != desired.get_width()){
+        std::cout << "A shape:" << inputs.shape_str() << std::endl;
+        std::cout << "B shape:" << desired.shape_str() << std::endl;
+        throw std::invalid_argument("inputs and desired outputs must have a column per sample and the height of their layer");
+    }
+    train_batch(learning_rate,StackedSamples{inputs,desired});
+}
+
+template<typename Samples>
+void NeuralNet::train_batch(float learning_rate, const Samples& batch)
+{
+    if(batch.size() == 0){
+        return;
+    }
 
+    // every worker pushes its own slice of the batch through the network at once (one column per sample)
+    // using its own workspace, so the gradients of a worker hold the sums over its slice
+    size_t n_workers = std::min(get_thread_count(),batch.size());
+    if(thread_workspaces.size() < n_workers){
+        thread_workspaces.resize(n_workers);
+    }
 
-        for(size_t n_layer = 0; n_layer < neuron_layers.size(); n_layer++)
+    // with the sparse input check on, the workers first mark the non-zero inputs of their samples,
+    // the marks are merged to pick the first layer path and a sparse batch only stacks the active inputs
+    bool check_sparse = sparse_input_threshold > 0 && neuron_layers.size() > 1;
+    bool sparse = false;
+    auto prepare_slice = [&](size_t n_worker)
+    {
+        size_t begin = batch.size() * n_worker / n_workers;
+        size_t end = batch.size() * (n_worker + 1) / n_workers;
+        TrainingWorkspace& workspace = thread_workspaces[n_worker];
+        workspace.prepare(weight_layers,end - begin);
+        if(check_sparse){
+            workspace.input_mask.assign(weight_layers[1].get_width(),0);
+            batch.mark_active(begin,end,workspace.input_mask);
+        }
+    };
+    auto compute_slice = [&](size_t n_worker)
+    {
+        size_t begin = batch.size() * n_worker / n_workers;
+        size_t end = batch.size() * (n_worker + 1) / n_workers;
+        TrainingWorkspace& workspace = thread_workspaces[n_worker];
+        if(!check_sparse){
+            prepare_slice(n_worker);
+        }
+        ConstMatrixView desired = batch.desired(begin,end,workspace);
+        if(sparse){
+            backpropagate_batch(batch.input_rows(begin,end,active_inputs,workspace),desired,workspace,active_weights);
+        }else{
+            backpropagate_batch(batch.inputs(begin,end,workspace),desired,workspace,weight_layers[1]);
+        }
+    };
+
+    // tree reduction, in round n worker i adds the sums of worker i + 2^n
+    auto reduce_pair = [&](size_t n_pair, size_t stride)
+    {
+        TrainingWorkspace& target = thread_workspaces[n_pair * 2 * stride];
+        const TrainingWorkspace& source = thread_workspaces[n_pair * 2 * stride + stride];
+        PhaseTimer timer(profiling ? &target.profile : nullptr);
+        for(size_t n_layer = 1; n_layer < neuron_layers.size(); n_layer++)
         {
-            bias_delta_sum[n_layer] += bias_delta[n_layer];
-            weight_delta_sum[n_layer] += weight_delta[n_layer];
+            target.bias_gradient[n_layer] += source.bias_gradient[n_layer];
+            target.weight_gradient[n_layer] += source.weight_gradient[n_layer];
+            double values = target.weight_gradient[n_layer].get_data().size() + target.bias_gradient[n_layer].get_data().size();
+            timer.lap(n_layer,ProfilePhase::gradient_reduce,values,12.0 * values);
+        }
+    };
+
+    if(n_workers == 1){
+        if(check_sparse){
+            prepare_slice(0);
+            sparse = select_sparse_inputs(1);
+        }
+        compute_slice(0);
+    }else{
+        // passed by reference, wrapping the lambdas themselves in a std::function would allocate
+        if(check_sparse){
+            thread_pool->run(n_workers,std::cref(prepare_slice));
+            sparse = select_sparse_inputs(n_workers);
+        }
+        thread_pool->run(n_workers,std::cref(compute_slice));
+        for(size_t stride = 1; stride < n_workers; stride *= 2)
+        {
+            size_t n_pairs = (n_workers - stride + 2 * stride - 1) / (2 * stride);
+            auto reduce_round = [&](size_t n_pair){ reduce_pair(n_pair,stride); };
+            thread_pool->run(n_pairs,std::cref(reduce_round));
         }
     }
 
-    // adjusting weights
-    for(size_t n_layer = 0; n_layer < neuron_layers.size(); n_layer++)
+    // adjusting weights in place, pruned weights are masked in the same pass
+    const TrainingWorkspace& total = thread_workspaces[0];
+    PhaseTimer timer(profiling ? &profile : nullptr);
+    optimizer.next_step();
+    for(size_t n_layer = 1; n_layer < neuron_layers.size(); n_layer++)
     {
-        weight_layers[n_layer] = weight_layers[n_layer] + (weight_delta_sum[n_layer] * (learning_rate/batch.size()));
-        bias_layers[n_layer] = bias_layers[n_layer] + (bias_delta_sum[n_layer] * (learning_rate/batch.size()));
+        const Matrix* mask = (weight_masks[n_layer].get_width() != 0) ? &weight_masks[n_layer] : nullptr;
+        if(n_layer == 1 && sparse){
+            optimizer.update_columns(2 * n_layer,learning_rate,batch.size(),weight_layers[n_layer].view(),
+                                     total.weight_gradient[n_layer],active_inputs,mask);
+        }else{
+            optimizer.update(2 * n_layer,learning_rate,batch.size(),weight_layers[n_layer].view(),total.weight_gradient[n_layer],mask);
+        }
+        optimizer.update(2 * n_layer + 1,learning_rate,batch.size(),bias_layers[n_layer].view(),total.bias_gradient[n_layer]);
+        double values = total.weight_gradient[n_layer].get_data().size() + bias_layers[n_layer].get_data().size();
+        timer.lap(n_layer,ProfilePhase::update,optimizer.get_flops_per_parameter() * values,
+                  optimizer.get_bytes_per_parameter() * values);
     }
 }
 
-void NeuralNet::backpropagate(const Matrix& input, const Matrix& desired)
+void NeuralNet::train_hogwild(float learning_rate, const TrainingBatch& samples, size_t samples_per_update)
 {
+    if(samples_per_update == 0){
+        throw std::invalid_argument("samples per update must be at least 1");
+    }
+    if(neuron_layers.size() < 2){
+        throw std::invalid_argument("network needs at least one layer after the input layer");
+    }
+    size_t n_updates = (samples.size() + samples_per_update - 1) / samples_per_update;
+    if(n_updates == 0){
+        return;
+    }
+    size_t n_workers = std::min(get_thread_count(),n_updates);
+    if(thread_workspaces.size() < n_workers){
+        thread_workspaces.resize(n_workers);
+    }
 
-    // feed forward
-    set_input(input);
-    std::vector<Matrix> intermediates({});
+    // the workers only share the counter of the next sample, the network's own sparse input
+    // buffers are per pass so every worker picks its first layer path in its own workspace
+    std::atomic<size_t> next_sample(0);
+    std::vector<SparseInputStats> worker_stats(n_workers);
+    bool check_sparse = sparse_input_threshold > 0;
+    auto worker = [&](size_t n_worker)
+    {
+        TrainingWorkspace& workspace = thread_workspaces[n_worker];
+        Optimizer sgd; // stateless, only the update kernels
+        for(;;)
+        {
+            size_t begin = next_sample.fetch_add(samples_per_update,std::memory_order_relaxed);
+            if(begin >= samples.size()){
+                break;
+            }
+            size_t end = std::min(begin + samples_per_update,samples.size());
+            workspace.prepare(weight_layers,end - begin);
+            samples.get_desired_matrix(begin,end,workspace.desired);
+            bool sparse = false;
+            if(check_sparse){
+                workspace.input_mask.assign(weight_layers[1].get_width(),0);
+                for(size_t n_case = begin; n_case < end; n_case++){
+                    mark_active_rows(samples[n_case].first,workspace.input_mask);
+                }
+                mask_to_indices(workspace.input_mask,workspace.active_inputs);
+                sparse = workspace.active_inputs.size() <= sparse_input_threshold * workspace.input_mask.size();
+                worker_stats[n_worker].add(workspace.active_inputs.size(),workspace.input_mask.size(),sparse);
+            }
+            if(sparse){
+                gather_columns(weight_layers[1],workspace.active_inputs,workspace.active_weights);
+                samples.get_input_rows(begin,end,workspace.active_inputs,workspace.sparse_inputs);
+                backpropagate_batch(workspace.sparse_inputs,workspace.desired,workspace,workspace.active_weights);
+            }else{
+                samples.get_input_matrix(begin,end,workspace.inputs);
+                backpropagate_batch(workspace.inputs,workspace.desired,workspace,weight_layers[1]);
+            }
+
+            // straight into the shared parameters, see the header on why this is not synchronized
+            PhaseTimer timer(profiling ? &workspace.profile : nullptr);
+            for(size_t n_layer = 1; n_layer < neuron_layers.size(); n_layer++)
+            {
+                const Matrix* mask = (weight_masks[n_layer].get_width() != 0) ? &weight_masks[n_layer] : nullptr;
+                if(n_layer == 1 && sparse){
+                    sgd.update_columns(0,learning_rate,end - begin,weight_layers[n_layer].view(),
+                                       workspace.weight_gradient[n_layer],workspace.active_inputs,mask);
+                }else{
+                    sgd.update(0,learning_rate,end - begin,weight_layers[n_layer].view(),workspace.weight_gradient[n_layer],mask);
+                }
+                sgd.update(0,learning_rate,end - begin,bias_layers[n_layer].view(),workspace.bias_gradient[n_layer]);
+                double values = workspace.weight_gradient[n_layer].get_data().size() + bias_layers[n_layer].get_data().size();
+                timer.lap(n_layer,ProfilePhase::update,sgd.get_flops_per_parameter() * values,
+                          sgd.get_bytes_per_parameter() * values);
+            }
+        }
+    };
+
+    if(n_workers == 1){
+        worker(0);
+    }else{
+        thread_pool->run(n_workers,std::cref(worker));
+    }
+    for(const SparseInputStats& stats : worker_stats)
+    {
+        sparse_stats.merge(stats);
+    }
+}
 
+void NeuralNet::set_optimizer(const OptimizerSettings& settings)
+{
+    optimizer = Optimizer(settings);
+}
+
+const Optimizer& NeuralNet::get_optimizer() const
+{
+    return optimizer;
+}
+
+void NeuralNet::reset_optimizer()
+{
+    optimizer.reset();
+}
+
+void NeuralNet::backpropagate(ConstMatrixView input, ConstMatrixView desired)
+{
+    if(input.get_width() != 1){
+        throw std::invalid_argument("input data must be column vector thus the width must be 1");
+    }
+    if(thread_workspaces.empty()){
+        thread_workspaces.resize(1);
+    }
+    TrainingWorkspace& workspace = thread_workspaces[0];
+    workspace.prepare(weight_layers,1);
+    bool sparse = false;
+    if(sparse_input_threshold > 0 && neuron_layers.size() > 1){
+        workspace.input_mask.assign(input.get_height(),0);
+        mark_active_rows(input,workspace.input_mask);
+        sparse = select_sparse_inputs(1);
+    }
+    if(sparse){
+        gather_rows(input,active_inputs,workspace.sparse_inputs);
+        backpropagate_batch(workspace.sparse_inputs,desired,workspace,active_weights);
+    }else{
+        backpropagate_batch(input,desired,workspace,weight_layers[1]);
+    }
+
+    neuron_layers[0] = input;
     for(size_t n_layer = 1; n_layer < neuron_layers.size(); n_layer++)
     {
-        Matrix intermediate = weight_layers[n_layer].dot(neuron_layers[n_layer-1]) + bias_layers[n_layer];
-        neuron_layers[n_layer] = intermediate;
-        sigmoid(neuron_layers[n_layer]); 
-        intermediates.push_back(intermediate);
+        neuron_layers[n_layer] = workspace.activations[n_layer];
     }
+}
 
+// derivative = f'(x) computed from activation = f(x)
+static void activation_derivative(ActivationKind kind, const Matrix& activation, Matrix& derivative)
+{
+    derivative.resize(activation.get_width(),activation.get_height());
+    activation_derivative_kernel(kind,activation.get_data().data(),derivative.get_data().data(),activation.get_data().size());
+}
 
-    // actual backward propagation
-    Matrix sig_der(intermediates.back());
-    sigmoid_derivative(sig_der);
-    Matrix delta = (neuron_layers.back() - desired) * sig_der;
+// only writes to the workspace so multiple threads can run it at the same time
+void NeuralNet::backpropagate_batch(ConstMatrixView inputs, ConstMatrixView desired, TrainingWorkspace& workspace,
+                                    const Matrix& first_weights)
+{
+    PhaseTimer timer(profiling ? &workspace.profile : nullptr);
+    size_t n = inputs.get_width();
 
-    bias_delta.back() = delta;
-    weight_delta.back() = delta.dot(neuron_layers[neuron_layers.size()-2].transpose());
-    
-    for(size_t n_layer = neuron_layers.size()-2; n_layer >= 1; n_layer--)
+    // feed forward, every column of inputs is one sample
+    for(size_t n_layer = 1; n_layer < neuron_layers.size(); n_layer++)
     {
-        Matrix intermediate(intermediates[n_layer-1]);
-        sig_der = intermediate;
-        sigmoid_derivative(sig_der);
+        ConstMatrixView previous = (n_layer == 1) ? inputs : workspace.activations[n_layer-1].view();
+        const Matrix& weights = (n_layer == 1) ? first_weights : weight_layers[n_layer];
+        size_t in_size = previous.get_height();
+        size_t out_size = weights.get_height();
+        weights.dot(previous,workspace.activations[n_layer]);
+        timer.lap(n_layer,ProfilePhase::forward_gemm,forward_flops(in_size,out_size,n),forward_bytes(in_size,out_size,n));
+        add_bias_and_activate(workspace.activations[n_layer],bias_layers[n_layer],activation_layers[n_layer]);
+        timer.lap(n_layer,ProfilePhase::bias_activation,activation_flops(activation_layers[n_layer],out_size,n),
+                  activation_bytes(out_size,n));
+    }
 
-        delta = weight_layers[n_layer+1].transpose().dot(delta) * sig_der;
-        bias_delta[n_layer] = delta;
+    // actual backward propagation, the bias gradients are summed over the samples (columns)
+    // and delta * activations^T sums the per sample outer products into the weight gradients in a single product
+    // delta is the negative gradient of the cost over the layer's inputs, process_batch adds it to the weights,
+    // the activation derivatives come from the stored activations
+    size_t last = neuron_layers.size()-1;
+    activation_derivative(activation_layers[last],workspace.activations[last],workspace.derivative);
+    workspace.delta = (desired - workspace.activations[last]) * workspace.derivative;
+    double outputs = workspace.delta.get_data().size();
+    timer.lap(last,ProfilePhase::backward_delta,4.0 * outputs,16.0 * outputs);
+
+    for(size_t n_layer = last; n_layer >= 1; n_layer--)
+    {
+        ConstMatrixView previous = (n_layer == 1) ? inputs : workspace.activations[n_layer-1].view();
+        size_t in_size = previous.get_height();
+        size_t out_size = weight_layers[n_layer].get_height();
+        workspace.delta.row_sums(workspace.bias_gradient[n_layer]);
+        workspace.delta.dot_nt(previous,workspace.weight_gradient[n_layer]);
+        timer.lap(n_layer,ProfilePhase::weight_gradient,
+                  forward_flops(in_size,out_size,n) + out_size * n,
+                  forward_bytes(in_size,out_size,n) + 4.0 * out_size);
+        if(n_layer == 1){
+            break;
+        }
 
-        weight_delta[n_layer] = delta.dot(neuron_layers[n_layer-1].transpose());
+        // the error of layer n_layer-1 comes from the weights of this layer
+        weight_layers[n_layer].dot_tn(workspace.delta,workspace.next_delta);
+        activation_derivative(activation_layers[n_layer-1],workspace.activations[n_layer-1],workspace.derivative);
+        workspace.delta = workspace.next_delta * workspace.derivative;
+        timer.lap(n_layer-1,ProfilePhase::backward_delta,
+                  forward_flops(out_size,in_size,n) + 3.0 * in_size * n,
+                  forward_bytes(out_size,in_size,n) + 16.0 * in_size * n);
+    }
+}
+
+void NeuralNet::set_profiling(bool enabled)
+{
+    profiling = enabled;
+}
+
+bool NeuralNet::get_profiling() const
+{
+    return profiling;
+}
+
+LayerProfile NeuralNet::get_profile() const
+{
+    LayerProfile sum = profile;
+    for(const TrainingWorkspace& workspace : thread_workspaces)
+    {
+        sum.merge(workspace.profile);
+    }
+    return sum;
+}
+
+void NeuralNet::reset_profile()
+{
+    profile.clear();
+    for(TrainingWorkspace& workspace : thread_workspaces)
+    {
+        workspace.profile.clear();
     }
 }
 
-float NeuralNet::calculate_cost(const Matrix& desired)
+void NeuralNet::set_sparse_input_threshold(float density)
+{
+    if(density < 0 || density > 1){
+        throw std::invalid_argument("sparse input threshold must be a fraction between 0 and 1");
+    }
+    sparse_input_threshold = density;
+}
+
+float NeuralNet::get_sparse_input_threshold() const
+{
+    return sparse_input_threshold;
+}
+
+const SparseInputStats& NeuralNet::get_sparse_input_stats() const
+{
+    return sparse_stats;
+}
+
+void NeuralNet::reset_sparse_input_stats()
+{
+    sparse_stats = SparseInputStats();
+}
+
+// the layers n_layer refers to, 0 is all of them
+static std::pair<size_t,size_t> pruning_layers(size_t n_layer, size_t layer_count)
+{
+    if(n_layer == 0){
+        return {1,layer_count};
+    }
+    if(n_layer >= layer_count){
+        throw std::invalid_argument("layer " + std::to_string(n_layer) + " out of range");
+    }
+    return {n_layer,n_layer + 1};
+}
+
+size_t NeuralNet::prune_weights(float threshold, size_t n_layer)
+{
+    auto range = pruning_layers(n_layer,neuron_layers.size());
+    size_t pruned = 0;
+    for(size_t n = range.first; n < range.second; n++)
+    {
+        Matrix& weights = weight_layers[n];
+        Matrix& mask = weight_masks[n];
+        if(mask.get_width() == 0){
+            mask = Matrix(weights.get_width(),weights.get_height());
+            mask.view().fill(1.0f);
+        }
+        MatrixStorage& values = weights.get_data();
+        MatrixStorage& kept = mask.get_data();
+        for(size_t i = 0; i < values.size(); i++)
+        {
+            kept[i] = (kept[i] != 0.0f && std::abs(values[i]) >= threshold) ? 1.0f : 0.0f;
+            values[i] *= kept[i];
+            pruned += (kept[i] == 0.0f);
+        }
+    }
+    return pruned;
+}
+
+float NeuralNet::pruning_threshold(float density, size_t n_layer) const
+{
+    if(density < 0 || density > 1){
+        throw std::invalid_argument("density must be a fraction between 0 and 1");
+    }
+    auto range = pruning_layers(n_layer,neuron_layers.size());
+    std::vector<float> magnitudes;
+    for(size_t n = range.first; n < range.second; n++)
+    {
+        for(float value : weight_layers[n].get_data()){
+            magnitudes.push_back(std::abs(value));
+        }
+    }
+    size_t keep = static_cast<size_t>(density * magnitudes.size() + 0.5);
+    if(keep == 0){
+        return std::numeric_limits<float>::infinity();
+    }
+    // the keep-th largest magnitude, weights at least that large are kept
+    std::nth_element(magnitudes.begin(),magnitudes.begin() + (keep - 1),magnitudes.end(),std::greater<float>());
+    return magnitudes[keep - 1];
+}
+
+void NeuralNet::clear_pruning()
+{
+    for(Matrix& mask : weight_masks){
+        mask = Matrix();
+    }
+}
+
+float NeuralNet::get_weight_density(size_t n_layer) const
+{
+    auto range = pruning_layers(n_layer,neuron_layers.size());
+    size_t non_zero = 0;
+    size_t total = 0;
+    for(size_t n = range.first; n < range.second; n++)
+    {
+        for(float value : weight_layers[n].get_data()){
+            non_zero += (value != 0.0f);
+        }
+        total += weight_layers[n].get_data().size();
+    }
+    return total ? float(non_zero) / total : 0.0f;
+}
+
+float NeuralNet::calculate_cost(ConstMatrixView desired)
 {
     return (neuron_layers.back() - desired).sum();
 }
 
 void NeuralNet::set_layer_neurons(size_t n_layer, const Matrix& mat)
 {
-    neuron_layers.at(n_layer) = mat;
+    neuron_layers.at(n_layer) = mat.view();
 }
 
 void NeuralNet::set_layer_weights(size_t n_layer, const Matrix& mat)
 {
-    weight_layers.at(n_layer) = mat;
+    weight_layers.at(n_layer) = mat.view();
+    weight_masks.at(n_layer) = Matrix(); // new weights, nothing pruned
 }
 
 void NeuralNet::set_layer_bias(size_t n_layer, const Matrix& mat)
 {
-    bias_layers.at(n_layer) = mat;
+    bias_layers.at(n_layer) = mat.view();
 }
 
-const Matrix& NeuralNet::get_layer_neurons(size_t n_layer)
+size_t NeuralNet::get_layer_count() const
+{
+    return neuron_layers.size();
+}
+
+const Matrix& NeuralNet::get_layer_neurons(size_t n_layer) const
 {
     return neuron_layers.at(n_layer);
 }
 
-const Matrix& NeuralNet::get_layer_weights(size_t n_layer)
+const Matrix& NeuralNet::get_layer_weights(size_t n_layer) const
 {
     return weight_layers.at(n_layer);
 }
 
-const Matrix& NeuralNet::get_layer_bias(size_t n_layer)
+const Matrix& NeuralNet::get_layer_bias(size_t n_layer) const
 {
     return bias_layers.at(n_layer);
 }
 
+ActivationKind NeuralNet::get_layer_activation(size_t n_layer) const
+{
+    return activation_layers.at(n_layer);
+}
+
 std::string NeuralNet::to_str()
 {
     std::string str("");
@@ -230,6 +778,12 @@ std::string NeuralNet::to_str()
         }
     }
 
+    // activations, older strings without them load as sigmoid
+    for(size_t n_layer = 1; n_layer < activation_layers.size(); n_layer++)
+    {
+        str += "activation " + std::to_string(n_layer) + " " + activation_name(activation_layers[n_layer]) + "\n";
+    }
+
     // weight data
     for(size_t n_layer = 0; n_layer < weight_layers.size(); n_layer++)
     {
@@ -288,6 +842,25 @@ void NeuralNet::from_str(const std::string& str)
             buf = "";
         }
 
+        // activation info
+        if(buf == "activation "){
+            buf = "";
+            n_char++;
+            while(str.at(n_char) != ' '){
+                buf += str.at(n_char);
+                n_char++;
+            }
+            size_t layer_index = std::stoi(buf);
+            buf = "";
+            n_char++;
+            while(str.at(n_char) != '\n'){
+                buf += str.at(n_char);
+                n_char++;
+            }
+            activation_layers.at(layer_index) = activation_from_name(buf);
+            buf = "";
+        }
+
         // weight info
         if(buf == "weight "){
             buf = "";
@@ -309,6 +882,9 @@ void NeuralNet::from_str(const std::string& str)
                 buf += str.at(n_char);
                 n_char++;
             }
+            if(buf.size() > 1){
+                layer_data.push_back(std::stof(buf)); // the last value ends with the line, not a space
+            }
             weight_layers.at(layer_index).set_data(layer_data);
             buf = "";
         }
@@ -334,8 +910,59 @@ void NeuralNet::from_str(const std::string& str)
                 buf += str.at(n_char);
                 n_char++;
             }
+            if(buf.size() > 1){
+                layer_data.push_back(std::stof(buf)); // the last value ends with the line, not a space
+            }
             bias_layers.at(layer_index).set_data(layer_data);
             buf = "";
         }
     }
+}
+
+void NeuralNet::save(const std::string& path, ModelDataType weight_type) const
+{
+    std::vector<size_t> topology;
+    std::vector<const float*> weights;
+    std::vector<const float*> biases;
+    for(size_t n_layer = 0; n_layer < neuron_layers.size(); n_layer++)
+    {
+        topology.push_back(neuron_layers[n_layer].get_height());
+        weights.push_back(weight_layers[n_layer].get_data().data());
+        biases.push_back(bias_layers[n_layer].get_data().data());
+    }
+    write_model_file(path,topology,weights,biases,weight_type,activation_layers);
+}
+
+void NeuralNet::load(const std::string& path)
+{
+    MappedModel model(path,true);
+
+    neuron_layers.clear();
+    weight_layers.clear();
+    bias_layers.clear();
+    error_layers.clear();
+    weight_masks.clear();
+    activation_layers.clear();
+    thread_workspaces.clear();
+    optimizer.reset();
+
+    for(size_t n_layer = 0; n_layer < model.get_layer_count(); n_layer++)
+    {
+        add_layer(model.get_layer_size(n_layer),model.get_layer_activation(n_layer));
+        if(n_layer == 0){
+            continue;
+        }
+        MatrixStorage& weights = weight_layers[n_layer].get_data();
+        MatrixStorage& bias = bias_layers[n_layer].get_data();
+        const float* bias_block = model.get_layer_bias(n_layer);
+        if(model.get_data_type() == ModelDataType::float32){
+            const float* weight_block = model.get_layer_weights(n_layer);
+            weights.assign(weight_block,weight_block + weights.size());
+        }else{
+            // training needs float32 weights, the halves are widened exactly
+            half_to_float(static_cast<const uint16_t*>(model.get_layer_weight_data(n_layer)),weights.data(),
+                          weights.size(),model_data_type_half_format(model.get_data_type()));
+        }
+        bias.assign(bias_block,bias_block + bias.size());
+    }
 }
\ No newline at end of file
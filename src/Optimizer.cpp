@@ -0,0 +1,517 @@
+#include "Optimizer.hpp"
+#include "Gemm.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OPTIMIZER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// everything a rule needs for one step, worked out once per update
+struct StepConstants{
+    float factor;        // learning rate / batch size
+    float scale;         // 1 / batch size, the mean gradient d = g * scale
+    float learning_rate;
+    float momentum;
+    float decay;         // of the second moment, rms_decay or beta2
+    float beta1;
+    float step_size;     // adam, learning rate / (1 - beta1^t)
+    float correction;    // adam, 1 / sqrt(1 - beta2^t)
+    float epsilon;
+};
+
+// ---------------------------------------------------------------- rules
+//
+// Every rule is a struct with the update of one float, one avx2 and one avx512 vector: it takes the
+// parameter and the summed gradient, updates its state in place and returns the new parameter.
+// uses_first / uses_second tell which state buffers it has. The kernels below are templates over
+// the rules, so the rule is picked once per update and the loops have no branches.
+
+struct Sgd{
+    static const bool uses_first = false;
+    static const bool uses_second = false;
+    // p + g * factor, the same arithmetic as the plain update before the optimizers
+    static float scalar(const StepConstants& c, float p, float g, float&, float&) { return p + g * c.factor; }
+#ifdef OPTIMIZER_X86
+    __attribute__((target("avx2,fma")))
+    static __m256 avx2(const StepConstants& c, __m256 p, __m256 g, __m256&, __m256&)
+    {
+        return _mm256_add_ps(p, _mm256_mul_ps(g, _mm256_set1_ps(c.factor)));
+    }
+    __attribute__((target("avx512f")))
+    static __m512 avx512(const StepConstants& c, __m512 p, __m512 g, __m512&, __m512&)
+    {
+        return _mm512_add_ps(p, _mm512_mul_ps(g, _mm512_set1_ps(c.factor)));
+    }
+#endif
+};
+
+struct Momentum{
+    static const bool uses_first = true;
+    static const bool uses_second = false;
+    static float scalar(const StepConstants& c, float p, float g, float& v, float&)
+    {
+        v = c.momentum * v + g * c.scale;
+        return p + c.learning_rate * v;
+    }
+#ifdef OPTIMIZER_X86
+    __attribute__((target("avx2,fma")))
+    static __m256 avx2(const StepConstants& c, __m256 p, __m256 g, __m256& v, __m256&)
+    {
+        v = _mm256_fmadd_ps(_mm256_set1_ps(c.momentum), v, _mm256_mul_ps(g, _mm256_set1_ps(c.scale)));
+        return _mm256_fmadd_ps(_mm256_set1_ps(c.learning_rate), v, p);
+    }
+    __attribute__((target("avx512f")))
+    static __m512 avx512(const StepConstants& c, __m512 p, __m512 g, __m512& v, __m512&)
+    {
+        v = _mm512_fmadd_ps(_mm512_set1_ps(c.momentum), v, _mm512_mul_ps(g, _mm512_set1_ps(c.scale)));
+        return _mm512_fmadd_ps(_mm512_set1_ps(c.learning_rate), v, p);
+    }
+#endif
+};
+
+// the step looks ahead along the new velocity: d + momentum * v instead of v
+struct Nesterov{
+    static const bool uses_first = true;
+    static const bool uses_second = false;
+    static float scalar(const StepConstants& c, float p, float g, float& v, float&)
+    {
+        float d = g * c.scale;
+        v = c.momentum * v + d;
+        return p + c.learning_rate * (d + c.momentum * v);
+    }
+#ifdef OPTIMIZER_X86
+    __attribute__((target("avx2,fma")))
+    static __m256 avx2(const StepConstants& c, __m256 p, __m256 g, __m256& v, __m256&)
+    {
+        __m256 momentum = _mm256_set1_ps(c.momentum);
+        __m256 d = _mm256_mul_ps(g, _mm256_set1_ps(c.scale));
+        v = _mm256_fmadd_ps(momentum, v, d);
+        return _mm256_fmadd_ps(_mm256_set1_ps(c.learning_rate), _mm256_fmadd_ps(momentum, v, d), p);
+    }
+    __attribute__((target("avx512f")))
+    static __m512 avx512(const StepConstants& c, __m512 p, __m512 g, __m512& v, __m512&)
+    {
+        __m512 momentum = _mm512_set1_ps(c.momentum);
+        __m512 d = _mm512_mul_ps(g, _mm512_set1_ps(c.scale));
+        v = _mm512_fmadd_ps(momentum, v, d);
+        return _mm512_fmadd_ps(_mm512_set1_ps(c.learning_rate), _mm512_fmadd_ps(momentum, v, d), p);
+    }
+#endif
+};
+
+struct RmsProp{
+    static const bool uses_first = false;
+    static const bool uses_second = true;
+    static float scalar(const StepConstants& c, float p, float g, float&, float& s)
+    {
+        float d = g * c.scale;
+        s = c.decay * s + (1 - c.decay) * d * d;
+        return p + c.learning_rate * d / (std::sqrt(s) + c.epsilon);
+    }
+#ifdef OPTIMIZER_X86
+    __attribute__((target("avx2,fma")))
+    static __m256 avx2(const StepConstants& c, __m256 p, __m256 g, __m256&, __m256& s)
+    {
+        __m256 d = _mm256_mul_ps(g, _mm256_set1_ps(c.scale));
+        s = _mm256_fmadd_ps(_mm256_set1_ps(c.decay), s, _mm256_mul_ps(_mm256_set1_ps(1 - c.decay), _mm256_mul_ps(d, d)));
+        __m256 denominator = _mm256_add_ps(_mm256_sqrt_ps(s), _mm256_set1_ps(c.epsilon));
+        return _mm256_fmadd_ps(_mm256_set1_ps(c.learning_rate), _mm256_div_ps(d, denominator), p);
+    }
+    __attribute__((target("avx512f")))
+    static __m512 avx512(const StepConstants& c, __m512 p, __m512 g, __m512&, __m512& s)
+    {
+        __m512 d = _mm512_mul_ps(g, _mm512_set1_ps(c.scale));
+        s = _mm512_fmadd_ps(_mm512_set1_ps(c.decay), s, _mm512_mul_ps(_mm512_set1_ps(1 - c.decay), _mm512_mul_ps(d, d)));
+        __m512 denominator = _mm512_add_ps(_mm512_sqrt_ps(s), _mm512_set1_ps(c.epsilon));
+        return _mm512_fmadd_ps(_mm512_set1_ps(c.learning_rate), _mm512_div_ps(d, denominator), p);
+    }
+#endif
+};
+
+// m_hat = m / (1 - beta1^t) and sqrt(s_hat) = sqrt(s) / sqrt(1 - beta2^t) are folded into step_size and correction
+struct Adam{
+    static const bool uses_first = true;
+    static const bool uses_second = true;
+    static float scalar(const StepConstants& c, float p, float g, float& m, float& s)
+    {
+        float d = g * c.scale;
+        m = c.beta1 * m + (1 - c.beta1) * d;
+        s = c.decay * s + (1 - c.decay) * d * d;
+        return p + c.step_size * m / (std::sqrt(s) * c.correction + c.epsilon);
+    }
+#ifdef OPTIMIZER_X86
+    __attribute__((target("avx2,fma")))
+    static __m256 avx2(const StepConstants& c, __m256 p, __m256 g, __m256& m, __m256& s)
+    {
+        __m256 d = _mm256_mul_ps(g, _mm256_set1_ps(c.scale));
+        m = _mm256_fmadd_ps(_mm256_set1_ps(c.beta1), m, _mm256_mul_ps(_mm256_set1_ps(1 - c.beta1), d));
+        s = _mm256_fmadd_ps(_mm256_set1_ps(c.decay), s, _mm256_mul_ps(_mm256_set1_ps(1 - c.decay), _mm256_mul_ps(d, d)));
+        __m256 denominator = _mm256_fmadd_ps(_mm256_sqrt_ps(s), _mm256_set1_ps(c.correction), _mm256_set1_ps(c.epsilon));
+        return _mm256_fmadd_ps(_mm256_set1_ps(c.step_size), _mm256_div_ps(m, denominator), p);
+    }
+    __attribute__((target("avx512f")))
+    static __m512 avx512(const StepConstants& c, __m512 p, __m512 g, __m512& m, __m512& s)
+    {
+        __m512 d = _mm512_mul_ps(g, _mm512_set1_ps(c.scale));
+        m = _mm512_fmadd_ps(_mm512_set1_ps(c.beta1), m, _mm512_mul_ps(_mm512_set1_ps(1 - c.beta1), d));
+        s = _mm512_fmadd_ps(_mm512_set1_ps(c.decay), s, _mm512_mul_ps(_mm512_set1_ps(1 - c.decay), _mm512_mul_ps(d, d)));
+        __m512 denominator = _mm512_fmadd_ps(_mm512_sqrt_ps(s), _mm512_set1_ps(c.correction), _mm512_set1_ps(c.epsilon));
+        return _mm512_fmadd_ps(_mm512_set1_ps(c.step_size), _mm512_div_ps(m, denominator), p);
+    }
+#endif
+};
+
+// ---------------------------------------------------------------- kernels
+//
+// params[i] = rule(params[i], gradient[i]) * mask[i], first and second are the rule's state
+// (null when it has none), mask may be null
+
+typedef void (*StepKernel)(const StepConstants& c, float* params, const float* gradient,
+                           float* first, float* second, const float* mask, size_t count);
+
+template<typename R>
+void step_scalar(const StepConstants& c, float* params, const float* gradient,
+                 float* first, float* second, const float* mask, size_t count)
+{
+    float unused = 0.0f;
+    for(size_t i = 0; i < count; i++)
+    {
+        float& f = R::uses_first ? first[i] : unused;
+        float& s = R::uses_second ? second[i] : unused;
+        float p = R::scalar(c, params[i], gradient[i], f, s);
+        params[i] = mask ? p * mask[i] : p;
+    }
+}
+
+// a few of the given columns of every row, gathered one by one, the rules' scalar form is all it needs
+template<typename R>
+void step_columns(const StepConstants& c, float* params, size_t stride, const float* gradient, size_t gradient_stride,
+                  float* first, float* second, const float* mask, size_t mask_stride, size_t width,
+                  const std::vector<uint32_t>& columns, size_t rows)
+{
+    float unused = 0.0f;
+    for(size_t y = 0; y < rows; y++)
+    {
+        const float* row_gradient = gradient + y * gradient_stride;
+        for(size_t i = 0; i < columns.size(); i++)
+        {
+            size_t x = columns[i];
+            size_t state = y * width + x;
+            float& f = R::uses_first ? first[state] : unused;
+            float& s = R::uses_second ? second[state] : unused;
+            float p = R::scalar(c, params[y * stride + x], row_gradient[i], f, s);
+            params[y * stride + x] = mask ? p * mask[y * mask_stride + x] : p;
+        }
+    }
+}
+
+#ifdef OPTIMIZER_X86
+
+template<typename R>
+__attribute__((target("avx2,fma")))
+void step_avx2(const StepConstants& c, float* params, const float* gradient,
+               float* first, float* second, const float* mask, size_t count)
+{
+    __m256 f = _mm256_setzero_ps();
+    __m256 s = _mm256_setzero_ps();
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        if(R::uses_first){
+            f = _mm256_loadu_ps(first + i);
+        }
+        if(R::uses_second){
+            s = _mm256_loadu_ps(second + i);
+        }
+        __m256 p = R::avx2(c, _mm256_loadu_ps(params + i), _mm256_loadu_ps(gradient + i), f, s);
+        if(mask){
+            p = _mm256_mul_ps(p, _mm256_loadu_ps(mask + i));
+        }
+        _mm256_storeu_ps(params + i, p);
+        if(R::uses_first){
+            _mm256_storeu_ps(first + i, f);
+        }
+        if(R::uses_second){
+            _mm256_storeu_ps(second + i, s);
+        }
+    }
+    if(i < count){
+        // tail through buffers so every element sees the same arithmetic, padding gradients are 0
+        size_t rest = count - i;
+        alignas(32) float tail_params[8] = {};
+        alignas(32) float tail_gradient[8] = {};
+        alignas(32) float tail_first[8] = {};
+        alignas(32) float tail_second[8] = {};
+        alignas(32) float tail_mask[8] = {1, 1, 1, 1, 1, 1, 1, 1};
+        std::copy(params + i, params + count, tail_params);
+        std::copy(gradient + i, gradient + count, tail_gradient);
+        if(R::uses_first){
+            std::copy(first + i, first + count, tail_first);
+        }
+        if(R::uses_second){
+            std::copy(second + i, second + count, tail_second);
+        }
+        if(mask){
+            std::copy(mask + i, mask + count, tail_mask);
+        }
+        step_avx2<R>(c, tail_params, tail_gradient, tail_first, tail_second, tail_mask, 8);
+        std::copy(tail_params, tail_params + rest, params + i);
+        if(R::uses_first){
+            std::copy(tail_first, tail_first + rest, first + i);
+        }
+        if(R::uses_second){
+            std::copy(tail_second, tail_second + rest, second + i);
+        }
+    }
+}
+
+template<typename R>
+__attribute__((target("avx512f")))
+void step_avx512(const StepConstants& c, float* params, const float* gradient,
+                 float* first, float* second, const float* mask, size_t count)
+{
+    __m512 f = _mm512_setzero_ps();
+    __m512 s = _mm512_setzero_ps();
+    for(size_t i = 0; i < count; i += 16)
+    {
+        __mmask16 lanes = (count - i >= 16) ? 0xFFFF : static_cast<__mmask16>((1u << (count - i)) - 1);
+        if(R::uses_first){
+            f = _mm512_maskz_loadu_ps(lanes, first + i);
+        }
+        if(R::uses_second){
+            s = _mm512_maskz_loadu_ps(lanes, second + i);
+        }
+        __m512 p = R::avx512(c, _mm512_maskz_loadu_ps(lanes, params + i), _mm512_maskz_loadu_ps(lanes, gradient + i), f, s);
+        if(mask){
+            p = _mm512_mul_ps(p, _mm512_maskz_loadu_ps(lanes, mask + i));
+        }
+        _mm512_mask_storeu_ps(params + i, lanes, p);
+        if(R::uses_first){
+            _mm512_mask_storeu_ps(first + i, lanes, f);
+        }
+        if(R::uses_second){
+            _mm512_mask_storeu_ps(second + i, lanes, s);
+        }
+    }
+}
+
+#endif
+
+typedef void (*ColumnKernel)(const StepConstants& c, float* params, size_t stride, const float* gradient, size_t gradient_stride,
+                             float* first, float* second, const float* mask, size_t mask_stride, size_t width,
+                             const std::vector<uint32_t>& columns, size_t rows);
+
+struct StepKernels{
+    StepKernel step;
+    ColumnKernel columns;
+};
+
+template<typename R>
+StepKernels kernels_for_isa()
+{
+#ifdef OPTIMIZER_X86
+    return {gemm_isa_select<StepKernel>(step_scalar<R>, step_avx2<R>, step_avx512<R>), step_columns<R>};
+#else
+    return {step_scalar<R>, step_columns<R>};
+#endif
+}
+
+StepKernels kernels_for(OptimizerKind kind)
+{
+    switch(kind){
+        case OptimizerKind::sgd: return kernels_for_isa<Sgd>();
+        case OptimizerKind::momentum: return kernels_for_isa<Momentum>();
+        case OptimizerKind::nesterov: return kernels_for_isa<Nesterov>();
+        case OptimizerKind::rmsprop: return kernels_for_isa<RmsProp>();
+        case OptimizerKind::adam: return kernels_for_isa<Adam>();
+    }
+    throw std::invalid_argument("unknown optimizer " + std::to_string(static_cast<int>(kind)));
+}
+
+bool uses_first(OptimizerKind kind)
+{
+    return kind == OptimizerKind::momentum || kind == OptimizerKind::nesterov || kind == OptimizerKind::adam;
+}
+
+bool uses_second(OptimizerKind kind)
+{
+    return kind == OptimizerKind::rmsprop || kind == OptimizerKind::adam;
+}
+
+StepConstants step_constants(const OptimizerSettings& settings, size_t step, float learning_rate, size_t batch_size)
+{
+    StepConstants c;
+    c.factor = learning_rate / batch_size;
+    c.scale = 1.0f / batch_size;
+    c.learning_rate = learning_rate;
+    c.momentum = settings.momentum;
+    c.decay = (settings.kind == OptimizerKind::rmsprop) ? settings.rms_decay : settings.beta2;
+    c.beta1 = settings.beta1;
+    // step is at least 1 once next_step() ran, a missing call counts as the first step
+    double t = static_cast<double>(std::max<size_t>(step,1));
+    c.step_size = static_cast<float>(learning_rate / (1 - std::pow((double)settings.beta1, t)));
+    c.correction = static_cast<float>(1 / std::sqrt(1 - std::pow((double)settings.beta2, t)));
+    c.epsilon = settings.epsilon;
+    return c;
+}
+
+void check_mask(ConstMatrixView params, const Matrix* mask)
+{
+    if(mask && (mask->get_width() != params.get_width() || mask->get_height() != params.get_height())){
+        std::cout << "A shape:" << params.shape_str() << std::endl;
+        std::cout << "B shape:" << mask->shape_str() << std::endl;
+        throw std::invalid_argument("mask must have the shape of the parameters");
+    }
+}
+
+const char* const OPTIMIZER_NAMES[] = {"sgd", "momentum", "nesterov", "rmsprop", "adam"};
+
+}
+
+const char* optimizer_name(OptimizerKind kind)
+{
+    if(static_cast<size_t>(kind) > static_cast<size_t>(OptimizerKind::adam)){
+        throw std::invalid_argument("unknown optimizer " + std::to_string(static_cast<int>(kind)));
+    }
+    return OPTIMIZER_NAMES[static_cast<size_t>(kind)];
+}
+
+Optimizer::Optimizer(const OptimizerSettings& settings)
+:settings(settings),step(0)
+{
+    if(settings.momentum < 0 || settings.momentum >= 1 || settings.rms_decay < 0 || settings.rms_decay >= 1 ||
+       settings.beta1 < 0 || settings.beta1 >= 1 || settings.beta2 < 0 || settings.beta2 >= 1){
+        throw std::invalid_argument("optimizer momentum and decay rates must be in [0, 1)");
+    }
+    kernels_for(settings.kind); // throws for unknown kinds
+}
+
+const OptimizerSettings& Optimizer::get_settings() const
+{
+    return settings;
+}
+
+void Optimizer::next_step()
+{
+    step++;
+}
+
+size_t Optimizer::get_step() const
+{
+    return step;
+}
+
+Optimizer::State& Optimizer::get_state(size_t slot, size_t count)
+{
+    if(states.size() <= slot){
+        states.resize(slot + 1);
+    }
+    State& state = states[slot];
+    if(uses_first(settings.kind) && state.first.size() != count){
+        state.first.assign(count,0.0f);
+    }
+    if(uses_second(settings.kind) && state.second.size() != count){
+        state.second.assign(count,0.0f);
+    }
+    return state;
+}
+
+void Optimizer::update(size_t slot, float learning_rate, size_t batch_size, MatrixView params,
+                       ConstMatrixView gradient, const Matrix* mask)
+{
+    if(params.get_width() != gradient.get_width() || params.get_height() != gradient.get_height()){
+        std::cout << "A shape:" << params.shape_str() << std::endl;
+        std::cout << "B shape:" << gradient.shape_str() << std::endl;
+        throw std::invalid_argument("parameters and gradient must have the same shape");
+    }
+    check_mask(params,mask);
+    size_t width = params.get_width();
+    size_t height = params.get_height();
+    State& state = get_state(slot,width * height);
+    StepConstants c = step_constants(settings,step,learning_rate,batch_size);
+    StepKernel kernel = kernels_for(settings.kind).step;
+    float* first = state.first.empty() ? nullptr : state.first.data();
+    float* second = state.second.empty() ? nullptr : state.second.data();
+    const float* mask_data = mask ? mask->get_data().data() : nullptr;
+
+    // the state is unpadded, contiguous matrices (all of NeuralNet's) are a single pass
+    bool contiguous = params.get_stride() == width && gradient.get_stride() == width && (!mask || mask->get_stride() == width);
+    if(contiguous){
+        kernel(c,params.get_data(),gradient.get_data(),first,second,mask_data,width * height);
+        return;
+    }
+    for(size_t y = 0; y < height; y++)
+    {
+        kernel(c,params.get_data() + y * params.get_stride(),gradient.get_data() + y * gradient.get_stride(),
+               first ? first + y * width : nullptr,second ? second + y * width : nullptr,
+               mask_data ? mask_data + y * mask->get_stride() : nullptr,width);
+    }
+}
+
+void Optimizer::update_columns(size_t slot, float learning_rate, size_t batch_size, MatrixView params,
+                               ConstMatrixView gradient, const std::vector<uint32_t>& columns, const Matrix* mask)
+{
+    if(gradient.get_width() != columns.size() || gradient.get_height() != params.get_height()){
+        std::cout << "A shape:" << params.shape_str() << std::endl;
+        std::cout << "B shape:" << gradient.shape_str() << std::endl;
+        throw std::invalid_argument("gradient must have a column per index and the height of the parameters");
+    }
+    check_mask(params,mask);
+    size_t width = params.get_width();
+    State& state = get_state(slot,width * params.get_height());
+    StepConstants c = step_constants(settings,step,learning_rate,batch_size);
+    kernels_for(settings.kind).columns(c,params.get_data(),params.get_stride(),gradient.get_data(),gradient.get_stride(),
+                                       state.first.empty() ? nullptr : state.first.data(),
+                                       state.second.empty() ? nullptr : state.second.data(),
+                                       mask ? mask->get_data().data() : nullptr,mask ? mask->get_stride() : 0,
+                                       width,columns,params.get_height());
+}
+
+void Optimizer::reset()
+{
+    states.clear();
+    step = 0;
+}
+
+size_t Optimizer::get_state_bytes() const
+{
+    size_t bytes = 0;
+    for(const State& state : states)
+    {
+        bytes += (state.first.size() + state.second.size()) * sizeof(float);
+    }
+    return bytes;
+}
+
+double Optimizer::get_flops_per_parameter() const
+{
+    switch(settings.kind){
+        case OptimizerKind::sgd: return 2;
+        case OptimizerKind::momentum: return 5;
+        case OptimizerKind::nesterov: return 7;
+        case OptimizerKind::rmsprop: return 9; // sqrt and division count 1
+        case OptimizerKind::adam: return 13;
+    }
+    return 0;
+}
+
+double Optimizer::get_bytes_per_parameter() const
+{
+    // parameter read and written, gradient read, every state buffer read and written
+    return 12.0 + 8.0 * (uses_first(settings.kind) + uses_second(settings.kind));
+}
+
+const char* Optimizer::get_kernel_name()
+{
+#ifdef OPTIMIZER_X86
+    return gemm_isa_select("scalar", "avx2", "avx512");
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,133 @@
+#include "PackedDataset.hpp"
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+static const char PACKED_MAGIC[8] = {'N','N','P','A','C','K','\0','\0'};
+
+PackedDatasetWriter::PackedDatasetWriter(const std::string& path, size_t sample_size)
+:path(path), out(path,std::ios_base::binary), header(), labels({}), crc(0), finished(false)
+{
+    if(!out){
+        throw std::runtime_error("unable to open " + path + " for writing");
+    }
+    std::memcpy(header.magic,PACKED_MAGIC,sizeof(PACKED_MAGIC));
+    header.version = PACKED_DATASET_VERSION;
+    header.alignment = PACKED_DATASET_ALIGNMENT;
+    header.sample_size = sample_size;
+    header.sample_stride = (sample_size * sizeof(float) + PACKED_DATASET_ALIGNMENT - 1) / PACKED_DATASET_ALIGNMENT * PACKED_DATASET_ALIGNMENT;
+    header.sample_offset = sizeof(PackedDatasetHeader);
+
+    // placeholder, the real header is written by finish()
+    out.write(reinterpret_cast<const char*>(&header),sizeof(header));
+}
+
+PackedDatasetWriter::~PackedDatasetWriter()
+{
+    if(!finished){
+        try
+        {
+            finish();
+        }
+        catch(std::exception& e)
+        {
+            std::cerr << "unable to finish " << path << ": " << e.what() << std::endl;
+        }
+    }
+}
+
+void PackedDatasetWriter::add_sample(const float* sample, uint32_t label)
+{
+    if(finished){
+        throw std::logic_error("cannot add samples to a finished packed dataset");
+    }
+    size_t bytes = header.sample_size * sizeof(float);
+    static const char padding[PACKED_DATASET_ALIGNMENT] = {};
+    out.write(reinterpret_cast<const char*>(sample),bytes);
+    out.write(padding,header.sample_stride - bytes);
+    crc = crc32(sample,bytes,crc);
+    crc = crc32(padding,header.sample_stride - bytes,crc);
+    labels.push_back(label);
+}
+
+void PackedDatasetWriter::finish()
+{
+    if(finished){
+        return;
+    }
+    finished = true;
+
+    header.sample_count = labels.size();
+    header.label_offset = header.sample_offset + header.sample_count * header.sample_stride;
+    out.write(reinterpret_cast<const char*>(labels.data()),labels.size() * sizeof(uint32_t));
+    header.checksum = crc32(labels.data(),labels.size() * sizeof(uint32_t),crc);
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header),sizeof(header));
+    out.close();
+    if(!out){
+        throw std::runtime_error("unable to write " + path);
+    }
+}
+
+PackedDataset::PackedDataset(const std::string& path, bool verify_checksum)
+:file(path), header(), labels(nullptr), samples(nullptr)
+{
+    if(file.size() < sizeof(header)){
+        throw std::runtime_error(path + " is too small to be a packed dataset");
+    }
+    std::memcpy(&header,file.data(),sizeof(header));
+    if(std::memcmp(header.magic,PACKED_MAGIC,sizeof(PACKED_MAGIC)) != 0){
+        throw std::runtime_error(path + " is not a packed dataset");
+    }
+    if(header.version != PACKED_DATASET_VERSION){
+        throw std::runtime_error(path + " has unsupported packed dataset version " + std::to_string(header.version));
+    }
+    if(header.alignment != PACKED_DATASET_ALIGNMENT){
+        throw std::runtime_error(path + " has unsupported alignment " + std::to_string(header.alignment));
+    }
+    // sizes from a corrupt file could wrap around, every product and sum is checked
+    uint64_t sample_bytes = 0;
+    uint64_t samples_bytes = 0;
+    uint64_t label_bytes = 0;
+    if(!checked_multiply(header.sample_size,sizeof(float),sample_bytes) || header.sample_stride < sample_bytes ||
+       header.sample_offset % PACKED_DATASET_ALIGNMENT != 0 || header.sample_stride % PACKED_DATASET_ALIGNMENT != 0 ||
+       !checked_multiply(header.sample_count,header.sample_stride,samples_bytes) ||
+       !checked_multiply(header.sample_count,sizeof(uint32_t),label_bytes) ||
+       !block_in_range(header.sample_offset,samples_bytes,file.size()) ||
+       header.label_offset != header.sample_offset + samples_bytes ||
+       !block_in_range(header.label_offset,label_bytes,file.size()) || header.label_offset + label_bytes != file.size()){
+        throw std::runtime_error(path + " is truncated or corrupt");
+    }
+    if(verify_checksum && crc32(file.data() + sizeof(header),file.size() - sizeof(header)) != header.checksum){
+        throw std::runtime_error(path + " checksum mismatch");
+    }
+    samples = file.data() + header.sample_offset;
+    labels = reinterpret_cast<const uint32_t*>(file.data() + header.label_offset);
+}
+
+size_t PackedDataset::size() const
+{
+    return header.sample_count;
+}
+
+size_t PackedDataset::get_sample_size() const
+{
+    return header.sample_size;
+}
+
+const float* PackedDataset::get_sample(size_t index) const
+{
+    if(index >= header.sample_count){
+        throw std::out_of_range("sample index out of range");
+    }
+    return reinterpret_cast<const float*>(samples + index * header.sample_stride);
+}
+
+uint32_t PackedDataset::get_label(size_t index) const
+{
+    if(index >= header.sample_count){
+        throw std::out_of_range("sample index out of range");
+    }
+    return labels[index];
+}
@@ -0,0 +1,414 @@
+#include "QuantizedNet.hpp"
+#include "Activation.hpp"
+#include "Gemm.hpp"
+#include "InferencePlan.hpp"
+#include "ModelComparison.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define QUANTIZED_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const size_t ROW_ALIGNMENT = 64;
+// samples per pass through a layer, every weight load is used for all of them
+const size_t SAMPLES_PER_PASS = 4;
+// weight rows per kernel call, every activation load is used for all of them
+const size_t ROWS_PER_PASS = 4;
+
+// int32 dot products of ROWS_PER_PASS weight rows (ld apart) with SAMPLES_PER_PASS activation
+// vectors, out[row * SAMPLES_PER_PASS + sample]. len is a multiple of ROW_ALIGNMENT.
+typedef void (*DotKernel)(size_t len, const int8_t* w, size_t ld, const uint8_t* const* x, int32_t* out);
+
+void dot_u8s8_scalar(size_t len, const int8_t* w, size_t ld, const uint8_t* const* x, int32_t* out)
+{
+    for(size_t r = 0; r < ROWS_PER_PASS; r++){
+        for(size_t s = 0; s < SAMPLES_PER_PASS; s++){
+            int32_t acc = 0;
+            for(size_t k = 0; k < len; k++){
+                acc += int32_t(x[s][k]) * int32_t(w[r * ld + k]);
+            }
+            out[r * SAMPLES_PER_PASS + s] = acc;
+        }
+    }
+}
+
+#ifdef QUANTIZED_X86
+
+// u8 * s8 pairs can overflow the int16 of maddubs, so both sides are widened to int16 first
+__attribute__((target("avx2")))
+void dot_u8s8_avx2(size_t len, const int8_t* w, size_t ld, const uint8_t* const* x, int32_t* out)
+{
+    __m256i acc[ROWS_PER_PASS][SAMPLES_PER_PASS];
+    for(size_t r = 0; r < ROWS_PER_PASS; r++){
+        for(size_t s = 0; s < SAMPLES_PER_PASS; s++){
+            acc[r][s] = _mm256_setzero_si256();
+        }
+    }
+    for(size_t k = 0; k < len; k += 16){
+        __m256i values[SAMPLES_PER_PASS];
+        for(size_t s = 0; s < SAMPLES_PER_PASS; s++){
+            values[s] = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x[s] + k)));
+        }
+        for(size_t r = 0; r < ROWS_PER_PASS; r++){
+            __m256i weights = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w + r * ld + k)));
+            for(size_t s = 0; s < SAMPLES_PER_PASS; s++){
+                acc[r][s] = _mm256_add_epi32(acc[r][s], _mm256_madd_epi16(values[s], weights));
+            }
+        }
+    }
+    for(size_t r = 0; r < ROWS_PER_PASS; r++){
+        for(size_t s = 0; s < SAMPLES_PER_PASS; s++){
+            __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc[r][s]), _mm256_extracti128_si256(acc[r][s], 1));
+            sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+            sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+            out[r * SAMPLES_PER_PASS + s] = _mm_cvtsi128_si32(sum);
+        }
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void dot_u8s8_avx512bw(size_t len, const int8_t* w, size_t ld, const uint8_t* const* x, int32_t* out)
+{
+    __m512i acc[ROWS_PER_PASS][SAMPLES_PER_PASS];
+    for(size_t r = 0; r < ROWS_PER_PASS; r++){
+        for(size_t s = 0; s < SAMPLES_PER_PASS; s++){
+            acc[r][s] = _mm512_setzero_si512();
+        }
+    }
+    for(size_t k = 0; k < len; k += 32){
+        __m512i values[SAMPLES_PER_PASS];
+        for(size_t s = 0; s < SAMPLES_PER_PASS; s++){
+            values[s] = _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(x[s] + k)));
+        }
+        for(size_t r = 0; r < ROWS_PER_PASS; r++){
+            __m512i weights = _mm512_cvtepi8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + r * ld + k)));
+            for(size_t s = 0; s < SAMPLES_PER_PASS; s++){
+                acc[r][s] = _mm512_add_epi32(acc[r][s], _mm512_madd_epi16(values[s], weights));
+            }
+        }
+    }
+    for(size_t r = 0; r < ROWS_PER_PASS; r++){
+        for(size_t s = 0; s < SAMPLES_PER_PASS; s++){
+            out[r * SAMPLES_PER_PASS + s] = _mm512_reduce_add_epi32(acc[r][s]);
+        }
+    }
+}
+
+// vpdpbusd multiplies u8 by s8 and sums groups of 4 straight into int32, no saturation
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+void dot_u8s8_vnni(size_t len, const int8_t* w, size_t ld, const uint8_t* const* x, int32_t* out)
+{
+    __m512i acc[ROWS_PER_PASS][SAMPLES_PER_PASS];
+    for(size_t r = 0; r < ROWS_PER_PASS; r++){
+        for(size_t s = 0; s < SAMPLES_PER_PASS; s++){
+            acc[r][s] = _mm512_setzero_si512();
+        }
+    }
+    for(size_t k = 0; k < len; k += 64){
+        __m512i values[SAMPLES_PER_PASS];
+        for(size_t s = 0; s < SAMPLES_PER_PASS; s++){
+            values[s] = _mm512_loadu_si512(x[s] + k);
+        }
+        for(size_t r = 0; r < ROWS_PER_PASS; r++){
+            __m512i weights = _mm512_loadu_si512(w + r * ld + k);
+            for(size_t s = 0; s < SAMPLES_PER_PASS; s++){
+                acc[r][s] = _mm512_dpbusd_epi32(acc[r][s], values[s], weights);
+            }
+        }
+    }
+    for(size_t r = 0; r < ROWS_PER_PASS; r++){
+        for(size_t s = 0; s < SAMPLES_PER_PASS; s++){
+            out[r * SAMPLES_PER_PASS + s] = _mm512_reduce_add_epi32(acc[r][s]);
+        }
+    }
+}
+
+#endif
+
+struct DotKernelChoice{
+    DotKernel kernel;
+    const char* name;
+};
+
+struct CpuFeatures{
+    bool avx2 = false;
+    bool avx512bw = false;
+    bool avx512vnni = false;
+    CpuFeatures()
+    {
+#ifdef QUANTIZED_X86
+        __builtin_cpu_init();
+        avx2 = __builtin_cpu_supports("avx2");
+        avx512bw = __builtin_cpu_supports("avx512bw");
+        avx512vnni = __builtin_cpu_supports("avx512vnni");
+#endif
+    }
+};
+
+const CpuFeatures cpu_features;
+
+// the widest kernel the cpu supports
+DotKernelChoice select_kernel()
+{
+    DotKernelChoice scalar = {dot_u8s8_scalar, "scalar"};
+#ifdef QUANTIZED_X86
+    DotKernelChoice avx2 = cpu_features.avx2 ? DotKernelChoice{dot_u8s8_avx2, "avx2"} : scalar;
+    DotKernelChoice avx512 = avx2;
+    if(cpu_features.avx512bw){
+        avx512 = cpu_features.avx512vnni ? DotKernelChoice{dot_u8s8_vnni, "avx512vnni"}
+                                         : DotKernelChoice{dot_u8s8_avx512bw, "avx512bw"};
+    }
+    return gemm_isa_select(scalar, avx2, avx512);
+#else
+    return scalar;
+#endif
+}
+
+size_t padded(size_t len)
+{
+    return (len + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT;
+}
+
+// uint8 quantization covering [min, max], the range is widened to include 0 so 0 stays exact
+void choose_quantization(float min, float max, float& scale, int32_t& zero_point)
+{
+    min = std::min(min, 0.0f);
+    max = std::max(max, 0.0f);
+    scale = (max - min) / 255.0f;
+    if(scale == 0.0f){
+        scale = 1.0f;
+    }
+    zero_point = std::min(255, std::max(0, static_cast<int32_t>(std::lround(-min / scale))));
+}
+
+void quantize(const float* values, size_t count, float scale, int32_t zero_point, uint8_t* out)
+{
+    // clamping before the conversion lets the truncation round (half up) and keeps the loop vectorizable
+    float inverse = 1.0f / scale;
+    float offset = zero_point + 0.5f;
+    for(size_t i = 0; i < count; i++){
+        float q = std::min(255.0f, std::max(0.0f, values[i] * inverse + offset));
+        out[i] = static_cast<uint8_t>(q);
+    }
+}
+
+}
+
+QuantizedNet::QuantizedNet(const NeuralNet& net, const TrainingBatch& calibration)
+{
+    if(net.get_layer_count() < 2){
+        throw std::invalid_argument("quantized net needs at least an input and an output layer");
+    }
+    if(calibration.size() == 0){
+        throw std::invalid_argument("quantization needs calibration samples");
+    }
+
+    // run the calibration samples through the float network and record the range of every layer's input
+    Matrix activations = calibration.get_input_matrix();
+    for(size_t n_layer = 1; n_layer < net.get_layer_count(); n_layer++)
+    {
+        const Matrix& weights = net.get_layer_weights(n_layer);
+        const Matrix& bias = net.get_layer_bias(n_layer);
+        const MatrixStorage& input_values = activations.get_data();
+
+        Layer layer;
+        layer.inputs = weights.get_width();
+        layer.outputs = weights.get_height();
+        layer.stride = padded(layer.inputs);
+        auto range = std::minmax_element(input_values.begin(), input_values.end());
+        choose_quantization(*range.first, *range.second, layer.input_scale, layer.input_zero_point);
+
+        // whole blocks of ROWS_PER_PASS rows, the extra rows stay 0
+        size_t rows = (layer.outputs + ROWS_PER_PASS - 1) / ROWS_PER_PASS * ROWS_PER_PASS;
+        layer.weights.assign(rows * layer.stride, 0);
+        layer.weight_scales.resize(layer.outputs);
+        layer.weight_sums.resize(layer.outputs);
+        layer.bias.assign(bias.get_data().begin(), bias.get_data().end());
+        layer.activation = net.get_layer_activation(n_layer);
+        for(size_t row = 0; row < layer.outputs; row++)
+        {
+            const float* source = weights.get_data().data() + row * weights.get_stride();
+            float largest = 0.0f;
+            for(size_t k = 0; k < layer.inputs; k++){
+                largest = std::max(largest, std::abs(source[k]));
+            }
+            float scale = (largest > 0.0f) ? largest / 127.0f : 1.0f;
+            int8_t* target = layer.weights.data() + row * layer.stride;
+            int32_t sum = 0;
+            for(size_t k = 0; k < layer.inputs; k++){
+                target[k] = static_cast<int8_t>(std::lround(source[k] / scale));
+                sum += target[k];
+            }
+            layer.weight_scales[row] = scale;
+            layer.weight_sums[row] = sum;
+        }
+        ActivationKind activation = layer.activation;
+        layers.push_back(std::move(layer));
+
+        Matrix next;
+        weights.dot(activations, next);
+        bias_activation_by_row(activation, next.get_data().data(), next.get_height(), next.get_width(),
+                               bias.get_data().data());
+        activations = std::move(next);
+    }
+}
+
+void QuantizedNet::run_layer(const Layer& layer, const uint8_t* const* inputs, size_t n, float** outputs) const
+{
+    DotKernelChoice choice = select_kernel();
+    // unused sample slots repeat the first sample, their results are dropped
+    const uint8_t* x[SAMPLES_PER_PASS];
+    for(size_t s = 0; s < SAMPLES_PER_PASS; s++){
+        x[s] = inputs[s < n ? s : 0];
+    }
+
+    int32_t acc[ROWS_PER_PASS * SAMPLES_PER_PASS];
+    for(size_t first_row = 0; first_row < layer.outputs; first_row += ROWS_PER_PASS)
+    {
+        choice.kernel(layer.stride, layer.weights.data() + first_row * layer.stride, layer.stride, x, acc);
+        for(size_t row = first_row; row < std::min(first_row + ROWS_PER_PASS, layer.outputs); row++)
+        {
+            float scale = layer.weight_scales[row] * layer.input_scale;
+            int32_t correction = layer.input_zero_point * layer.weight_sums[row];
+            for(size_t s = 0; s < n; s++){
+                outputs[s][row] = scale * static_cast<float>(acc[(row - first_row) * SAMPLES_PER_PASS + s] - correction);
+            }
+        }
+    }
+    for(size_t s = 0; s < n; s++){
+        bias_activation_by_row(layer.activation, outputs[s], layer.outputs, 1, layer.bias.data());
+    }
+}
+
+void QuantizedNet::predict_batch(const float* inputs, size_t n, float* outputs) const
+{
+    size_t widest = 0;
+    size_t widest_stride = 0;
+    for(const Layer& layer : layers){
+        widest = std::max(widest, layer.outputs);
+        widest_stride = std::max(widest_stride, layer.stride);
+    }
+    std::vector<uint8_t> quantized(SAMPLES_PER_PASS * widest_stride, 0);
+    std::vector<float> hidden(SAMPLES_PER_PASS * widest);
+
+    for(size_t begin = 0; begin < n; begin += SAMPLES_PER_PASS)
+    {
+        size_t count = std::min(SAMPLES_PER_PASS, n - begin);
+        const uint8_t* layer_inputs[SAMPLES_PER_PASS];
+        float* layer_outputs[SAMPLES_PER_PASS];
+        const float* current[SAMPLES_PER_PASS];
+        for(size_t s = 0; s < count; s++){
+            current[s] = inputs + (begin + s) * get_input_size();
+        }
+
+        for(size_t n_layer = 0; n_layer < layers.size(); n_layer++)
+        {
+            const Layer& layer = layers[n_layer];
+            bool last = (n_layer + 1 == layers.size());
+            for(size_t s = 0; s < count; s++){
+                // the padding after layer.inputs stays 0 and meets 0 weights
+                uint8_t* q = quantized.data() + s * widest_stride;
+                quantize(current[s], layer.inputs, layer.input_scale, layer.input_zero_point, q);
+                std::fill(q + layer.inputs, q + layer.stride, static_cast<uint8_t>(0));
+                layer_inputs[s] = q;
+                layer_outputs[s] = last ? outputs + (begin + s) * get_output_size() : hidden.data() + s * widest;
+            }
+            run_layer(layer, layer_inputs, count, layer_outputs);
+            for(size_t s = 0; s < count; s++){
+                current[s] = layer_outputs[s];
+            }
+        }
+    }
+}
+
+Matrix QuantizedNet::feedforward(ConstMatrixView input) const
+{
+    if(input.get_width() != 1 || input.get_height() != get_input_size()){
+        throw std::invalid_argument("input must be a column vector with the size of the input layer");
+    }
+    std::vector<float> packed;
+    Matrix output(1, get_output_size());
+    predict_batch(packed_elements(input, packed), 1, output.get_data().data());
+    return output;
+}
+
+size_t QuantizedNet::get_input_size() const
+{
+    return layers.front().inputs;
+}
+
+size_t QuantizedNet::get_output_size() const
+{
+    return layers.back().outputs;
+}
+
+size_t QuantizedNet::get_weight_bytes() const
+{
+    size_t bytes = 0;
+    for(const Layer& layer : layers){
+        bytes += layer.weights.size() * sizeof(int8_t);
+        bytes += layer.weight_scales.size() * sizeof(float) + layer.weight_sums.size() * sizeof(int32_t);
+    }
+    return bytes;
+}
+
+const char* QuantizedNet::get_kernel_name()
+{
+    return select_kernel().name;
+}
+
+QuantizationReport compare_quantized(const NeuralNet& net, const QuantizedNet& quantized, const TrainingBatch& samples)
+{
+    typedef std::chrono::steady_clock clock;
+    size_t n = samples.size();
+    size_t input_size = quantized.get_input_size();
+    size_t output_size = quantized.get_output_size();
+
+    std::vector<float> inputs = pack_inputs(samples, input_size);
+
+    std::vector<float> float_outputs(n * output_size);
+    std::vector<float> quantized_outputs(n * output_size);
+    InferencePlan plan(net);
+    auto start = clock::now();
+    plan.predict_batch(inputs.data(), n, float_outputs.data());
+    double float_seconds = std::chrono::duration<double>(clock::now() - start).count();
+    start = clock::now();
+    quantized.predict_batch(inputs.data(), n, quantized_outputs.data());
+    double quantized_seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    QuantizationReport report = {};
+    report.samples = n;
+    report.float_seconds = float_seconds;
+    report.quantized_seconds = quantized_seconds;
+    report.quantized_weight_bytes = quantized.get_weight_bytes();
+    for(size_t n_layer = 1; n_layer < net.get_layer_count(); n_layer++){
+        report.float_weight_bytes += net.get_layer_weights(n_layer).get_data().size() * sizeof(float);
+    }
+
+    OutputComparison comparison = compare_outputs(float_outputs.data(), quantized_outputs.data(), output_size, samples);
+    report.max_abs_error = comparison.max_abs_error;
+    report.mean_abs_error = comparison.mean_abs_error;
+    report.float_accuracy = comparison.reference_accuracy;
+    report.quantized_accuracy = comparison.accuracy;
+    report.agreement = comparison.agreement;
+    return report;
+}
+
+std::string QuantizationReport::str() const
+{
+    std::stringstream out;
+    out << "samples: " << samples << "\n";
+    out << "output error, max: " << max_abs_error << " mean: " << mean_abs_error << "\n";
+    out << "accuracy, float: " << float_accuracy * 100 << "% int8: " << quantized_accuracy * 100 << "%"
+        << " (same prediction on " << agreement * 100 << "%)\n";
+    out << "weight memory, float: " << float_weight_bytes << " bytes, int8: " << quantized_weight_bytes << " bytes\n";
+    out << "inference time, float: " << float_seconds * 1000 << " ms, int8: " << quantized_seconds * 1000 << " ms\n";
+    return out.str();
+}
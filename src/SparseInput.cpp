@@ -0,0 +1,154 @@
+#include "SparseInput.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+void SparseInputStats::add(size_t active, size_t total, bool sparse)
+{
+    (sparse ? sparse_passes : dense_passes)++;
+    active_inputs += active;
+    total_inputs += total;
+}
+
+void SparseInputStats::merge(const SparseInputStats& other)
+{
+    sparse_passes += other.sparse_passes;
+    dense_passes += other.dense_passes;
+    active_inputs += other.active_inputs;
+    total_inputs += other.total_inputs;
+}
+
+double SparseInputStats::sparse_fraction() const
+{
+    size_t passes = sparse_passes + dense_passes;
+    return passes ? (double)sparse_passes / passes : 0.0;
+}
+
+double SparseInputStats::mean_density() const
+{
+    return total_inputs ? (double)active_inputs / total_inputs : 0.0;
+}
+
+void mark_active_rows(ConstMatrixView inputs, std::vector<uint8_t>& mask)
+{
+    mask.resize(inputs.get_height(),0);
+    // through plain pointers, stores to uint8_t could alias the vector itself and stop vectorization
+    uint8_t* marks = mask.data();
+    const float* data = inputs.get_data();
+    size_t stride = inputs.get_stride();
+    // no early exits, branch free loops vectorize, for a single sample over the whole column
+    if(inputs.get_width() == 1 && stride == 1){
+        for(size_t y = 0; y < inputs.get_height(); y++){
+            marks[y] |= (data[y] != 0.0f);
+        }
+        return;
+    }
+    for(size_t y = 0; y < inputs.get_height(); y++)
+    {
+        const float* row = data + y * stride;
+        uint8_t active = marks[y];
+        for(size_t x = 0; x < inputs.get_width(); x++){
+            active |= (row[x] != 0.0f);
+        }
+        marks[y] = active;
+    }
+}
+
+void collect_non_zero(ConstMatrixView column, std::vector<uint32_t>& indices, std::vector<float>& values)
+{
+    if(column.get_width() != 1){
+        throw std::invalid_argument("non-zero elements can only be collected from a column vector");
+    }
+    // every element is written and the position only advances past non-zero ones, no branches
+    size_t height = column.get_height();
+    indices.resize(height);
+    values.resize(height);
+    uint32_t* index_out = indices.data();
+    float* value_out = values.data();
+    const float* data = column.get_data();
+    size_t count = 0;
+    for(size_t y = 0; y < height; y++)
+    {
+        float value = data[y * column.get_stride()];
+        index_out[count] = static_cast<uint32_t>(y);
+        value_out[count] = value;
+        count += (value != 0.0f);
+    }
+    indices.resize(count);
+    values.resize(count);
+}
+
+void mask_to_indices(const std::vector<uint8_t>& mask, std::vector<uint32_t>& indices)
+{
+    indices.clear();
+    for(size_t i = 0; i < mask.size(); i++)
+    {
+        if(mask[i]){
+            indices.push_back(static_cast<uint32_t>(i));
+        }
+    }
+}
+
+void gather_rows(ConstMatrixView mat, const std::vector<uint32_t>& rows, Matrix& result)
+{
+    size_t width = mat.get_width();
+    result.resize(width,rows.size());
+    for(size_t i = 0; i < rows.size(); i++)
+    {
+        const float* row = mat.get_data() + rows[i] * mat.get_stride();
+        std::copy(row,row + width,result.get_data().data() + i * result.get_stride());
+    }
+}
+
+void gather_columns(ConstMatrixView mat, const std::vector<uint32_t>& columns, Matrix& result)
+{
+    result.resize(columns.size(),mat.get_height());
+    for(size_t y = 0; y < mat.get_height(); y++)
+    {
+        const float* row = mat.get_data() + y * mat.get_stride();
+        float* out = result.get_data().data() + y * result.get_stride();
+        for(size_t i = 0; i < columns.size(); i++){
+            out[i] = row[columns[i]];
+        }
+    }
+}
+
+void sparse_matrix_vector(ConstMatrixView weights, const std::vector<uint32_t>& indices,
+                          const std::vector<float>& values, Matrix& result)
+{
+    size_t height = weights.get_height();
+    size_t count = indices.size();
+    size_t stride = weights.get_stride();
+    result.resize(1,height);
+    float* out = result.get_data().data();
+    size_t out_stride = result.get_stride();
+
+    // four rows at a time, they share the index and value loads
+    size_t y = 0;
+    for(; y + 4 <= height; y += 4)
+    {
+        const float* row = weights.get_data() + y * stride;
+        float sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+        for(size_t i = 0; i < count; i++)
+        {
+            size_t x = indices[i];
+            float value = values[i];
+            sum0 += row[x] * value;
+            sum1 += row[stride + x] * value;
+            sum2 += row[2 * stride + x] * value;
+            sum3 += row[3 * stride + x] * value;
+        }
+        out[y * out_stride] = sum0;
+        out[(y + 1) * out_stride] = sum1;
+        out[(y + 2) * out_stride] = sum2;
+        out[(y + 3) * out_stride] = sum3;
+    }
+    for(; y < height; y++)
+    {
+        const float* row = weights.get_data() + y * stride;
+        float sum = 0;
+        for(size_t i = 0; i < count; i++){
+            sum += row[indices[i]] * values[i];
+        }
+        out[y * out_stride] = sum;
+    }
+}
@@ -0,0 +1,413 @@
+#include "SparseNet.hpp"
+#include "Activation.hpp"
+#include "Gemm.hpp"
+#include "InferencePlan.hpp"
+#include "ModelComparison.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SPARSE_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// samples of a batch run together, one cache line of floats per input
+const size_t BLOCK = 16;
+
+// y = A x for a CSR matrix of rows rows
+typedef void (*SpmvKernel)(size_t rows, const uint32_t* row_offsets, const uint32_t* columns, const float* values,
+                           const float* x, float* y);
+// out = A in, in and out hold BLOCK samples per row (feature-major)
+typedef void (*SpmmKernel)(size_t rows, const uint32_t* row_offsets, const uint32_t* columns, const float* values,
+                           const float* in, float* out);
+
+// ---------------------------------------------------------------- scalar
+
+void spmv_scalar(size_t rows, const uint32_t* row_offsets, const uint32_t* columns, const float* values,
+                 const float* x, float* y)
+{
+    for(size_t r = 0; r < rows; r++){
+        float sum = 0.0f;
+        for(uint32_t k = row_offsets[r]; k < row_offsets[r + 1]; k++){
+            sum += values[k] * x[columns[k]];
+        }
+        y[r] = sum;
+    }
+}
+
+void spmm_scalar(size_t rows, const uint32_t* row_offsets, const uint32_t* columns, const float* values,
+                 const float* in, float* out)
+{
+    for(size_t r = 0; r < rows; r++){
+        float acc[BLOCK] = {};
+        for(uint32_t k = row_offsets[r]; k < row_offsets[r + 1]; k++){
+            const float* samples = in + columns[k] * BLOCK;
+            for(size_t s = 0; s < BLOCK; s++){
+                acc[s] += values[k] * samples[s];
+            }
+        }
+        std::copy(acc, acc + BLOCK, out + r * BLOCK);
+    }
+}
+
+#ifdef SPARSE_X86
+
+// ---------------------------------------------------------------- avx2
+
+__attribute__((target("avx2,fma")))
+void spmv_avx2(size_t rows, const uint32_t* row_offsets, const uint32_t* columns, const float* values,
+               const float* x, float* y)
+{
+    for(size_t r = 0; r < rows; r++){
+        __m256 acc = _mm256_setzero_ps();
+        uint32_t k = row_offsets[r];
+        uint32_t end = row_offsets[r + 1];
+        for(; k + 8 <= end; k += 8){
+            __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(columns + k));
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(values + k), _mm256_i32gather_ps(x, index, 4), acc);
+        }
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+        float total = _mm_cvtss_f32(sum);
+        for(; k < end; k++){
+            total += values[k] * x[columns[k]];
+        }
+        y[r] = total;
+    }
+}
+
+__attribute__((target("avx2,fma")))
+void spmm_avx2(size_t rows, const uint32_t* row_offsets, const uint32_t* columns, const float* values,
+               const float* in, float* out)
+{
+    for(size_t r = 0; r < rows; r++){
+        __m256 low = _mm256_setzero_ps();
+        __m256 high = _mm256_setzero_ps();
+        for(uint32_t k = row_offsets[r]; k < row_offsets[r + 1]; k++){
+            __m256 value = _mm256_set1_ps(values[k]);
+            const float* samples = in + columns[k] * BLOCK;
+            low = _mm256_fmadd_ps(value, _mm256_load_ps(samples), low);
+            high = _mm256_fmadd_ps(value, _mm256_load_ps(samples + 8), high);
+        }
+        _mm256_store_ps(out + r * BLOCK, low);
+        _mm256_store_ps(out + r * BLOCK + 8, high);
+    }
+}
+
+// ---------------------------------------------------------------- avx512
+
+__attribute__((target("avx512f")))
+void spmv_avx512(size_t rows, const uint32_t* row_offsets, const uint32_t* columns, const float* values,
+                 const float* x, float* y)
+{
+    for(size_t r = 0; r < rows; r++){
+        __m512 acc = _mm512_setzero_ps();
+        uint32_t k = row_offsets[r];
+        uint32_t end = row_offsets[r + 1];
+        for(; k + 16 <= end; k += 16){
+            __m512i index = _mm512_loadu_si512(columns + k);
+            acc = _mm512_fmadd_ps(_mm512_loadu_ps(values + k), _mm512_i32gather_ps(index, x, 4), acc);
+        }
+        if(k < end){
+            __mmask16 tail = static_cast<__mmask16>((1u << (end - k)) - 1);
+            __m512i index = _mm512_maskz_loadu_epi32(tail, columns + k);
+            __m512 gathered = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), tail, index, x, 4);
+            acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(tail, values + k), gathered, acc);
+        }
+        y[r] = _mm512_reduce_add_ps(acc);
+    }
+}
+
+// two accumulators, consecutive non-zeros don't wait on each other's multiply-add
+__attribute__((target("avx512f")))
+void spmm_avx512(size_t rows, const uint32_t* row_offsets, const uint32_t* columns, const float* values,
+                 const float* in, float* out)
+{
+    for(size_t r = 0; r < rows; r++){
+        __m512 even = _mm512_setzero_ps();
+        __m512 odd = _mm512_setzero_ps();
+        uint32_t k = row_offsets[r];
+        uint32_t end = row_offsets[r + 1];
+        for(; k + 2 <= end; k += 2){
+            even = _mm512_fmadd_ps(_mm512_set1_ps(values[k]), _mm512_load_ps(in + columns[k] * BLOCK), even);
+            odd = _mm512_fmadd_ps(_mm512_set1_ps(values[k + 1]), _mm512_load_ps(in + columns[k + 1] * BLOCK), odd);
+        }
+        if(k < end){
+            even = _mm512_fmadd_ps(_mm512_set1_ps(values[k]), _mm512_load_ps(in + columns[k] * BLOCK), even);
+        }
+        _mm512_store_ps(out + r * BLOCK, _mm512_add_ps(even, odd));
+    }
+}
+
+#endif
+
+struct SparseKernels{
+    SpmvKernel spmv;
+    SpmmKernel spmm;
+    const char* name;
+};
+
+SparseKernels select_kernels()
+{
+#ifdef SPARSE_X86
+    return gemm_isa_select<SparseKernels>({spmv_scalar, spmm_scalar, "scalar"}, {spmv_avx2, spmm_avx2, "avx2"},
+                                          {spmv_avx512, spmm_avx512, "avx512"});
+#else
+    return {spmv_scalar, spmm_scalar, "scalar"};
+#endif
+}
+
+}
+
+SparseNet::SparseNet(const NeuralNet& net, float max_density)
+:non_zero_weights(0), total_weights(0)
+{
+    if(net.get_layer_count() < 2){
+        throw std::invalid_argument("sparse net needs at least an input and an output layer");
+    }
+    for(size_t n_layer = 1; n_layer < net.get_layer_count(); n_layer++)
+    {
+        const Matrix& weights = net.get_layer_weights(n_layer);
+        const Matrix& bias = net.get_layer_bias(n_layer);
+        Layer layer;
+        layer.inputs = weights.get_width();
+        layer.outputs = weights.get_height();
+        layer.bias.assign(bias.get_data().begin(), bias.get_data().end());
+        layer.activation = net.get_layer_activation(n_layer);
+
+        size_t non_zero = 0;
+        for(size_t row = 0; row < layer.outputs; row++){
+            const float* source = weights.get_data().data() + row * weights.get_stride();
+            for(size_t k = 0; k < layer.inputs; k++){
+                non_zero += (source[k] != 0.0f);
+            }
+        }
+        non_zero_weights += non_zero;
+        total_weights += layer.inputs * layer.outputs;
+
+        layer.sparse = non_zero <= max_density * layer.inputs * layer.outputs;
+        if(layer.sparse){
+            layer.row_offsets.reserve(layer.outputs + 1);
+            layer.columns.reserve(non_zero);
+            layer.values.reserve(non_zero);
+            layer.row_offsets.push_back(0);
+            for(size_t row = 0; row < layer.outputs; row++){
+                const float* source = weights.get_data().data() + row * weights.get_stride();
+                for(size_t k = 0; k < layer.inputs; k++){
+                    if(source[k] != 0.0f){
+                        layer.columns.push_back(static_cast<uint32_t>(k));
+                        layer.values.push_back(source[k]);
+                    }
+                }
+                layer.row_offsets.push_back(static_cast<uint32_t>(layer.values.size()));
+            }
+        }else{
+            layer.values.resize(layer.inputs * layer.outputs);
+            for(size_t row = 0; row < layer.outputs; row++){
+                const float* source = weights.get_data().data() + row * weights.get_stride();
+                std::copy(source, source + layer.inputs, layer.values.begin() + row * layer.inputs);
+            }
+        }
+        layers.push_back(std::move(layer));
+    }
+}
+
+void SparseNet::run_sample(const float* input, float* output, MatrixStorage (&buffers)[2]) const
+{
+    SparseKernels kernels = select_kernels();
+    const float* current = input;
+    for(size_t n_layer = 0; n_layer < layers.size(); n_layer++)
+    {
+        const Layer& layer = layers[n_layer];
+        float* next = (n_layer + 1 == layers.size()) ? output : buffers[n_layer % 2].data();
+        if(layer.sparse){
+            kernels.spmv(layer.outputs, layer.row_offsets.data(), layer.columns.data(), layer.values.data(), current, next);
+        }else{
+            gemm(Transpose::no, Transpose::no, layer.outputs, 1, layer.inputs,
+                 1.0f, layer.values.data(), layer.inputs, current, 1, 0.0f, next, 1);
+        }
+        bias_activation_by_row(layer.activation, next, layer.outputs, 1, layer.bias.data());
+        current = next;
+    }
+}
+
+void SparseNet::run_block(const float* inputs, size_t n, float* outputs, MatrixStorage (&buffers)[2]) const
+{
+    SparseKernels kernels = select_kernels();
+    size_t input_size = get_input_size();
+    size_t output_size = get_output_size();
+
+    // samples to feature-major, written a whole row (cache line) at a time,
+    // the unused sample slots are 0 and their results dropped
+    float* current = buffers[0].data();
+    for(size_t k = 0; k < input_size; k++){
+        float* row = current + k * BLOCK;
+        for(size_t s = 0; s < BLOCK; s++){
+            row[s] = (s < n) ? inputs[s * input_size + k] : 0.0f;
+        }
+    }
+
+    for(size_t n_layer = 0; n_layer < layers.size(); n_layer++)
+    {
+        const Layer& layer = layers[n_layer];
+        float* next = buffers[(n_layer + 1) % 2].data();
+        if(layer.sparse){
+            kernels.spmm(layer.outputs, layer.row_offsets.data(), layer.columns.data(), layer.values.data(), current, next);
+        }else{
+            gemm(Transpose::no, Transpose::no, layer.outputs, BLOCK, layer.inputs,
+                 1.0f, layer.values.data(), layer.inputs, current, BLOCK, 0.0f, next, BLOCK);
+        }
+        bias_activation_by_row(layer.activation, next, layer.outputs, BLOCK, layer.bias.data());
+        current = next;
+    }
+
+    for(size_t s = 0; s < n; s++){
+        float* result = outputs + s * output_size;
+        for(size_t r = 0; r < output_size; r++){
+            result[r] = current[r * BLOCK + s];
+        }
+    }
+}
+
+void SparseNet::predict_batch(const float* inputs, size_t n, float* outputs) const
+{
+    size_t widest = 0;
+    for(const Layer& layer : layers){
+        widest = std::max(widest, std::max(layer.inputs, layer.outputs));
+    }
+    MatrixStorage buffers[2];
+    if(n == 1){
+        buffers[0].resize(widest);
+        buffers[1].resize(widest);
+        run_sample(inputs, outputs, buffers);
+        return;
+    }
+    buffers[0].resize(widest * BLOCK);
+    buffers[1].resize(widest * BLOCK);
+    for(size_t begin = 0; begin < n; begin += BLOCK)
+    {
+        size_t count = std::min(BLOCK, n - begin);
+        run_block(inputs + begin * get_input_size(), count, outputs + begin * get_output_size(), buffers);
+    }
+}
+
+Matrix SparseNet::feedforward(ConstMatrixView input) const
+{
+    if(input.get_width() != 1 || input.get_height() != get_input_size()){
+        throw std::invalid_argument("input must be a column vector with the size of the input layer");
+    }
+    std::vector<float> packed;
+    Matrix output(1, get_output_size());
+    predict_batch(packed_elements(input, packed), 1, output.get_data().data());
+    return output;
+}
+
+size_t SparseNet::get_input_size() const
+{
+    return layers.front().inputs;
+}
+
+size_t SparseNet::get_output_size() const
+{
+    return layers.back().outputs;
+}
+
+size_t SparseNet::get_weight_bytes() const
+{
+    size_t bytes = 0;
+    for(const Layer& layer : layers){
+        bytes += layer.values.size() * sizeof(float);
+        bytes += (layer.row_offsets.size() + layer.columns.size()) * sizeof(uint32_t);
+    }
+    return bytes;
+}
+
+float SparseNet::get_density() const
+{
+    return total_weights ? float(non_zero_weights) / total_weights : 0.0f;
+}
+
+bool SparseNet::is_layer_sparse(size_t n_layer) const
+{
+    if(n_layer == 0 || n_layer > layers.size()){
+        throw std::invalid_argument("layer " + std::to_string(n_layer) + " out of range");
+    }
+    return layers[n_layer - 1].sparse;
+}
+
+const char* SparseNet::get_kernel_name()
+{
+    return select_kernels().name;
+}
+
+PruningReport compare_pruned(const NeuralNet& net, const SparseNet& sparse, const TrainingBatch& samples)
+{
+    typedef std::chrono::steady_clock clock;
+    size_t n = samples.size();
+    size_t input_size = sparse.get_input_size();
+    size_t output_size = sparse.get_output_size();
+
+    std::vector<float> inputs = pack_inputs(samples, input_size);
+
+    std::vector<float> dense_outputs(n * output_size);
+    std::vector<float> sparse_outputs(n * output_size);
+    InferencePlan plan(net);
+    auto start = clock::now();
+    plan.predict_batch(inputs.data(), n, dense_outputs.data());
+    double dense_seconds = std::chrono::duration<double>(clock::now() - start).count();
+    start = clock::now();
+    sparse.predict_batch(inputs.data(), n, sparse_outputs.data());
+    double sparse_seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    // latency, one sample at a time
+    std::vector<float> output(output_size);
+    start = clock::now();
+    for(size_t i = 0; i < n; i++){
+        plan.predict_batch(inputs.data() + i * input_size, 1, output.data());
+    }
+    double dense_sample_seconds = std::chrono::duration<double>(clock::now() - start).count();
+    start = clock::now();
+    for(size_t i = 0; i < n; i++){
+        sparse.predict_batch(inputs.data() + i * input_size, 1, output.data());
+    }
+    double sparse_sample_seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    PruningReport report = {};
+    report.samples = n;
+    report.density = sparse.get_density();
+    report.dense_seconds = dense_seconds;
+    report.sparse_seconds = sparse_seconds;
+    report.sparse_weight_bytes = sparse.get_weight_bytes();
+    report.dense_weight_bytes = plan.get_weight_bytes();
+
+    OutputComparison comparison = compare_outputs(dense_outputs.data(), sparse_outputs.data(), output_size, samples);
+    report.max_abs_error = comparison.max_abs_error;
+    report.mean_abs_error = comparison.mean_abs_error;
+    report.dense_accuracy = comparison.reference_accuracy;
+    report.sparse_accuracy = comparison.accuracy;
+    report.agreement = comparison.agreement;
+    if(n > 0){
+        report.dense_sample_seconds = dense_sample_seconds / n;
+        report.sparse_sample_seconds = sparse_sample_seconds / n;
+    }
+    return report;
+}
+
+std::string PruningReport::str() const
+{
+    std::stringstream out;
+    out << "samples: " << samples << ", weight density: " << density * 100 << "%\n";
+    out << "output error, max: " << max_abs_error << " mean: " << mean_abs_error << "\n";
+    out << "accuracy, dense: " << dense_accuracy * 100 << "% sparse: " << sparse_accuracy * 100 << "%"
+        << " (same prediction on " << agreement * 100 << "%)\n";
+    out << "weight memory, dense: " << dense_weight_bytes << " bytes, sparse: " << sparse_weight_bytes << " bytes\n";
+    out << "batch time, dense: " << dense_seconds * 1000 << " ms, sparse: " << sparse_seconds * 1000 << " ms\n";
+    out << "sample latency, dense: " << dense_sample_seconds * 1e6 << " us, sparse: " << sparse_sample_seconds * 1e6 << " us\n";
+    return out.str();
+}
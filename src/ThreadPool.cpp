@@ -0,0 +1,122 @@
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(size_t n_threads)
+:job(nullptr), job_tasks(0), next_task(0), finished_tasks(0), busy_workers(0), generation(0), stopping(false)
+{
+    for(size_t n = 1; n < n_threads; n++)
+    {
+        workers.emplace_back(&ThreadPool::worker_loop,this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_available.notify_all();
+    for(auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::size() const
+{
+    return workers.size() + 1;
+}
+
+void ThreadPool::run(size_t n_tasks, const std::function<void(size_t)>& task)
+{
+    if(n_tasks == 0){
+        return;
+    }
+    if(workers.empty() || n_tasks == 1){
+        for(size_t n = 0; n < n_tasks; n++){
+            task(n);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> run_lock(run_mutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &task;
+        job_tasks = n_tasks;
+        next_task = 0;
+        finished_tasks = 0;
+        error = nullptr;
+        generation++;
+    }
+    job_available.notify_all();
+
+    work_on_current_job();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    // wait for the last task and for every worker to let go of the job
+    job_done.wait(lock,[this]{ return finished_tasks == job_tasks && busy_workers == 0; });
+    job = nullptr;
+    if(error){
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+void ThreadPool::worker_loop()
+{
+    size_t seen_generation = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true)
+    {
+        job_available.wait(lock,[&]{ return stopping || (generation != seen_generation && job != nullptr); });
+        if(stopping){
+            return;
+        }
+        seen_generation = generation;
+        busy_workers++;
+        lock.unlock();
+        work_on_current_job();
+        lock.lock();
+        busy_workers--;
+        if(busy_workers == 0){
+            job_done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::work_on_current_job()
+{
+    while(true)
+    {
+        size_t n_task;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(next_task >= job_tasks){
+                return;
+            }
+            n_task = next_task++;
+        }
+
+        try
+        {
+            (*job)(n_task);
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!error){
+                error = std::current_exception();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished_tasks++;
+            if(finished_tasks == job_tasks){
+                job_done.notify_all();
+            }
+        }
+    }
+}
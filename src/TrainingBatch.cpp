@@ -1,20 +1,165 @@
 #include "TrainingBatch.hpp"
+#include <algorithm>
+#include <stdexcept>
 
 TrainingBatch::TrainingBatch()
-:training_cases({})
-{}
+:dataset(nullptr), owned_dataset(std::make_shared<Dataset>()), indices({})
+{
+    dataset = owned_dataset;
+}
+
+TrainingBatch::TrainingBatch(std::shared_ptr<const Dataset> dataset)
+:dataset(dataset), owned_dataset(nullptr), indices({})
+{
+    if(!dataset){
+        throw std::invalid_argument("training batch needs a dataset");
+    }
+}
 
 void TrainingBatch::add_sample(const Matrix& input, const Matrix& desired_output)
 {
-    training_cases.push_back(std::make_pair<const Matrix&,const Matrix&>(input,desired_output));
+    if(!owned_dataset){
+        throw std::logic_error("cannot copy samples into a shared dataset, add them to the dataset and add_sample(index) instead");
+    }
+    indices.push_back(owned_dataset->add_sample(input,desired_output));
+}
+
+void TrainingBatch::add_sample(size_t index)
+{
+    if(index >= dataset->size()){
+        throw std::out_of_range("sample index out of range");
+    }
+    indices.push_back(index);
+}
+
+void TrainingBatch::clear()
+{
+    indices.clear();
+}
+
+void TrainingBatch::reserve(size_t n_samples)
+{
+    indices.reserve(n_samples);
 }
 
 std::pair<const Matrix&,const Matrix&> TrainingBatch::operator[](size_t index) const
 {
-    return training_cases[index];
+    return (*dataset)[indices[index]];
 }
 
 size_t TrainingBatch::size() const
 {
-    return training_cases.size();
-}
\ No newline at end of file
+    return indices.size();
+}
+
+const std::vector<size_t>& TrainingBatch::get_indices() const
+{
+    return indices;
+}
+
+const Dataset& TrainingBatch::get_dataset() const
+{
+    return *dataset;
+}
+
+// stacks the column vectors of either the inputs (first) or desired outputs (second)
+// of samples [begin,end) side by side into stacked, only the given rows when rows isn't null
+template<typename Getter>
+static void stack_columns(const TrainingBatch& batch, size_t begin, size_t end, Getter get, Matrix& stacked,
+                          const std::vector<uint32_t>* rows = nullptr)
+{
+    if(begin > end || end > batch.size()){
+        throw std::invalid_argument("sample range out of range");
+    }
+    if(begin == end){
+        stacked.resize(0,0);
+        return;
+    }
+    size_t count = end - begin;
+    size_t height = get(batch[begin]).get_height();
+    for(size_t n_case = 0; n_case < count; n_case++)
+    {
+        const Matrix& column = get(batch[begin + n_case]);
+        if(column.get_width() != 1 || column.get_height() != height){
+            throw std::invalid_argument("all samples in a batch must be column vectors of the same height");
+        }
+        if(rows && !rows->empty() && rows->back() >= height){
+            throw std::invalid_argument("row index out of range of the samples");
+        }
+    }
+    stacked.resize(count,rows ? rows->size() : height);
+    float* data = stacked.get_data().data();
+    size_t stride = stacked.get_stride();
+
+    // a block of samples at a time, written row by row so the stacked matrix is filled
+    // sequentially instead of one scattered element per row for every sample
+    const size_t BLOCK = 16;
+    const float* columns[BLOCK];
+    size_t column_strides[BLOCK];
+    for(size_t block_begin = 0; block_begin < count; block_begin += BLOCK)
+    {
+        size_t block_size = std::min(BLOCK,count - block_begin);
+        for(size_t n_case = 0; n_case < block_size; n_case++){
+            const Matrix& column = get(batch[begin + block_begin + n_case]);
+            columns[n_case] = column.get_data().data();
+            column_strides[n_case] = column.get_stride();
+        }
+        for(size_t y = 0; y < stacked.get_height(); y++)
+        {
+            size_t source = rows ? (*rows)[y] : y;
+            float* out = data + y * stride + block_begin;
+            for(size_t n_case = 0; n_case < block_size; n_case++){
+                out[n_case] = columns[n_case][source * column_strides[n_case]];
+            }
+        }
+    }
+}
+
+static const Matrix& get_input(std::pair<const Matrix&,const Matrix&> training_case)
+{
+    return training_case.first;
+}
+
+static const Matrix& get_desired(std::pair<const Matrix&,const Matrix&> training_case)
+{
+    return training_case.second;
+}
+
+Matrix TrainingBatch::get_input_matrix() const
+{
+    return get_input_matrix(0,size());
+}
+
+Matrix TrainingBatch::get_desired_matrix() const
+{
+    return get_desired_matrix(0,size());
+}
+
+Matrix TrainingBatch::get_input_matrix(size_t begin, size_t end) const
+{
+    Matrix stacked;
+    stack_columns(*this,begin,end,get_input,stacked);
+    return stacked;
+}
+
+void TrainingBatch::get_input_matrix(size_t begin, size_t end, Matrix& result) const
+{
+    stack_columns(*this,begin,end,get_input,result);
+}
+
+void TrainingBatch::get_input_rows(size_t begin, size_t end, const std::vector<uint32_t>& rows, Matrix& result) const
+{
+    stack_columns(*this,begin,end,get_input,result,&rows);
+}
+
+Matrix TrainingBatch::get_desired_matrix(size_t begin, size_t end) const
+{
+    Matrix stacked;
+    stack_columns(*this,begin,end,get_desired,stacked);
+    return stacked;
+}
+
+void TrainingBatch::get_desired_matrix(size_t begin, size_t end, Matrix& result) const
+{
+    stack_columns(*this,begin,end,get_desired,result);
+}
@@ -0,0 +1,17 @@
+#include "TrainingWorkspace.hpp"
+
+void TrainingWorkspace::prepare(const std::vector<Matrix>& weight_layers, size_t batch_size)
+{
+    size_t n_layers = weight_layers.size();
+    activations.resize(n_layers);
+    bias_gradient.resize(n_layers);
+    weight_gradient.resize(n_layers);
+
+    for(size_t n_layer = 1; n_layer < n_layers; n_layer++)
+    {
+        const Matrix& weights = weight_layers[n_layer];
+        activations[n_layer].resize(batch_size,weights.get_height());
+        bias_gradient[n_layer].resize(1,weights.get_height());
+        weight_gradient[n_layer].resize(weights.get_width(),weights.get_height());
+    }
+}
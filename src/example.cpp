@@ -1,6 +1,20 @@
 #include <iostream>
 #include "NeuralNet.hpp"
 #include "BMP.hpp"
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include "ModelFile.hpp"
+#include "PackedDataset.hpp"
+#include "IngestPipeline.hpp"
+#include "InferencePlan.hpp"
+#include "QuantizedNet.hpp"
+#include "SparseNet.hpp"
+#include "Hogwild.hpp"
+#include "BatchProducer.hpp"
+#include <algorithm>
+#include <filesystem>
 
 void bmp_to_greyscale_mat(BMP& bmp, Matrix& mat)
 {
@@ -19,60 +33,228 @@ void bmp_to_greyscale_mat(BMP& bmp, Matrix& mat)
 }
 
 
+// the images of a digit are data/<digit>/<n>.bmp, sorted by n
+std::vector<std::string> list_digit_files(size_t digit)
+{
+    std::vector<std::pair<size_t,std::string>> numbered;
+    std::filesystem::path dir = "data/" + std::to_string(digit);
+    if(!std::filesystem::is_directory(dir)){
+        return {};
+    }
+    for(const auto& entry : std::filesystem::directory_iterator(dir))
+    {
+        const std::filesystem::path& path = entry.path();
+        std::string stem = path.stem().string();
+        if(path.extension() != ".bmp" || stem.empty() || stem.find_first_not_of("0123456789") != std::string::npos){
+            continue;
+        }
+        numbered.emplace_back(std::stoul(stem),path.string());
+    }
+    std::sort(numbered.begin(),numbered.end());
+    std::vector<std::string> files;
+    for(auto& file : numbered)
+    {
+        files.push_back(file.second);
+    }
+    return files;
+}
+
+Matrix decode_bmp(const std::vector<uint8_t>& bytes)
+{
+    BMP bmp(bytes.data(),bytes.size());
+    Matrix mat;
+    bmp_to_greyscale_mat(bmp,mat);
+    mat.reshape(1,128*128);
+    return mat;
+}
+
 void load_data(std::vector<std::vector<Matrix>>& data)
 {
+    std::vector<std::string> files;
+    std::vector<size_t> digits;
     for(size_t digit = 0; digit < 10; digit++)
     {
-        size_t image_count = 0;
-        bool done = false;
-        std::vector<Matrix> images({});
-        while(!done)
+        for(auto& file : list_digit_files(digit))
         {
-            try
-            {
-                std::string filename = "data/"+std::to_string(digit)+"/"+std::to_string(image_count)+".bmp";
-                std::cout << "loading: " << filename << std::endl;
-                BMP bmp(filename.c_str());
-                Matrix mat;
-                bmp_to_greyscale_mat(bmp,mat);
-                mat.reshape(1,128*128);
-                images.push_back(mat);
-                image_count++;
-            }
-            catch(std::exception& e)
-            {
-                done = true;
-            }
+            files.push_back(file);
+            digits.push_back(digit);
         }
-        data.push_back(images);
     }
+
+    data.assign(10,std::vector<Matrix>({}));
+    IngestPipeline pipeline(files,decode_bmp,std::max(1u,std::thread::hardware_concurrency()));
+    for(size_t n_file = 0; n_file < files.size(); n_file++)
+    {
+        try
+        {
+            Matrix mat;
+            pipeline.next(mat);
+            data[digits[n_file]].push_back(std::move(mat));
+        }
+        catch(std::exception& e)
+        {
+            std::cout << "skipping " << files[n_file] << ": " << e.what() << std::endl;
+        }
+    }
+
+    IngestStats stats = pipeline.get_stats();
+    std::cout << "loaded " << stats.files << " files in " << stats.seconds << " s, "
+              << stats.files_per_second() << " files/s, " << stats.bytes_per_second() / (1024*1024) << " MiB/s" << std::endl;
+}
+
+// packed copy of the whole dataset, written on the first run so later runs don't decode bitmaps
+const char* PACKED_DATA_PATH = "build/digits.pack";
+
+void pack_data(const std::vector<std::vector<Matrix>>& data, const std::string& path)
+{
+    // an empty pack would be loaded on every later run instead of retrying the bitmaps
+    size_t images = 0;
+    for(const auto& digit : data)
+    {
+        images += digit.size();
+    }
+    if(images == 0){
+        return;
+    }
+    PackedDatasetWriter writer(path,128*128);
+    for(size_t digit = 0; digit < data.size(); digit++)
+    {
+        for(const auto& image : data[digit])
+        {
+            writer.add_sample(image.get_data().data(),digit);
+        }
+    }
+    writer.finish();
 }
 
-void generate_batches(const std::vector<std::vector<Matrix>>& data, size_t batch_size, size_t batch_count, std::vector<TrainingBatch>& batches)
+bool load_packed_data(std::vector<std::vector<Matrix>>& data, const std::string& path)
 {
-    for(size_t n_batch = 0; n_batch < batch_count; n_batch++)
+    try
     {
-        TrainingBatch batch;
-        for(size_t count = 0; count < batch_size; count++)
+        PackedDataset packed(path);
+        if(packed.get_sample_size() != 128*128 || packed.size() == 0){
+            return false;
+        }
+        data.assign(10,std::vector<Matrix>({}));
+        for(size_t index = 0; index < packed.size(); index++)
+        {
+            const float* sample = packed.get_sample(index);
+            data.at(packed.get_label(index)).emplace_back(std::vector<float>(sample,sample + packed.get_sample_size()),1,packed.get_sample_size());
+        }
+        return true;
+    }
+    catch(std::exception& e)
+    {
+        return false;
+    }
+}
+
+// moves all images into one shared dataset
+void build_dataset(std::vector<std::vector<Matrix>>& data, Dataset& dataset)
+{
+    for(size_t digit = 0; digit < data.size(); digit++)
+    {
+        for(auto& image : data[digit])
         {
-            size_t digit = (rand() % 10);
-            size_t index = (rand() % data.at(digit).size());
             Matrix desired(1,10);
             desired.set_value(0,digit,1);
-            batch.add_sample(data.at(digit).at(index),desired);
-            std::cout << "added batch sample digit: " << digit << " index: " << index << std::endl;
-            batches.push_back(batch);
+            dataset.add_sample(std::move(image),std::move(desired));
+        }
+    }
+    data.clear();
+}
+
+// saves the net in both formats and compares how long it takes to get a usable model back
+void compare_model_formats(NeuralNet& net)
+{
+    typedef std::chrono::steady_clock clock;
+    auto ms_since = [](clock::time_point start){
+        return std::chrono::duration<double,std::milli>(clock::now() - start).count();
+    };
+
+    {
+        std::ofstream out("model.txt");
+        out << net.to_str();
+    }
+    net.save("model.nnm");
+
+    auto start = clock::now();
+    std::ifstream in("model.txt");
+    std::stringstream text;
+    text << in.rdbuf();
+    NeuralNet text_net;
+    text_net.from_str(text.str());
+    double text_ms = ms_since(start);
+
+    start = clock::now();
+    NeuralNet binary_net;
+    binary_net.load("model.nnm");
+    double binary_ms = ms_since(start);
+
+    start = clock::now();
+    MappedModel mapped("model.nnm");
+    double mapped_ms = ms_since(start);
+
+    std::cout << "model load, text: " << text_ms << " ms, binary: " << binary_ms << " ms, mmap: " << mapped_ms << " ms" << std::endl;
+
+    net.save("model_bf16.nnm",ModelDataType::bfloat16);
+    MappedModel mapped_half("model_bf16.nnm");
+    InferencePlan float_plan(mapped,1);
+    InferencePlan half_plan(mapped_half,1);
+    std::cout << "model weights, float32: " << float_plan.get_weight_bytes() << " bytes, bfloat16: "
+              << half_plan.get_weight_bytes() << " bytes" << std::endl;
+}
+
+// classification accuracy over the whole dataset, run through a precompiled inference plan
+float evaluate_accuracy(const NeuralNet& net, const Dataset& dataset)
+{
+    InferencePlan plan(net,64);
+    size_t input_size = plan.get_input_size();
+    size_t output_size = plan.get_output_size();
+    std::vector<float> inputs(plan.get_max_batch() * input_size);
+    std::vector<float> outputs(plan.get_max_batch() * output_size);
+    std::vector<float> packed_desired;
+
+    size_t correct = 0;
+    for(size_t begin = 0; begin < dataset.size(); begin += plan.get_max_batch())
+    {
+        size_t count = std::min(plan.get_max_batch(), dataset.size() - begin);
+        for(size_t i = 0; i < count; i++)
+        {
+            copy_elements(dataset[begin + i].first,inputs.data() + i * input_size);
+        }
+        plan.predict_batch(inputs.data(),count,outputs.data());
+        for(size_t i = 0; i < count; i++)
+        {
+            const float* result = outputs.data() + i * output_size;
+            const float* desired = packed_elements(dataset[begin + i].second,packed_desired);
+            size_t predicted = std::max_element(result,result + output_size) - result;
+            size_t label = std::max_element(desired,desired + output_size) - desired;
+            correct += (predicted == label);
         }
     }
+    return dataset.size() ? float(correct) / dataset.size() : 0.0f;
 }
 
 int main(){
 
     std::vector<std::vector<Matrix>> data({});
-    std::vector<TrainingBatch> batches;
 
-    load_data(data);
-    generate_batches(data,30,10,batches);
+    auto load_start = std::chrono::steady_clock::now();
+    if(!load_packed_data(data,PACKED_DATA_PATH))
+    {
+        load_data(data);
+        pack_data(data,PACKED_DATA_PATH);
+    }
+    std::cout << "data loaded in " << std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - load_start).count() << " ms" << std::endl;
+    auto dataset = std::make_shared<Dataset>();
+    build_dataset(data,*dataset);
+    if(dataset->size() == 0){
+        std::cout << "no digit images found in data/" << std::endl;
+        return 1;
+    }
+    // batches of 30 samples, shuffled every epoch and assembled on a background thread while the previous one trains
+    BatchProducer producer(dataset,30);
 
 
 
@@ -87,15 +269,23 @@ int main(){
     
     NeuralNet net;
     net.add_layer(128*128);
-    net.add_layer(32);
+    net.add_layer(32,ActivationKind::relu);
     net.add_layer(10);
     net.randomize();
+    net.set_thread_count(std::thread::hardware_concurrency());
+    // the bitmaps are mostly background, batches with at most half the pixels lit skip the rest
+    net.set_sparse_input_threshold(0.5f);
+    OptimizerSettings adam;
+    adam.kind = OptimizerKind::adam;
+    net.set_optimizer(adam);
+    const float learning_rate = 0.001f;
   
-    std::cout << "batch size: " <<  batches.size() << std::endl;
+    std::cout << "batches per epoch: " << producer.get_batches_per_epoch() << std::endl;
 
-    for(size_t i = 0; i < 10000; i++){
-        net.process_batch(0.1,batches.at(i%10));
-        if(i%1000 == 0){
+    for(size_t i = 0; i < 2000; i++){
+        const ProducedBatch& produced = producer.next();
+        net.process_batch(learning_rate,produced.inputs,produced.desired);
+        if(i%200 == 0){
             float total = 0;
             for(size_t i = 0; i < batch.size(); i++){
                 net.set_input(batch[i].first);
@@ -106,7 +296,48 @@ int main(){
         }
     }
 
+    BatchProducerStats producer_stats = producer.get_stats();
+    std::cout << "batch producer: " << producer_stats.batches << " batches, training waited " << producer_stats.consumer_waits
+              << " times (" << producer_stats.wait_seconds * 1000 << " ms), assembling took "
+              << producer_stats.produce_seconds * 1000 << " ms" << std::endl;
+    const SparseInputStats& sparse_stats = net.get_sparse_input_stats();
+    std::cout << "sparse first layer: " << sparse_stats.sparse_fraction() * 100 << "% of passes, input density "
+              << sparse_stats.mean_density() * 100 << "%" << std::endl;
+    std::cout << "accuracy: " << evaluate_accuracy(net,*dataset) * 100 << "%" << std::endl;
 
+    TrainingBatch all_samples(dataset);
+    for(size_t i = 0; i < dataset->size(); i++)
+    {
+        all_samples.add_sample(i);
+    }
+    QuantizedNet quantized(net,producer.next().batch);
+    std::cout << "int8 model (" << QuantizedNet::get_kernel_name() << "):\n" << compare_quantized(net,quantized,all_samples).str();
+
+    compare_model_formats(net);
+
+    // magnitude pruning, each pruned copy is fine-tuned with its pruned weights held at 0
+    for(float density : {0.3f, 0.1f, 0.03f})
+    {
+        NeuralNet pruned = net;
+        pruned.prune_weights(pruned.pruning_threshold(density));
+        for(size_t i = 0; i < 100; i++){
+            const ProducedBatch& produced = producer.next();
+            pruned.process_batch(learning_rate,produced.inputs,produced.desired);
+        }
+        SparseNet sparse(pruned,1.0f);
+        std::cout << "pruned to " << density * 100 << "% (" << SparseNet::get_kernel_name() << "):\n"
+                  << compare_pruned(net,sparse,all_samples).str();
+    }
+
+    // asynchronous against synchronous training from a fresh start, plain SGD for both
+    std::vector<TrainingBatch> batches;
+    for(size_t i = 0; i < 10; i++){
+        batches.push_back(producer.next().batch);
+    }
+    NeuralNet untrained = net;
+    untrained.randomize();
+    untrained.reset_optimizer();
+    std::cout << "hogwild sgd:\n" << compare_hogwild(untrained,0.05f,batches,all_samples,3).str();
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,202 @@
+// Stress test of the BatchProducer handover: epoch coverage, a full and an empty ring, destruction
+// while the producer is blocked and errors of the producer rethrown from next().
+// make test runs it, make test_tsan runs it under ThreadSanitizer.
+#include "BatchProducer.hpp"
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void check(bool condition, const std::string& what)
+{
+    if(!condition){
+        throw std::runtime_error(what);
+    }
+}
+
+// every value of sample n is n, its desired output is n % outputs one hot
+std::shared_ptr<Dataset> numbered_dataset(size_t samples, size_t input_size, size_t outputs = 10)
+{
+    auto dataset = std::make_shared<Dataset>();
+    for(size_t n = 0; n < samples; n++)
+    {
+        Matrix desired(1,outputs);
+        desired.set_value(0,n % outputs,1);
+        dataset->add_sample(Matrix(std::vector<float>(input_size,float(n)),1,input_size),std::move(desired));
+    }
+    return dataset;
+}
+
+// the stacked columns hold the samples the batch names
+void check_batch(const ProducedBatch& produced, size_t input_size)
+{
+    const TrainingBatch& batch = produced.batch;
+    check(produced.inputs.get_width() == batch.size() && produced.inputs.get_height() == input_size,
+          "stacked inputs have the wrong shape");
+    check(produced.desired.get_width() == batch.size(),"stacked desired outputs have the wrong shape");
+    for(size_t column = 0; column < batch.size(); column++)
+    {
+        size_t index = batch.get_indices()[column];
+        for(size_t row = 0; row < input_size; row++)
+        {
+            check(produced.inputs.get_value(column,row) == float(index),"stacked input doesn't match its sample");
+        }
+        for(size_t row = 0; row < produced.desired.get_height(); row++)
+        {
+            check(produced.desired.get_value(column,row) == batch[column].second.get_value(0,row),
+                  "stacked desired output doesn't match its sample");
+        }
+    }
+}
+
+void test_epoch_coverage()
+{
+    const size_t samples = 307, input_size = 64;
+    BatchProducer producer(numbered_dataset(samples,input_size),30,5);
+    check(producer.get_batches_per_epoch() == 11,"wrong number of batches per epoch");
+    for(size_t epoch = 0; epoch < 4; epoch++)
+    {
+        std::vector<size_t> seen(samples,0);
+        for(size_t n_batch = 0; n_batch < producer.get_batches_per_epoch(); n_batch++)
+        {
+            const ProducedBatch& produced = producer.next();
+            check(produced.epoch == epoch,"batch from the wrong epoch");
+            check(produced.batch.size() == (n_batch + 1 < producer.get_batches_per_epoch() ? 30 : samples % 30),
+                  "wrong batch size");
+            check_batch(produced,input_size);
+            for(size_t index : produced.batch.get_indices())
+            {
+                seen[index]++;
+            }
+        }
+        for(size_t count : seen)
+        {
+            check(count == 1,"an epoch doesn't take every sample exactly once");
+        }
+    }
+    check(producer.get_stats().batches == 44,"wrong batch count in the stats");
+}
+
+// a slow consumer keeps the ring full, the producer has to wait for every slot
+void test_full_ring()
+{
+    const size_t input_size = 16;
+    for(size_t slots : {2, 3, 5})
+    {
+        BatchProducer producer(numbered_dataset(50,input_size),7,1,{},slots);
+        for(size_t n_batch = 0; n_batch < 20; n_batch++)
+        {
+            check_batch(producer.next(),input_size);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        check(producer.get_stats().producer_waits > 0,"the producer never found the ring full");
+    }
+}
+
+// large batches and a consumer that does nothing keep the ring empty, next() has to wait
+void test_empty_ring()
+{
+    const size_t input_size = 1 << 16;
+    BatchProducer producer(numbered_dataset(64,input_size),64);
+    for(size_t n_batch = 0; n_batch < 20; n_batch++)
+    {
+        const ProducedBatch& produced = producer.next();
+        check(produced.inputs.get_value(0,0) == float(produced.batch.get_indices()[0]),"stacked input doesn't match its sample");
+    }
+    check(producer.get_stats().consumer_waits > 0,"next() never found the ring empty");
+}
+
+void test_destruction()
+{
+    auto dataset = numbered_dataset(50,16);
+    // blocked on a full ring, with and without a batch held by the consumer
+    for(size_t held = 0; held < 2; held++)
+    {
+        BatchProducer producer(dataset,7,1,{},2);
+        for(size_t n_batch = 0; n_batch < held; n_batch++)
+        {
+            producer.next();
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while(producer.get_stats().producer_waits == 0)
+        {
+            check(std::chrono::steady_clock::now() < deadline,"the producer never blocked");
+            std::this_thread::yield();
+        }
+    }
+    // at any point of the stream
+    for(size_t n = 0; n < 200; n++)
+    {
+        BatchProducer producer(dataset,7,n,{},2 + n % 3);
+        for(size_t n_batch = 0; n_batch < n % 5; n_batch++)
+        {
+            producer.next();
+        }
+    }
+}
+
+// the last sample is taller than the rest, so a batch of all samples fails to stack
+void test_producer_error()
+{
+    auto dataset = numbered_dataset(8,16);
+    dataset->add_sample(Matrix(std::vector<float>(17,0.0f),1,17),Matrix(1,10));
+    for(size_t slots : {2, 4})
+    {
+        BatchProducer producer(dataset,dataset->size(),1,{},slots);
+        for(size_t attempt = 0; attempt < 2; attempt++)
+        {
+            bool thrown = false;
+            try
+            {
+                producer.next();
+            }
+            catch(std::invalid_argument&)
+            {
+                thrown = true;
+            }
+            check(thrown,"the producer's error wasn't rethrown from next()");
+        }
+    }
+
+    bool thrown = false;
+    try
+    {
+        BatchProducer producer(dataset,1,1,{dataset->size()});
+    }
+    catch(std::out_of_range&)
+    {
+        thrown = true;
+    }
+    check(thrown,"an out of range sample index wasn't rejected");
+}
+
+}
+
+int main()
+{
+    const std::vector<std::pair<const char*,void(*)()>> tests = {
+        {"epoch coverage",test_epoch_coverage},
+        {"full ring",test_full_ring},
+        {"empty ring",test_empty_ring},
+        {"destruction",test_destruction},
+        {"producer error",test_producer_error},
+    };
+    int failed = 0;
+    for(const auto& test : tests)
+    {
+        try
+        {
+            test.second();
+            std::cout << "ok     " << test.first << std::endl;
+        }
+        catch(std::exception& e)
+        {
+            std::cout << "FAILED " << test.first << ": " << e.what() << std::endl;
+            failed++;
+        }
+    }
+    return failed ? 1 : 0;
+}
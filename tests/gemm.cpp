@@ -0,0 +1,226 @@
+// Checks every gemm instruction set against a naive double precision product: odd shapes that
+// leave partial micro tiles and blocks, k = 1, the matrix-vector paths (m = 1 or n = 1), all
+// transpose combinations, leading dimensions larger than the width and both entry points.
+// make test runs it.
+#include "Gemm.hpp"
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+void check(bool condition, const std::string& what)
+{
+    if(!condition){
+        throw std::runtime_error(what);
+    }
+}
+
+const float NaN = std::numeric_limits<float>::quiet_NaN();
+
+// a rows x cols operand stored with leading dimension ld, the padding is NaN so reading it shows
+struct Operand{
+    size_t rows, cols, ld;
+    std::vector<float> data;
+
+    Operand(size_t rows, size_t cols, size_t padding, std::mt19937& rng)
+    :rows(rows), cols(cols), ld(cols + padding), data(rows * (cols + padding), NaN)
+    {
+        std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+        for(size_t r = 0; r < rows; r++){
+            for(size_t c = 0; c < cols; c++){
+                data[r * ld + c] = value(rng);
+            }
+        }
+    }
+    float at(size_t r, size_t c) const { return data[r * ld + c]; }
+};
+
+struct Case{
+    Transpose trans_a, trans_b;
+    size_t m, n, k, padding;
+    float alpha, beta;
+    bool workspace;
+};
+
+std::string describe(const Case& c)
+{
+    std::stringstream out;
+    out << gemm_isa_name(gemm_get_isa()) << " " << (c.trans_a == Transpose::yes ? "T" : "N")
+        << (c.trans_b == Transpose::yes ? "T" : "N") << " m=" << c.m << " n=" << c.n << " k=" << c.k
+        << " padding=" << c.padding << " alpha=" << c.alpha << " beta=" << c.beta
+        << (c.workspace ? " workspace" : "");
+    return out.str();
+}
+
+void check_case(const Case& c, std::mt19937& rng)
+{
+    bool ta = c.trans_a == Transpose::yes;
+    bool tb = c.trans_b == Transpose::yes;
+    Operand a(ta ? c.k : c.m, ta ? c.m : c.k, c.padding, rng);
+    Operand b(tb ? c.n : c.k, tb ? c.k : c.n, c.padding, rng);
+    Operand result(c.m, c.n, c.padding, rng);
+    // with beta 0 C must not be read, garbage in it has to disappear
+    if(c.beta == 0.0f){
+        for(size_t r = 0; r < c.m; r++){
+            for(size_t col = 0; col < c.n; col++){
+                result.data[r * result.ld + col] = NaN;
+            }
+        }
+    }
+    const Operand initial = result;
+
+    if(c.workspace){
+        std::vector<float> workspace(gemm_workspace_size(c.m, c.n, c.k) + 16);
+        // the workspace has to be 64 byte aligned
+        float* aligned = workspace.data();
+        while(reinterpret_cast<uintptr_t>(aligned) % 64 != 0){
+            aligned++;
+        }
+        gemm(c.trans_a, c.trans_b, c.m, c.n, c.k, c.alpha, a.data.data(), a.ld, b.data.data(), b.ld,
+             c.beta, result.data.data(), result.ld, aligned);
+    }else{
+        gemm(c.trans_a, c.trans_b, c.m, c.n, c.k, c.alpha, a.data.data(), a.ld, b.data.data(), b.ld,
+             c.beta, result.data.data(), result.ld);
+    }
+
+    for(size_t r = 0; r < c.m; r++){
+        for(size_t col = 0; col < c.n; col++){
+            double sum = 0.0, magnitude = 0.0;
+            for(size_t p = 0; p < c.k; p++){
+                double product = double(ta ? a.at(p, r) : a.at(r, p)) * (tb ? b.at(col, p) : b.at(p, col));
+                sum += product;
+                magnitude += std::abs(product);
+            }
+            double expected = c.alpha * sum;
+            if(c.beta != 0.0f){
+                expected += c.beta * double(initial.at(r, col));
+                magnitude = std::abs(c.alpha) * magnitude + std::abs(c.beta * initial.at(r, col));
+            }else{
+                magnitude *= std::abs(c.alpha);
+            }
+            double error = std::abs(result.at(r, col) - expected);
+            check(error <= 1e-5 * (magnitude + 1.0), describe(c) + ": wrong element (" + std::to_string(r) + ", "
+                  + std::to_string(col) + ")");
+        }
+        for(size_t col = c.n; col < result.ld; col++){
+            check(std::isnan(result.at(r, col)), describe(c) + ": wrote past the width of C");
+        }
+    }
+}
+
+// the instruction sets this cpu runs, gemm_set_isa clamps the others
+std::vector<GemmIsa> supported_isas()
+{
+    std::vector<GemmIsa> isas;
+    for(GemmIsa isa : {GemmIsa::scalar, GemmIsa::avx2, GemmIsa::avx512}){
+        gemm_set_isa(isa);
+        if(gemm_get_isa() == isa){
+            isas.push_back(isa);
+        }
+    }
+    return isas;
+}
+
+void test_shapes()
+{
+    std::mt19937 rng(1);
+    // 1, sizes around every micro tile (4 x 8, 6 x 16, 6 x 32) and primes that leave partial ones
+    const size_t sizes[] = {1, 2, 5, 7, 17, 33, 47};
+    for(GemmIsa isa : supported_isas()){
+        gemm_set_isa(isa);
+        for(Transpose trans_a : {Transpose::no, Transpose::yes}){
+            for(Transpose trans_b : {Transpose::no, Transpose::yes}){
+                for(size_t m : sizes){
+                    for(size_t n : sizes){
+                        for(size_t k : sizes){
+                            check_case({trans_a, trans_b, m, n, k, (m + n + k) % 3 * 5, 1.0f, 0.0f, false}, rng);
+                            check_case({trans_a, trans_b, m, n, k, 3, -0.5f, 2.0f, (m + n) % 2 == 0}, rng);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// blocks larger than MC x KC and panels wider than NC, so the edges of the blocking are hit too
+void test_large()
+{
+    std::mt19937 rng(2);
+    const Case cases[] = {
+        {Transpose::no, Transpose::no, 131, 67, 301, 0, 1.0f, 0.0f, false},
+        {Transpose::yes, Transpose::no, 127, 45, 259, 7, 0.75f, 1.0f, true},
+        {Transpose::no, Transpose::yes, 61, 2053, 19, 1, 1.0f, 0.5f, false},
+        {Transpose::yes, Transpose::yes, 245, 35, 513, 16, 1.0f, 0.0f, true},
+        {Transpose::no, Transpose::no, 1, 2051, 300, 2, 1.0f, 1.0f, false},
+        {Transpose::yes, Transpose::no, 1, 77, 300, 2, 1.0f, 0.0f, true},
+        {Transpose::no, Transpose::no, 300, 1, 257, 2, 1.0f, 1.0f, false},
+        {Transpose::yes, Transpose::no, 300, 1, 257, 3, 1.0f, 0.0f, true},
+    };
+    for(GemmIsa isa : supported_isas()){
+        gemm_set_isa(isa);
+        for(const Case& c : cases){
+            check_case(c, rng);
+        }
+    }
+}
+
+// 0 * inf is NaN, a zero element of the vector must not skip its row or column of the matrix
+void test_non_finite()
+{
+    for(GemmIsa isa : supported_isas()){
+        gemm_set_isa(isa);
+        const float inf = std::numeric_limits<float>::infinity();
+        std::vector<float> x = {0.0f, 1.0f, 0.0f, 1.0f};
+        std::vector<float> matrix(4 * 3, 1.0f);
+        matrix[0 * 3 + 1] = inf; // row 0 meets x[0] = 0
+        std::vector<float> y(3);
+        // row vector times matrix (gemv_t)
+        gemm(Transpose::no, Transpose::no, 1, 3, 4, 1.0f, x.data(), 4, matrix.data(), 3, 0.0f, y.data(), 3);
+        check(std::isnan(y[1]) && y[0] == 2.0f && y[2] == 2.0f,
+              std::string(gemm_isa_name(isa)) + ": 0 * inf didn't reach the row vector product");
+        // transposed matrix times column vector (gemv_t)
+        gemm(Transpose::yes, Transpose::no, 3, 1, 4, 1.0f, matrix.data(), 3, x.data(), 1, 0.0f, y.data(), 1);
+        check(std::isnan(y[1]) && y[0] == 2.0f && y[2] == 2.0f,
+              std::string(gemm_isa_name(isa)) + ": 0 * inf didn't reach the column vector product");
+    }
+}
+
+}
+
+int main()
+{
+    const std::vector<std::pair<const char*,void(*)()>> tests = {
+        {"odd shapes",test_shapes},
+        {"large shapes",test_large},
+        {"non finite",test_non_finite},
+    };
+    GemmIsa detected = gemm_get_isa();
+    std::cout << "instruction sets:";
+    for(GemmIsa isa : supported_isas()){
+        std::cout << " " << gemm_isa_name(isa);
+    }
+    std::cout << std::endl;
+    int failed = 0;
+    for(const auto& test : tests)
+    {
+        try
+        {
+            test.second();
+            std::cout << "ok     " << test.first << std::endl;
+        }
+        catch(std::exception& e)
+        {
+            std::cout << "FAILED " << test.first << ": " << e.what() << std::endl;
+            failed++;
+        }
+    }
+    gemm_set_isa(detected);
+    return failed ? 1 : 0;
+}